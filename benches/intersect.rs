@@ -0,0 +1,160 @@
+//! Intersections per second of the nearest-hit loop, over sphere-only and
+//! triangle-only scenes, with the shapes behind `Box<dyn Intersectable>` (as
+//! Object held them before), in a `Vec<Shape>` matched per shape, and in the
+//! per-type arrays of ObjectList. `cargo bench --bench intersect`
+//!
+//! Criterion-like: a warm-up, then SAMPLES timed samples of the same number
+//! of rays, reported as median [min max].
+
+use ray_tracing_image::object::{
+    Intersectable, Object, ObjectList, Plane, Shape, Sphere, Triangle,
+};
+use ray_tracing_image::ray::Ray;
+use ray_tracing_image::utils::Float3;
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+const SHAPES: usize = 256;
+const RAYS: usize = 4096;
+const SAMPLES: usize = 20;
+const WARM_UP: Duration = Duration::from_millis(500);
+
+struct Xorshift(u64);
+
+impl Xorshift {
+    fn next(&mut self) -> f32 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        return (self.0 >> 40) as f32 / (1u64 << 24) as f32;
+    }
+
+    fn float3(&mut self, scale: f32) -> Float3 {
+        return Float3::new(
+            scale * self.next(),
+            scale * self.next(),
+            scale * self.next(),
+        );
+    }
+}
+
+fn spheres(rng: &mut Xorshift) -> Vec<Shape> {
+    return (0..SHAPES)
+        .map(|_| Sphere::new(rng.float3(100.0), 1.0 + 4.0 * rng.next()).into())
+        .collect();
+}
+
+fn triangles(rng: &mut Xorshift) -> Vec<Shape> {
+    return (0..SHAPES)
+        .map(|_| {
+            let p1 = rng.float3(100.0);
+            let p2 = p1 + &rng.float3(20.0);
+            let p3 = p1 + &rng.float3(20.0);
+            Triangle::new(p1, p2, p3).into()
+        })
+        .collect();
+}
+
+/// From the middle of the scene towards all directions
+fn rays(rng: &mut Xorshift) -> Vec<Ray> {
+    let center = Float3::new(50.0, 50.0, 50.0);
+    return (0..RAYS)
+        .map(|_| {
+            let dir = rng.float3(2.0) - &Float3::new(1.0, 1.0, 1.0);
+            Ray::new_norm(center, dir)
+        })
+        .collect();
+}
+
+fn boxed(shape: &Shape) -> Box<dyn Intersectable + Sync + Send> {
+    return match shape {
+        Shape::Sphere(sphere) => Box::new(sphere.clone()),
+        Shape::Plane(plane) => Box::new(Plane::new(plane.a, plane.b, plane.c, plane.d)),
+        Shape::Triangle(triangle) => Box::new(triangle.clone()),
+    };
+}
+
+fn nearest<T: Intersectable + ?Sized>(shapes: &[Box<T>], ray: &Ray) -> Option<f32> {
+    let mut nearest: Option<f32> = None;
+    for shape in shapes {
+        if let Some(t) = shape.intersect(ray) {
+            if nearest.is_none() || t < nearest.unwrap() {
+                nearest = Some(t);
+            }
+        }
+    }
+    return nearest;
+}
+
+fn nearest_enum(shapes: &[Shape], ray: &Ray) -> Option<f32> {
+    let mut nearest: Option<f32> = None;
+    for shape in shapes {
+        if let Some(t) = shape.intersect(ray) {
+            if nearest.is_none() || t < nearest.unwrap() {
+                nearest = Some(t);
+            }
+        }
+    }
+    return nearest;
+}
+
+/// Prints the intersections per second of `pass`, which tests RAYS rays
+/// against SHAPES shapes
+fn bench(name: &str, mut pass: impl FnMut()) {
+    let start = Instant::now();
+    while start.elapsed() < WARM_UP {
+        pass();
+    }
+    let mut rates: Vec<f64> = (0..SAMPLES)
+        .map(|_| {
+            let start = Instant::now();
+            pass();
+            (RAYS * SHAPES) as f64 / start.elapsed().as_secs_f64()
+        })
+        .collect();
+    rates.sort_by(|a, b| a.partial_cmp(b).unwrap());
+    println!(
+        "{:<24} {:>8.1} M/s [{:.1} {:.1}]",
+        name,
+        rates[SAMPLES / 2] / 1e6,
+        rates[0] / 1e6,
+        rates[SAMPLES - 1] / 1e6
+    );
+}
+
+fn main() {
+    let mut rng = Xorshift(0x2545F4914F6CDD1D);
+    let rays = rays(&mut rng);
+    let scenes = [
+        ("spheres", spheres(&mut rng)),
+        ("triangles", triangles(&mut rng)),
+    ];
+    println!(
+        "{} rays x {} shapes a sample, intersections/s",
+        RAYS, SHAPES
+    );
+    for (name, shapes) in scenes {
+        let dyns: Vec<_> = shapes.iter().map(boxed).collect();
+        let color = Float3::new(0.5, 0.5, 0.5);
+        let objs: Vec<Object> = shapes
+            .iter()
+            .map(|shape| Object::new(shape.clone(), color, 0.0, 0.0))
+            .collect();
+        let list = ObjectList::new(objs);
+        bench(&format!("{} dyn", name), || {
+            for ray in &rays {
+                black_box(nearest(&dyns, black_box(ray)));
+            }
+        });
+        bench(&format!("{} enum", name), || {
+            for ray in &rays {
+                black_box(nearest_enum(&shapes, black_box(ray)));
+            }
+        });
+        bench(&format!("{} arrays", name), || {
+            for ray in &rays {
+                black_box(list.nearest(black_box(ray), usize::MAX));
+            }
+        });
+    }
+}
@@ -0,0 +1,231 @@
+//! Time of one pass of per-pixel jobs, and of empty jobs, through the
+//! work-stealing ThreadPool and through the mpsc pool it replaced, at 1 to
+//! 128 threads, and time of an execute() while every worker is busy.
+//! `cargo bench --bench threadpool`
+
+use ray_tracing_image::camera::Camera;
+use ray_tracing_image::object::{Object, ObjectList, Sphere};
+use ray_tracing_image::ray::Ray;
+use ray_tracing_image::threadpool::ThreadPool;
+use ray_tracing_image::trace_ray;
+use ray_tracing_image::utils::Float3;
+use std::hint::black_box;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread;
+use std::time::{Duration, Instant};
+
+const WIDTH: usize = 160;
+const HEIGHT: usize = 120;
+const SPHERES: usize = 64;
+const REPEATS: usize = 3;
+/// length of the jobs that keep the workers busy
+const BUSY_MS: u64 = 50;
+
+/// The pool of src/threadpool.rs before the work-stealing one: one channel
+/// behind a Mutex, and a Mutex<usize> counting the jobs left.
+mod mpsc_pool {
+    use std::sync::{mpsc, Arc, Mutex};
+    use std::thread;
+
+    pub struct ThreadPool {
+        workers: Vec<Option<thread::JoinHandle<()>>>,
+        sender: Option<mpsc::Sender<Job>>,
+        waiter: mpsc::Receiver<()>,
+        todos: Arc<Mutex<usize>>,
+    }
+
+    type Job = Box<dyn FnOnce() + Send + 'static>;
+
+    impl ThreadPool {
+        pub fn new(size: usize) -> Self {
+            let (sender, receiver) = mpsc::channel::<Job>();
+            let receiver = Arc::new(Mutex::new(receiver));
+            let (interrupt, waiter) = mpsc::channel();
+            let todos = Arc::new(Mutex::new(0));
+            let workers = (0..size)
+                .map(|_| {
+                    let receiver = Arc::clone(&receiver);
+                    let todos = Arc::clone(&todos);
+                    let interrupt = interrupt.clone();
+                    Some(thread::spawn(move || loop {
+                        let message = receiver.lock().unwrap().recv();
+                        match message {
+                            Ok(job) => job(),
+                            Err(_) => break,
+                        }
+                        let mut n = todos.lock().unwrap();
+                        *n -= 1;
+                        if *n == 0 {
+                            interrupt.send(()).unwrap();
+                        }
+                    }))
+                })
+                .collect();
+            ThreadPool {
+                workers,
+                sender: Some(sender),
+                waiter,
+                todos,
+            }
+        }
+
+        pub fn execute<F: FnOnce() + Send + 'static>(&self, f: F) {
+            self.sender.as_ref().unwrap().send(Box::new(f)).unwrap();
+        }
+
+        pub fn wait(&self) {
+            self.waiter.recv().unwrap();
+        }
+
+        pub fn add(&self, todos: usize) {
+            *self.todos.lock().unwrap() += todos;
+        }
+    }
+
+    impl Drop for ThreadPool {
+        fn drop(&mut self) {
+            drop(self.sender.take());
+            for worker in &mut self.workers {
+                worker.take().unwrap().join().unwrap();
+            }
+        }
+    }
+}
+
+struct Scene {
+    camera: Camera,
+    objs: ObjectList,
+}
+
+/// Spheres in front of the camera, one ray per pixel: the jobs are as short
+/// as they get in shoot_and_draw.
+fn random_scene() -> Scene {
+    let mut state = 0x2545F4914F6CDD1Du64;
+    let mut next = move || {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        (state >> 40) as f32 / (1u64 << 24) as f32
+    };
+    let objs: Vec<Object> = (0..SPHERES)
+        .map(|_| {
+            let center = Float3::new(
+                20.0 + 40.0 * next(),
+                40.0 * next() - 20.0,
+                30.0 * next() - 15.0,
+            );
+            let color = Float3::new(next(), next(), next());
+            Object::new(
+                Sphere::new(center, 1.0 + 3.0 * next()),
+                color,
+                next(),
+                next(),
+            )
+        })
+        .collect();
+    let ray = Ray::new_norm(Float3::new(0.0, 0.0, 0.0), Float3::new(1.0, 0.0, 0.0));
+    let camera = Camera::new_rectangle(&ray, 1.0, WIDTH, HEIGHT, 1);
+    return Scene {
+        camera,
+        objs: ObjectList::new(objs),
+    };
+}
+
+fn pixel_job(scene: &Arc<Scene>, i: usize) -> impl FnOnce() + Send + 'static {
+    let scene = Arc::clone(scene);
+    let background = Float3::new(0.1, 0.1, 0.1);
+    return move || {
+        for ray in scene.camera.pixel_rays(i) {
+            black_box(trace_ray(&ray, &scene.objs, 4, &background));
+        }
+    };
+}
+
+/// The slowest of `threads` execute() of an empty job, one per queue, while
+/// every worker runs a job of BUSY_MS, in ms
+fn busy_execute_ms(threads: usize) -> f64 {
+    let pool = ThreadPool::new(threads);
+    let started = Arc::new(AtomicUsize::new(0));
+    pool.execute_batch((0..threads).map(|_| {
+        let started = Arc::clone(&started);
+        move || {
+            started.fetch_add(1, Ordering::AcqRel);
+            thread::sleep(Duration::from_millis(BUSY_MS));
+        }
+    }));
+    while started.load(Ordering::Acquire) < threads {
+        thread::yield_now();
+    }
+    let slowest = (0..threads)
+        .map(|_| {
+            let start = Instant::now();
+            pool.execute(|| {});
+            start.elapsed().as_secs_f64() * 1e3
+        })
+        .fold(0.0, f64::max);
+    pool.wait();
+    return slowest;
+}
+
+/// The fastest of REPEATS runs of `pass`, in ms
+fn best_ms(mut pass: impl FnMut()) -> f64 {
+    return (0..REPEATS)
+        .map(|_| {
+            let start = Instant::now();
+            pass();
+            start.elapsed().as_secs_f64() * 1e3
+        })
+        .fold(f64::INFINITY, f64::min);
+}
+
+fn main() {
+    let scene = Arc::new(random_scene());
+    let jobs = WIDTH * HEIGHT;
+    println!("{} jobs a pass, best of {}", jobs, REPEATS);
+    println!(
+        "{:>8} {:>12} {:>12} {:>14} {:>14}",
+        "threads", "mpsc ms", "stealing ms", "mpsc ns/job", "stealing ns/job"
+    );
+    for threads in (0..8).map(|i| 1 << i) {
+        let old = mpsc_pool::ThreadPool::new(threads);
+        let old_pass = best_ms(|| {
+            old.add(jobs);
+            for i in 0..jobs {
+                old.execute(pixel_job(&scene, i));
+            }
+            old.wait();
+        });
+        let old_empty = best_ms(|| {
+            old.add(jobs);
+            for _ in 0..jobs {
+                old.execute(|| {});
+            }
+            old.wait();
+        });
+        drop(old);
+        let new = ThreadPool::new(threads);
+        let new_pass = best_ms(|| {
+            new.execute_batch((0..jobs).map(|i| pixel_job(&scene, i)));
+            new.wait();
+        });
+        let new_empty = best_ms(|| {
+            new.execute_batch((0..jobs).map(|_| || {}));
+            new.wait();
+        });
+        drop(new);
+        println!(
+            "{:>8} {:>12.2} {:>12.2} {:>14.0} {:>14.0}",
+            threads,
+            old_pass,
+            new_pass,
+            old_empty * 1e6 / jobs as f64,
+            new_empty * 1e6 / jobs as f64
+        );
+    }
+    println!("execute() while the workers run {} ms jobs", BUSY_MS);
+    println!("{:>8} {:>12}", "threads", "slowest ms");
+    for threads in (0..8).map(|i| 1 << i) {
+        println!("{:>8} {:>12.3}", threads, busy_execute_ms(threads));
+    }
+}
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "algebra.h"
+#include "bvh.h"
+#include "draw.h"
+#include "object.h"
+#include "rng.h"
+#include "soa.h"
+
+// Random triangles (plus one sphere every 16) scattered in a 1000^3 cube,
+// hit by rays from random points towards the cube.
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Float3 random_float3(Rng* rng, const float scale) {
+	return float3_new(scale * rng_next_float(rng), scale * rng_next_float(rng),
+					  scale * rng_next_float(rng));
+}
+
+ObjectVec random_scene(const int n, Rng* rng) {
+	ObjectVec objects = objectvec_new(n);
+	const Float3 color = float3_new(.5, .5, .5);
+	const Material material = material_new(&color, 0, 0);
+	const int gray = object_vec_push_material(&objects, &material);
+	const float size = 1000.0f / cbrtf(n);
+	for (int i = 0; i < n; i++) {
+		const Float3 p1 = random_float3(rng, 1000);
+		if (i % 16 == 15) {
+			Shape shape;
+			shape.sphere = sphere_new(&p1, size * rng_next_float(rng) / 2);
+			const Object object = object_new(TYPE_SPHERE, &shape, gray);
+			object_vec_push(&objects, &object);
+		} else {
+			const Float3 d2 = random_float3(rng, size);
+			const Float3 d3 = random_float3(rng, size);
+			const Float3 p2 = float3_add(&p1, &d2);
+			const Float3 p3 = float3_add(&p1, &d3);
+			object_vec_push_triangle(&objects, &p1, &p2, &p3, gray);
+		}
+	}
+	return objects;
+}
+
+Ray3 random_ray(Rng* rng) {
+	const Float3 origin = random_float3(rng, 2000);
+	const Float3 target = random_float3(rng, 1000);
+	Float3 direction = float3_sub(&target, &origin);
+	float3_normalize_eq(&direction);
+	return ray3_new(&origin, &direction);
+}
+
+int main() {
+	const int sizes[] = {10, 100, 1000, 10000, 100000, 1000000};
+	const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	printf("%10s %10s %14s %14s %10s %10s\n", "objects", "build ms",
+		   "linear ns/ray", "bvh ns/ray", "speedup", "mismatch");
+	for (int s = 0; s < n_sizes; s++) {
+		const int n = sizes[s];
+		Rng rng = rng_new(42, s);
+		ObjectVec objects = random_scene(n, &rng);
+
+		double start = now_seconds();
+		Bvh bvh = bvh_new(&objects, intersect_kernels_best_type());
+		const double build_ms = (now_seconds() - start) * 1e3;
+
+		// keep the linear scan to ~2e8 intersections per size
+		const int n_rays = 200000;
+		const int n_linear = n_rays < 200000000 / n ? n_rays : 200000000 / n;
+		Ray3* rays = malloc(sizeof(Ray3) * n_rays);
+		Object** found = malloc(sizeof(Object*) * n_rays);
+		float* found_distance = malloc(sizeof(float) * n_rays);
+		if (rays == NULL || found == NULL || found_distance == NULL) {
+			fprintf(stderr, "Error: malloc failed\n");
+			exit(-1);
+		}
+		for (int i = 0; i < n_rays; i++) rays[i] = random_ray(&rng);
+
+		start = now_seconds();
+		for (int i = 0; i < n_linear; i++)
+			found[i] =
+				nearest_object_linear(&rays[i], &objects, &found_distance[i]);
+		const double linear_ns = (now_seconds() - start) * 1e9 / n_linear;
+
+		int mismatch = 0;
+		start = now_seconds();
+		for (int i = 0; i < n_rays; i++) {
+			float distance;
+			Object* obj = bvh_nearest_object(&bvh, &rays[i], &distance);
+			// the kernels use Möller–Trumbore, so allow for rounding
+			if (i < n_linear &&
+				(obj != found[i] ||
+				 (obj != NULL && fabsf(distance - found_distance[i]) >
+									 1e-3f * found_distance[i])))
+				mismatch++;
+		}
+		const double bvh_ns = (now_seconds() - start) * 1e9 / n_rays;
+
+		printf("%10d %10.1f %14.1f %14.1f %9.1fx %10d\n", n, build_ms,
+			   linear_ns, bvh_ns, linear_ns / bvh_ns, mismatch);
+		free(rays);
+		free(found);
+		free(found_distance);
+		bvh_free(&bvh);
+		object_vec_free(&objects);
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "algebra.h"
+#include "object.h"
+#include "rng.h"
+#include "soa.h"
+
+// Intersections per second of every kernel against one long SoA range, next
+// to the per-Object path (object_intersect_distance()) they replace. Then
+// counts the rays that slip through the shared edges of a closed mesh.
+
+#define N_PRIMITIVES 4096
+#define N_RAYS 4096
+#define GRID 32
+#define N_EDGE_RAYS 16384
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Float3 random_float3(Rng* rng, const float scale) {
+	return float3_new(scale * rng_next_float(rng), scale * rng_next_float(rng),
+					  scale * rng_next_float(rng));
+}
+
+void random_object(ObjectVec* objects, const int shape_type, Rng* rng) {
+	const Float3 p1 = random_float3(rng, 1000);
+	if (shape_type == TYPE_SPHERE) {
+		Shape shape;
+		shape.sphere = sphere_new(&p1, 5 + 20 * rng_next_float(rng));
+		const Object object = object_new(TYPE_SPHERE, &shape, 0);
+		object_vec_push(objects, &object);
+	} else {
+		const Float3 d2 = random_float3(rng, 50);
+		const Float3 d3 = random_float3(rng, 50);
+		const Float3 p2 = float3_add(&p1, &d2);
+		const Float3 p3 = float3_add(&p1, &d3);
+		object_vec_push_triangle(objects, &p1, &p2, &p3, 0);
+	}
+}
+
+ObjectVec gray_objects(const int n) {
+	ObjectVec objects = objectvec_new(n);
+	const Float3 color = float3_new(.5, .5, .5);
+	const Material material = material_new(&color, 0, 0);
+	object_vec_push_material(&objects, &material);
+	return objects;
+}
+
+Ray3 random_ray(Rng* rng) {
+	const Float3 origin = random_float3(rng, 2000);
+	const Float3 target = random_float3(rng, 1000);
+	Float3 direction = float3_sub(&target, &origin);
+	float3_normalize_eq(&direction);
+	return ray3_new(&origin, &direction);
+}
+
+// A GRID x GRID height field, two triangles per cell sharing the diagonal,
+// indexed into (GRID + 1)^2 shared vertices
+void mesh_new(ObjectVec* objects, TriangleSoa* soa, Rng* rng) {
+	for (int y = 0; y <= GRID; y++) {
+		for (int x = 0; x <= GRID; x++) {
+			const Float3 vertex =
+				float3_new(10 * x + 6 * rng_next_float(rng) - 3,
+						   10 * y + 6 * rng_next_float(rng) - 3,
+						   5 * rng_next_float(rng));
+			object_vec_push_vertex(objects, &vertex);
+		}
+	}
+	const uint32_t cells[2][3] = {{0, 1, GRID + 2}, {0, GRID + 2, GRID + 1}};
+	for (int y = 0; y < GRID; y++) {
+		for (int x = 0; x < GRID; x++) {
+			const uint32_t v00 = y * (GRID + 1) + x;
+			for (int t = 0; t < 2; t++) {
+				Shape shape;
+				for (int v = 0; v < 3; v++)
+					shape.triangle.v[v] = v00 + cells[t][v];
+				const Object object = object_new(TYPE_TRIANGLE, &shape, 0);
+				const uint32_t* i = shape.triangle.v;
+				triangle_soa_push(soa, &objects->vertices[i[0]],
+								  &objects->vertices[i[1]],
+								  &objects->vertices[i[2]], objects->size);
+				object_vec_push(objects, &object);
+			}
+		}
+	}
+}
+
+// From above the mesh to a random point of an inner edge. Rays are steep
+// enough to never graze a ridge, so every miss is a leak.
+Ray3 edge_ray(const Float3* vertices, Rng* rng) {
+	const int x = rng_next_float(rng) * (GRID - 1);
+	const int y = rng_next_float(rng) * (GRID - 1);
+	const Float3* v00 = &vertices[y * (GRID + 1) + x];
+	const float edge = rng_next_float(rng);
+	const Float3* a =
+		edge < 1 / 3.0 ? v00 : (edge < 2 / 3.0 ? v00 + 1 : v00 + GRID + 1);
+	const Float3* b = v00 + GRID + 2;
+	Float3 target = float3_sub(b, a);
+	float3_mul_eq(&target, rng_next_float(rng));
+	float3_add_eq(&target, a);
+	Float3 origin = random_float3(rng, 100);
+	origin.x += target.x - 50;
+	origin.y += target.y - 50;
+	origin.z = 500;
+	Float3 direction = float3_sub(&target, &origin);
+	float3_normalize_eq(&direction);
+	return ray3_new(&origin, &direction);
+}
+
+void report(const char* shape, const char* path, const double seconds,
+			const int mismatch) {
+	const double rate = (double)N_PRIMITIVES * N_RAYS / seconds;
+	printf("%-10s %-8s %10.1f M/s %10d\n", shape, path, rate * 1e-6, mismatch);
+}
+
+int main() {
+	Rng rng = rng_new(42, 0);
+	ObjectVec objects[2] = {gray_objects(N_PRIMITIVES),
+							gray_objects(N_PRIMITIVES)};
+	SphereSoa spheres = sphere_soa_new(N_PRIMITIVES);
+	TriangleSoa triangles = triangle_soa_new(N_PRIMITIVES);
+	Ray3* rays = malloc(sizeof(Ray3) * N_RAYS);
+	int* nearest = malloc(sizeof(int) * N_RAYS);
+	if (rays == NULL || nearest == NULL) {
+		fprintf(stderr, "Error: malloc failed\n");
+		exit(-1);
+	}
+	for (int i = 0; i < N_PRIMITIVES; i++) {
+		random_object(&objects[0], TYPE_SPHERE, &rng);
+		random_object(&objects[1], TYPE_TRIANGLE, &rng);
+		sphere_soa_push(&spheres, &objects[0].ptr[i].shape.sphere, i);
+		const Float3* v = &objects[1].vertices[3 * i];
+		triangle_soa_push(&triangles, &v[0], &v[1], &v[2], i);
+	}
+	for (int i = 0; i < N_RAYS; i++) rays[i] = random_ray(&rng);
+
+	// mismatch: rays whose nearest primitive differs from the object path
+	printf("%-10s %-8s %14s %10s\n", "shape", "path", "intersections",
+		   "mismatch");
+	const char* shape_names[2] = {"sphere", "triangle"};
+	for (int s = 0; s < 2; s++) {
+		double start = now_seconds();
+		for (int r = 0; r < N_RAYS; r++) {
+			SoaHit hit = soa_hit_new();
+			for (int i = 0; i < N_PRIMITIVES; i++)
+				soa_hit_update(&hit,
+							   object_intersect_distance(
+								   &objects[s], &objects[s].ptr[i], &rays[r]),
+							   i);
+			nearest[r] = hit.object;
+		}
+		report(shape_names[s], "object", now_seconds() - start, 0);
+
+		for (int type = KERNELS_SCALAR; type <= intersect_kernels_best_type();
+			 type++) {
+			const IntersectKernels kernels = intersect_kernels(type);
+			start = now_seconds();
+			int mismatch = 0;
+			for (int r = 0; r < N_RAYS; r++) {
+				SoaHit hit = soa_hit_new();
+				if (s == 0)
+					kernels.spheres(&spheres, 0, N_PRIMITIVES, &rays[r], &hit);
+				else
+					kernels.triangles(&triangles, 0, N_PRIMITIVES, &rays[r],
+									  &hit);
+				mismatch += hit.object != nearest[r];
+			}
+			report(shape_names[s], kernels.name, now_seconds() - start,
+				   mismatch);
+		}
+	}
+
+	// leaks: rays aimed at an inner edge that hit neither of its triangles
+	const int mesh_size = 2 * GRID * GRID;
+	ObjectVec mesh = gray_objects(mesh_size);
+	TriangleSoa mesh_soa = triangle_soa_new(mesh_size);
+	mesh_new(&mesh, &mesh_soa, &rng);
+	printf("\n%-19s %10s\n", "mesh", "leaks");
+	int leaks = 0;
+	Rng edge_rng = rng_new(43, 0);
+	for (int r = 0; r < N_EDGE_RAYS; r++) {
+		const Ray3 ray = edge_ray(mesh.vertices, &edge_rng);
+		SoaHit hit = soa_hit_new();
+		for (int i = 0; i < mesh_size; i++)
+			soa_hit_update(&hit,
+						   object_intersect_distance(&mesh, &mesh.ptr[i], &ray),
+						   i);
+		leaks += hit.object < 0;
+	}
+	printf("%-10s %-8s %10d / %d\n", "triangle", "object", leaks, N_EDGE_RAYS);
+	for (int type = KERNELS_SCALAR; type <= intersect_kernels_best_type();
+		 type++) {
+		const IntersectKernels kernels = intersect_kernels(type);
+		leaks = 0;
+		edge_rng = rng_new(43, 0);
+		for (int r = 0; r < N_EDGE_RAYS; r++) {
+			const Ray3 ray = edge_ray(mesh.vertices, &edge_rng);
+			SoaHit hit = soa_hit_new();
+			kernels.triangles(&mesh_soa, 0, mesh_size, &ray, &hit);
+			leaks += hit.object < 0;
+		}
+		printf("%-10s %-8s %10d / %d\n", "triangle", kernels.name, leaks,
+			   N_EDGE_RAYS);
+	}
+
+	triangle_soa_free(&mesh_soa);
+	object_vec_free(&mesh);
+	sphere_soa_free(&spheres);
+	triangle_soa_free(&triangles);
+	object_vec_free(&objects[0]);
+	object_vec_free(&objects[1]);
+	free(rays);
+	free(nearest);
+	return 0;
+}
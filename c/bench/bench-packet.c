@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "algebra.h"
+#include "bvh.h"
+#include "camera.h"
+#include "object.h"
+#include "packet.h"
+#include "rng.h"
+#include "soa.h"
+
+// Primary rays of a camera looking at the scene of bench-bvh, traced one by
+// one with bvh_nearest_object() and PACKET_SIZE at a time with
+// bvh_nearest_packet(), pixel by pixel as shoot_a_pixel() does.
+
+#define WIDTH 256
+#define HEIGHT 256
+#define SQRT_RAY_PER_PIXEL 4
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Float3 random_float3(Rng* rng, const float scale) {
+	return float3_new(scale * rng_next_float(rng), scale * rng_next_float(rng),
+					  scale * rng_next_float(rng));
+}
+
+ObjectVec random_scene(const int n, Rng* rng) {
+	ObjectVec objects = objectvec_new(n);
+	const Float3 color = float3_new(.5, .5, .5);
+	const Material material = material_new(&color, 0, 0);
+	const int gray = object_vec_push_material(&objects, &material);
+	const float size = 1000.0f / cbrtf(n);
+	for (int i = 0; i < n; i++) {
+		const Float3 p1 = random_float3(rng, 1000);
+		if (i % 16 == 15) {
+			Shape shape;
+			shape.sphere = sphere_new(&p1, size * rng_next_float(rng) / 2);
+			const Object object = object_new(TYPE_SPHERE, &shape, gray);
+			object_vec_push(&objects, &object);
+		} else {
+			const Float3 d2 = random_float3(rng, size);
+			const Float3 d3 = random_float3(rng, size);
+			const Float3 p2 = float3_add(&p1, &d2);
+			const Float3 p3 = float3_add(&p1, &d3);
+			object_vec_push_triangle(&objects, &p1, &p2, &p3, gray);
+		}
+	}
+	return objects;
+}
+
+// The primary rays of every pixel, in the order shoot_a_pixel() makes them
+Ray3* camera_rays(const Camera* camera) {
+	const int ray_per_pixel = SQRT_RAY_PER_PIXEL * SQRT_RAY_PER_PIXEL;
+	Ray3* rays = malloc(sizeof(Ray3) * WIDTH * HEIGHT * ray_per_pixel);
+	if (rays == NULL) {
+		fprintf(stderr, "Error: malloc failed\n");
+		exit(-1);
+	}
+	int n = 0;
+	for (int i = 0; i < HEIGHT; i++) {
+		for (int j = 0; j < WIDTH; j++) {
+			Ray3 ray = camera->upper_left;
+			const Float3 offset_x = float3_mul(&camera->delta_x, j);
+			const Float3 offset_y = float3_mul(&camera->delta_y, i);
+			float3_add_eq(&ray.direction, &offset_x);
+			float3_add_eq(&ray.direction, &offset_y);
+			Float3 starting_direction = ray.direction;
+			for (int ii = 0; ii < SQRT_RAY_PER_PIXEL; ii++) {
+				ray.direction = starting_direction;
+				for (int jj = 0; jj < SQRT_RAY_PER_PIXEL; jj++) {
+					rays[n++] = ray;
+					float3_add_eq(&ray.direction, &camera->d_x);
+				}
+				float3_add_eq(&starting_direction, &camera->d_y);
+			}
+		}
+	}
+	return rays;
+}
+
+int main() {
+	const int sizes[] = {1000, 10000, 100000, 1000000};
+	const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	const Float3 position = float3_new(-1000, -1000, 1500);
+	const Float3 direction = float3_new(1500, 1500, -1000);
+	const Camera camera = camera_new(&position, &direction, 1, WIDTH, HEIGHT,
+									 SQRT_RAY_PER_PIXEL);
+	const int n_rays = WIDTH * HEIGHT * SQRT_RAY_PER_PIXEL * SQRT_RAY_PER_PIXEL;
+	Ray3* rays = camera_rays(&camera);
+	int* found = malloc(sizeof(int) * n_rays);
+	float* found_distance = malloc(sizeof(float) * n_rays);
+	if (found == NULL || found_distance == NULL) {
+		fprintf(stderr, "Error: malloc failed\n");
+		exit(-1);
+	}
+
+	// incoherent: packets traced one ray at a time
+	printf("packet size %d\n", PACKET_SIZE);
+	printf("%10s %14s %14s %10s %10s %10s\n", "objects", "single Mray/s",
+		   "packet Mray/s", "speedup", "incoherent", "mismatch");
+	for (int s = 0; s < n_sizes; s++) {
+		const int n = sizes[s];
+		Rng rng = rng_new(42, s);
+		ObjectVec objects = random_scene(n, &rng);
+		Bvh bvh = bvh_new(&objects, intersect_kernels_best_type());
+
+		double start = now_seconds();
+		for (int i = 0; i < n_rays; i++) {
+			float distance;
+			bvh_nearest_object(&bvh, &rays[i], &distance);
+		}
+		const double single_seconds = now_seconds() - start;
+
+		// the reference is the scalar kernels: the packet kernels round as
+		// they do, the SIMD single-ray ones may contract to fma. With -Ofast
+		// the compiler reassociates the scalar math, so a few grazing hits
+		// still differ in release; `make MODE=debug` shows none.
+		Bvh reference = bvh_new(&objects, KERNELS_SCALAR);
+		for (int i = 0; i < n_rays; i++) {
+			Object* obj =
+				bvh_nearest_object(&reference, &rays[i], &found_distance[i]);
+			found[i] = obj != NULL ? obj - objects.ptr : -1;
+		}
+		bvh_free(&reference);
+
+		int incoherent = 0, mismatch = 0;
+		RayPacket packet;
+		PacketHit hit;
+		start = now_seconds();
+		for (int i = 0; i + PACKET_SIZE <= n_rays; i += PACKET_SIZE) {
+			packet.origin = rays[i].origin;
+			for (int l = 0; l < PACKET_SIZE; l++) {
+				packet.dx[l] = rays[i + l].direction.x;
+				packet.dy[l] = rays[i + l].direction.y;
+				packet.dz[l] = rays[i + l].direction.z;
+			}
+			if (!ray_packet_prepare(&packet)) {
+				incoherent++;
+				for (int l = 0; l < PACKET_SIZE; l++) {
+					float distance;
+					bvh_nearest_object(&bvh, &rays[i + l], &distance);
+				}
+				continue;
+			}
+			bvh_nearest_packet(&bvh, &packet, &hit);
+			for (int l = 0; l < PACKET_SIZE; l++)
+				mismatch +=
+					hit.object[l] != found[i + l] ||
+					(hit.object[l] >= 0 &&
+					 fabsf(hit.distance[l] - found_distance[i + l]) >
+						 1e-3f * found_distance[i + l]);
+		}
+		const double packet_seconds = now_seconds() - start;
+
+		printf("%10d %14.2f %14.2f %9.1fx %10d %10d\n", n,
+			   n_rays / single_seconds * 1e-6, n_rays / packet_seconds * 1e-6,
+			   single_seconds / packet_seconds, incoherent, mismatch);
+		bvh_free(&bvh);
+		object_vec_free(&objects);
+	}
+	free(rays);
+	free(found);
+	free(found_distance);
+	return 0;
+}
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "algebra.h"
+#include "camera.h"
+#include "mesh_file.h"
+#include "object.h"
+#include "rng.h"
+#include "scanner.h"
+#include "scene_file.h"
+
+// Load time of random triangle soups, from the text format (scan_input) and
+// from the binary one (scene_file_load), then of OBJ grids (mesh_file_load)
+// on every core. The files go to /tmp.
+
+#define TEXT_MAX 1000000
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Float3 random_float3(Rng* rng, const float scale) {
+	return float3_new(scale * rng_next_float(rng), scale * rng_next_float(rng),
+					  scale * rng_next_float(rng));
+}
+
+void write_text_scene(const char* filename, const int n, Rng* rng) {
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	fprintf(file, "out.ppm 640 360 0 1 0 0 out.checkpoint 2 1 0\n"
+				  "-1000 -1000 1500 1500 1500 -1000 1 4 .1 .1 .1\n%d\n",
+			n);
+	for (int i = 0; i < n; i++) {
+		const Float3 p1 = random_float3(rng, 1000);
+		const Float3 p2 = random_float3(rng, 1000);
+		const Float3 p3 = random_float3(rng, 1000);
+		fprintf(file,
+				"triangle %.6g %.6g %.6g %.6g %.6g %.6g %.6g %.6g %.6g "
+				".5 .5 .5 0 0\n",
+				p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z);
+	}
+	fclose(file);
+}
+
+// A side x side grid of quads, with the vertices and faces of the OBJ format
+void write_obj_grid(const char* filename, const int side, Rng* rng) {
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	for (int i = 0; i <= side; i++)
+		for (int j = 0; j <= side; j++)
+			fprintf(file, "v %d %d %.6g\n", i, j, rng_next_float(rng));
+	for (int i = 0; i < side; i++) {
+		for (int j = 0; j < side; j++) {
+			const int a = i * (side + 1) + j + 1;
+			fprintf(file, "f %d %d %d %d\n", a, a + 1, a + side + 2,
+					a + side + 1);
+		}
+	}
+	fclose(file);
+}
+
+InputData random_scene(const int n, Rng* rng) {
+	InputData input_data;
+	input_data.color_ppm = NULL;
+	input_data.color_pfm = NULL;
+	input_data.albedo_pfm = NULL;
+	input_data.normal_pfm = NULL;
+	input_data.checkpoint = NULL;
+	input_data.checkpoint_seconds = 0;
+	input_data.n_threads = 0;
+	input_data.seed = 1;
+	input_data.number_of_updates = 1;
+	input_data.target_noise = 0;
+	input_data.max_bounces = 4;
+	input_data.background_color = float3_new(.1, .1, .1);
+	input_data.camera_position = float3_new(-1000, -1000, 1500);
+	input_data.camera_direction = float3_new(1500, 1500, -1000);
+	input_data.camera_angle = 1;
+	input_data.camera =
+		camera_new(&input_data.camera_position, &input_data.camera_direction,
+				   input_data.camera_angle, 640, 360, 2);
+	input_data.camera_path = camera_path_new();
+	input_data.objects = objectvec_new(n);
+	const Float3 color = float3_new(.5, .5, .5);
+	const Material material = material_new(&color, 0, 0);
+	const int gray = object_vec_push_material(&input_data.objects, &material);
+	for (int i = 0; i < n; i++) {
+		const Float3 p1 = random_float3(rng, 1000);
+		const Float3 p2 = random_float3(rng, 1000);
+		const Float3 p3 = random_float3(rng, 1000);
+		object_vec_push_triangle(&input_data.objects, &p1, &p2, &p3, gray);
+	}
+	return input_data;
+}
+
+int main() {
+	const int sizes[] = {100000, 1000000, 10000000};
+	const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	const char* text_file = "/tmp/bench-scene.txt";
+	const char* binary_file = "/tmp/bench-scene.bin";
+	printf("%10s %12s %12s %12s %12s\n", "triangles", "text ms", "text MB/s",
+		   "binary ms", "binary MB");
+	for (int s = 0; s < n_sizes; s++) {
+		const int n = sizes[s];
+		Rng rng = rng_new(42, s);
+
+		double text_ms = -1, text_mb = 0;
+		if (n <= TEXT_MAX) {
+			write_text_scene(text_file, n, &rng);
+			FILE* file = fopen(text_file, "r");
+			fseek(file, 0, SEEK_END);
+			text_mb = ftell(file) / 1e6;
+			rewind(file);
+			const double start = now_seconds();
+			InputData input_data = scan_input(file);
+			text_ms = (now_seconds() - start) * 1e3;
+			fclose(file);
+			object_vec_free(&input_data.objects);
+			remove(text_file);
+		}
+
+		InputData generated = random_scene(n, &rng);
+		scene_file_save(binary_file, &generated);
+		object_vec_free(&generated.objects);
+		FILE* file = fopen(binary_file, "rb");
+		fseek(file, 0, SEEK_END);
+		const double binary_mb = ftell(file) / 1e6;
+		fclose(file);
+		const double start = now_seconds();
+		InputData input_data = scene_file_load(binary_file);
+		const double binary_ms = (now_seconds() - start) * 1e3;
+		if (input_data.objects.size != n) {
+			fprintf(stderr, "Error: %d triangles loaded instead of %d\n",
+					input_data.objects.size, n);
+			exit(-1);
+		}
+		object_vec_free(&input_data.objects);
+		remove(binary_file);
+
+		if (text_ms < 0)
+			printf("%10d %12s %12s %12.1f %12.1f\n", n, "-", "-", binary_ms,
+				   binary_mb);
+		else
+			printf("%10d %12.1f %12.1f %12.1f %12.1f\n", n, text_ms,
+				   text_mb / text_ms * 1e3, binary_ms, binary_mb);
+	}
+
+	const int sides[] = {224, 708, 2237};
+	const int n_sides = sizeof(sides) / sizeof(sides[0]);
+	const char* obj_file = "/tmp/bench-scene.obj";
+	const Float3 zero = float3_new(0, 0, 0);
+	const Float3 color = float3_new(.5, .5, .5);
+	const MeshTransform transform = mesh_transform_new(&zero, &zero, 1);
+	printf("\n%10s %12s %12s\n", "obj tris", "obj ms", "obj MB/s");
+	for (int s = 0; s < n_sides; s++) {
+		Rng rng = rng_new(42, s);
+		write_obj_grid(obj_file, sides[s], &rng);
+		FILE* file = fopen(obj_file, "r");
+		fseek(file, 0, SEEK_END);
+		const double obj_mb = ftell(file) / 1e6;
+		fclose(file);
+		ObjectVec objects = objectvec_new(0);
+		const double start = now_seconds();
+		mesh_file_load(obj_file, &transform, &color, 0, 0, 0, &objects);
+		const double obj_ms = (now_seconds() - start) * 1e3;
+		printf("%10d %12.1f %12.1f\n", objects.size, obj_ms,
+			   obj_mb / obj_ms * 1e3);
+		object_vec_free(&objects);
+		remove(obj_file);
+	}
+	return 0;
+}
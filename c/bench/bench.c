@@ -0,0 +1,302 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "algebra.h"
+#include "bvh.h"
+#include "camera.h"
+#include "draw.h"
+#include "object.h"
+#include "packet.h"
+#include "rng.h"
+#include "scanner.h"
+#include "soa.h"
+#include "triangle.h"
+
+// Reference scenes rendered with fixed seeds on one thread, reported as JSON
+// on stdout so two versions can be compared. Run from c/ (`make MODE=release
+// bench`): the scene files are found relative to it.
+//
+// A pass renders a grid of about BENCH_PIXELS pixels spread over the whole
+// image of the scene, with every sample and bounce of the scene. Rays and
+// intersections are counted by the BVH (bvh_stats); ns per nearest_object is
+// timed apart, one pixel-centre primary ray per rendered pixel.
+//
+// Every pass is an independent estimate of a pixel: pixel_variance is the
+// variance of the luminance of one pass, averaged over the pixels, and
+// efficiency is 1 / (pixel_variance * seconds per pass). Samplers that trace
+// fewer rays or leave less noise for the same time have a higher one.
+
+#define BENCH_PIXELS 65536
+#define BENCH_PASSES 2
+#define BENCH_SEED 1
+
+typedef struct _BenchScene {
+	char name[64];
+	InputData input_data;
+	int stride;
+} BenchScene;
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Float3 random_float3(Rng* rng, const float scale) {
+	return float3_new(scale * rng_next_float(rng), scale * rng_next_float(rng),
+					  scale * rng_next_float(rng));
+}
+
+// Same scene as bench-bvh: triangles, plus one sphere every 16, in a 1000^3
+// cube. The last object is a big light above it.
+ObjectVec random_scene(const int n, Rng* rng) {
+	ObjectVec objects = objectvec_new(n + 1);
+	const Float3 color = float3_new(.5, .5, .5);
+	const Material material = material_new(&color, 0, 0);
+	const int gray = object_vec_push_material(&objects, &material);
+	const float size = 1000.0f / cbrtf(n);
+	for (int i = 0; i < n; i++) {
+		const Float3 p1 = random_float3(rng, 1000);
+		if (i % 16 == 15) {
+			Shape shape;
+			shape.sphere = sphere_new(&p1, size * rng_next_float(rng) / 2);
+			const Object object = object_new(TYPE_SPHERE, &shape, gray);
+			object_vec_push(&objects, &object);
+		} else {
+			const Float3 d2 = random_float3(rng, size);
+			const Float3 d3 = random_float3(rng, size);
+			const Float3 p2 = float3_add(&p1, &d2);
+			const Float3 p3 = float3_add(&p1, &d3);
+			object_vec_push_triangle(&objects, &p1, &p2, &p3, gray);
+		}
+	}
+	const Float3 center = float3_new(500, 500, 3000);
+	const Float3 white = float3_new(1, 1, 1);
+	const Material light_material = material_new(&white, 1, 0);
+	Shape light;
+	light.sphere = sphere_new(&center, 1000);
+	const Object object = object_new(
+		TYPE_SPHERE, &light, object_vec_push_material(&objects, &light_material));
+	object_vec_push(&objects, &object);
+	return objects;
+}
+
+int bench_stride(const Camera* camera) {
+	const int stride =
+		ceil(sqrt((double)camera->width * camera->height / BENCH_PIXELS));
+	return stride > 0 ? stride : 1;
+}
+
+BenchScene scene_from_file(const char* name, const char* filename) {
+	FILE* file = fopen(filename, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	BenchScene scene;
+	snprintf(scene.name, sizeof(scene.name), "%s", name);
+	scene.input_data = scan_input(file);
+	fclose(file);
+	scene.stride = bench_stride(&scene.input_data.camera);
+	return scene;
+}
+
+BenchScene scene_generated(const int n) {
+	BenchScene scene;
+	snprintf(scene.name, sizeof(scene.name), "random-%d", n);
+	InputData* input_data = &scene.input_data;
+	Rng rng = rng_new(42, n);
+	input_data->objects = random_scene(n, &rng);
+	input_data->camera_position = float3_new(-1000, -1000, 1500);
+	input_data->camera_direction = float3_new(1500, 1500, -1000);
+	input_data->camera_angle = 1;
+	input_data->camera =
+		camera_new(&input_data->camera_position, &input_data->camera_direction,
+				   input_data->camera_angle, 640, 360, 2);
+	input_data->max_bounces = 4;
+	input_data->background_color = float3_new(.1, .1, .1);
+	input_data->number_of_updates = BENCH_PASSES;
+	input_data->target_noise = 0;
+	input_data->n_threads = 1;
+	input_data->seed = BENCH_SEED;
+	input_data->color_ppm = NULL;
+	input_data->color_pfm = NULL;
+	input_data->albedo_pfm = NULL;
+	input_data->normal_pfm = NULL;
+	input_data->checkpoint = NULL;
+	input_data->checkpoint_seconds = 0;
+	input_data->resume = 0;
+	scene.stride = bench_stride(&input_data->camera);
+	return scene;
+}
+
+Ray3 pixel_ray(const Camera* camera, const int i, const int j) {
+	Ray3 ray = camera->upper_left;
+	const Float3 offset_x = float3_mul(&camera->delta_x, j);
+	const Float3 offset_y = float3_mul(&camera->delta_y, i);
+	float3_add_eq(&ray.direction, &offset_x);
+	float3_add_eq(&ray.direction, &offset_y);
+	return ray;
+}
+
+// One pass over the pixels of the grid, as render_tile() does them
+void bench_pass(const BenchScene* scene, Float3* pixel_sum,
+				const int pass_index) {
+	const InputData* input_data = &scene->input_data;
+	const Camera* camera = &input_data->camera;
+	int n = 0;
+	for (int i = 0; i < camera->height; i += scene->stride) {
+		for (int j = 0; j < camera->width; j += scene->stride, n++) {
+			const Ray3 ray = pixel_ray(camera, i, j);
+			Rng rng = rng_new(BENCH_SEED, ((uint64_t)pass_index << 32) | n);
+			PixelSums sums;
+			sums.color = &pixel_sum[n];
+			sums.albedo = NULL;
+			sums.normal = NULL;
+			shoot_a_pixel(&sums, camera->sqrt_ray_per_pixel, &ray, &camera->d_x,
+						  &camera->d_y, &input_data->bvh,
+						  input_data->max_bounces,
+						  &input_data->background_color, trace_ray, &rng);
+		}
+	}
+}
+
+void bench_scene(BenchScene* scene, const int first) {
+	InputData* input_data = &scene->input_data;
+	const Camera* camera = &input_data->camera;
+	const int rows = (camera->height + scene->stride - 1) / scene->stride;
+	const int cols = (camera->width + scene->stride - 1) / scene->stride;
+	const int pixels = rows * cols;
+
+	double start = now_seconds();
+	input_data->bvh =
+		bvh_new(&input_data->objects, intersect_kernels_best_type());
+	const double build_seconds = now_seconds() - start;
+
+	// the sums of every pass apart, pass after pass
+	Float3* pixel_sum = calloc((size_t)pixels * BENCH_PASSES, sizeof(Float3));
+	Ray3* rays = malloc(sizeof(Ray3) * pixels);
+	if (pixel_sum == NULL || rays == NULL) {
+		fprintf(stderr, "Error: malloc failed\n");
+		exit(-1);
+	}
+
+	const BvhStats before = bvh_stats;
+	start = now_seconds();
+	for (int pass = 1; pass <= BENCH_PASSES; pass++)
+		bench_pass(scene, &pixel_sum[(size_t)(pass - 1) * pixels], pass);
+	const double render_seconds = now_seconds() - start;
+	const uint64_t rays_traced = bvh_stats.rays - before.rays;
+	const uint64_t intersections =
+		bvh_stats.intersections - before.intersections;
+
+	int n = 0;
+	for (int i = 0; i < camera->height; i += scene->stride)
+		for (int j = 0; j < camera->width; j += scene->stride)
+			rays[n++] = pixel_ray(camera, i, j);
+	start = now_seconds();
+	int hits = 0;
+	for (int i = 0; i < pixels; i++) {
+		float distance;
+		hits += bvh_nearest_object(&input_data->bvh, &rays[i],
+								   &distance) != NULL;
+	}
+	const double query_seconds = now_seconds() - start;
+
+	// the mean color, so a change of the image shows up too
+	const int ray_per_pixel =
+		camera->sqrt_ray_per_pixel * camera->sqrt_ray_per_pixel;
+	Float3 mean = float3_new(0, 0, 0);
+	double variance = 0;
+	for (int i = 0; i < pixels; i++) {
+		double sum = 0, square_sum = 0;
+		for (int pass = 0; pass < BENCH_PASSES; pass++) {
+			const Float3* color = &pixel_sum[(size_t)pass * pixels + i];
+			float3_add_eq(&mean, color);
+			const double luminance = (0.2126 * color->x + 0.7152 * color->y +
+									  0.0722 * color->z) /
+									 ray_per_pixel;
+			sum += luminance;
+			square_sum += luminance * luminance;
+		}
+		variance += (square_sum - sum * sum / BENCH_PASSES) / (BENCH_PASSES - 1);
+	}
+	variance /= pixels;
+	float3_mul_eq(&mean,
+				  1.0f / ((double)pixels * ray_per_pixel * BENCH_PASSES));
+	const double seconds_per_pass = render_seconds / BENCH_PASSES;
+
+	printf("%s\n    {\n", first ? "" : ",");
+	printf("      \"name\": \"%s\",\n", scene->name);
+	printf("      \"objects\": %d,\n", input_data->objects.size);
+	printf("      \"pixels\": %d,\n", pixels);
+	printf("      \"samples_per_pixel\": %d,\n", ray_per_pixel);
+	printf("      \"max_bounces\": %d,\n", input_data->max_bounces);
+	printf("      \"passes\": %d,\n", BENCH_PASSES);
+	printf("      \"bvh_build_ms\": %.3f,\n", build_seconds * 1e3);
+	printf("      \"ms_per_pass\": %.3f,\n",
+		   render_seconds * 1e3 / BENCH_PASSES);
+	printf("      \"rays\": %llu,\n", (unsigned long long)rays_traced);
+	printf("      \"rays_per_second\": %.0f,\n", rays_traced / render_seconds);
+	printf("      \"intersections_per_second\": %.0f,\n",
+		   intersections / render_seconds);
+	printf("      \"ns_per_nearest_object\": %.2f,\n",
+		   query_seconds * 1e9 / pixels);
+	printf("      \"primary_hits\": %d,\n", hits);
+	printf("      \"pixel_variance\": %.6g,\n", variance);
+	printf("      \"efficiency\": %.6g,\n",
+		   variance > 0 ? 1 / (variance * seconds_per_pass) : 0);
+	printf("      \"mean_color\": [%.6f, %.6f, %.6f]\n", mean.x, mean.y, mean.z);
+	printf("    }");
+	fflush(stdout);
+
+	free(rays);
+	free(pixel_sum);
+	free_input_data(input_data);
+}
+
+int main() {
+	const char* files[][2] = {{"input", "input.txt"},
+							  {"airplane", "bench/scenes/airplane.txt"},
+							  {"butterfly", "bench/scenes/butterfly.txt"},
+							  {"small-light", "bench/scenes/small-light.txt"}};
+	const int n_files = sizeof(files) / sizeof(files[0]);
+	const int sizes[] = {10, 1000, 100000, 1000000};
+	const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+	printf("{\n");
+	printf("  \"seed\": %d,\n", BENCH_SEED);
+	printf("  \"threads\": 1,\n");
+	printf("  \"kernels\": \"%s\",\n",
+		   intersect_kernels(intersect_kernels_best_type()).name);
+#if TRIANGLE_INTERSECT == TRIANGLE_PROJECTION
+	printf("  \"triangle\": \"projection\",\n");
+#elif TRIANGLE_INTERSECT == TRIANGLE_MOLLER
+	printf("  \"triangle\": \"moller\",\n");
+#else
+	printf("  \"triangle\": \"watertight\",\n");
+#endif
+	printf("  \"packet_size\": %d,\n", PACKET_SIZE);
+#if DIFFUSE_SAMPLING == DIFFUSE_ANGLES
+	printf("  \"diffuse\": \"angles\",\n");
+#else
+	printf("  \"diffuse\": \"cosine\",\n");
+#endif
+	printf("  \"roulette\": %d,\n", RUSSIAN_ROULETTE);
+	printf("  \"next_event\": %d,\n", NEXT_EVENT);
+	printf("  \"scenes\": [");
+	for (int i = 0; i < n_files; i++) {
+		BenchScene scene = scene_from_file(files[i][0], files[i][1]);
+		bench_scene(&scene, i == 0);
+	}
+	for (int i = 0; i < n_sizes; i++) {
+		BenchScene scene = scene_generated(sizes[i]);
+		bench_scene(&scene, 0);
+	}
+	printf("\n  ]\n}\n");
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "aabb.h"
+
+#include <math.h>
+
+#include "algebra.h"
+
+Aabb aabb_empty() {
+	Aabb aabb;
+	aabb.min = float3_new(INFINITY, INFINITY, INFINITY);
+	aabb.max = float3_new(-INFINITY, -INFINITY, -INFINITY);
+	return aabb;
+}
+
+void aabb_grow_point(Aabb* aabb, const Float3* point) {
+	aabb->min.x = fminf(aabb->min.x, point->x);
+	aabb->min.y = fminf(aabb->min.y, point->y);
+	aabb->min.z = fminf(aabb->min.z, point->z);
+	aabb->max.x = fmaxf(aabb->max.x, point->x);
+	aabb->max.y = fmaxf(aabb->max.y, point->y);
+	aabb->max.z = fmaxf(aabb->max.z, point->z);
+}
+
+void aabb_grow(Aabb* aabb, const Aabb* other) {
+	aabb_grow_point(aabb, &other->min);
+	aabb_grow_point(aabb, &other->max);
+}
+
+Float3 aabb_centroid(const Aabb* aabb) {
+	Float3 centroid = float3_add(&aabb->min, &aabb->max);
+	float3_mul_eq(&centroid, 0.5f);
+	return centroid;
+}
+
+float aabb_area(const Aabb* aabb) {
+	const Float3 size = float3_sub(&aabb->max, &aabb->min);
+	if (size.x < 0) return 0;
+	return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Slab test: distance at which the ray enters the box, INFINITY if it misses
+// it or only reaches it beyond `max`.
+float aabb_intersect_distance(const Aabb* aabb, const Float3* origin,
+							  const Float3* inv_direction, const float max) {
+	const float tx1 = (aabb->min.x - origin->x) * inv_direction->x;
+	const float tx2 = (aabb->max.x - origin->x) * inv_direction->x;
+	float t_min = fminf(tx1, tx2), t_max = fmaxf(tx1, tx2);
+	const float ty1 = (aabb->min.y - origin->y) * inv_direction->y;
+	const float ty2 = (aabb->max.y - origin->y) * inv_direction->y;
+	t_min = fmaxf(t_min, fminf(ty1, ty2));
+	t_max = fminf(t_max, fmaxf(ty1, ty2));
+	const float tz1 = (aabb->min.z - origin->z) * inv_direction->z;
+	const float tz2 = (aabb->max.z - origin->z) * inv_direction->z;
+	t_min = fmaxf(t_min, fminf(tz1, tz2));
+	t_max = fminf(t_max, fmaxf(tz1, tz2));
+	if (t_max < t_min || t_max <= 0 || t_min > max) return INFINITY;
+	return t_min;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "algebra.h"
+#include "ray.h"
+
+typedef struct _Aabb {
+	Float3 min, max;
+} Aabb;
+
+Aabb aabb_empty();
+void aabb_grow_point(Aabb* aabb, const Float3* point);
+void aabb_grow(Aabb* aabb, const Aabb* other);
+Float3 aabb_centroid(const Aabb* aabb);
+float aabb_area(const Aabb* aabb);
+float aabb_intersect_distance(const Aabb* aabb, const Float3* origin,
+							  const Float3* inv_direction, const float max);
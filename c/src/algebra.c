@@ -114,12 +114,37 @@ Float3 float3_mirror(const Float3* lhs, const Float3* rhs) {
 	return float3_sub(lhs, &sub);
 }
 
+// Rec. 709 weights
+float float3_luminance(const Float3* color) {
+	return 0.2126f * color->x + 0.7152f * color->y + 0.0722f * color->z;
+}
+
+// (x, y, z) in a frame whose z is the unit vector `axis`: the other two axes
+// are built without branches nor normalization, Duff et al. (2017).
+Float3 float3_from_frame(const Float3* axis, const float x, const float y,
+						 const float z) {
+	const float sign = copysignf(1.0f, axis->z);
+	const float a = -1.0f / (sign + axis->z);
+	const float b = axis->x * axis->y * a;
+	const Float3 tangent = float3_new(1 + sign * axis->x * axis->x * a,
+									  sign * b, -sign * axis->x);
+	const Float3 bitangent =
+		float3_new(b, sign + axis->y * axis->y * a, -axis->y);
+	return float3_new(x * tangent.x + y * bitangent.x + z * axis->x,
+					  x * tangent.y + y * bitangent.y + z * axis->y,
+					  x * tangent.z + y * bitangent.z + z * axis->z);
+}
+
 void float3_invert_eq(Float3* lhs) {
 	lhs->x = -lhs->x;
 	lhs->y = -lhs->y;
 	lhs->z = -lhs->z;
 }
 
+float float3_axis(const Float3* v, const int axis) {
+	return axis == 0 ? v->x : (axis == 1 ? v->y : v->z);
+}
+
 Float2 float2_new(const float x, const float y) {
 	Float2 f;
 	f.x = x;
@@ -206,3 +231,13 @@ Float3 mat3_mul_float3(const Mat3* lhs, const Float3* rhs) {
 	f.z = lhs->m[2][0] * rhs->x + lhs->m[2][1] * rhs->y + lhs->m[2][2] * rhs->z;
 	return f;
 }
+
+Mat3 mat3_mul(const Mat3* lhs, const Mat3* rhs) {
+	Mat3 mat;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			mat.m[i][j] = lhs->m[i][0] * rhs->m[0][j] +
+						  lhs->m[i][1] * rhs->m[1][j] +
+						  lhs->m[i][2] * rhs->m[2][j];
+	return mat;
+}
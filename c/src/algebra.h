@@ -23,6 +23,10 @@ void float3_div_eq(Float3* lhs, const float rhs);
 int float3_eq(const Float3* lhs, const Float3* rhs);
 Float3 float3_mirror(const Float3* lhs, const Float3* rhs);
 void float3_invert_eq(Float3* lhs);
+float float3_axis(const Float3* v, const int axis);
+float float3_luminance(const Float3* color);
+Float3 float3_from_frame(const Float3* axis, const float x, const float y,
+						 const float z);
 
 typedef struct _Float2 {
 	float x, y;
@@ -44,3 +48,4 @@ Mat3 mat3_yaw(const float angle);
 Mat3 mat3_pitch(const float angle);
 Mat3 mat3_roll(const float angle);
 Float3 mat3_mul_float3(const Mat3* lhs, const Float3* rhs);
+Mat3 mat3_mul(const Mat3* lhs, const Mat3* rhs);
@@ -0,0 +1,99 @@
+#include "animation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "algebra.h"
+#include "camera.h"
+
+Float3 float3_lerp(const Float3* a, const Float3* b, const float t);
+
+CameraPath camera_path_new(void) {
+	CameraPath path;
+	path.keys = NULL;
+	path.count = 0;
+	path.capacity = 0;
+	return path;
+}
+
+void camera_path_free(CameraPath* path) {
+	free(path->keys);
+	*path = camera_path_new();
+}
+
+void camera_path_push(CameraPath* path, const Keyframe* key) {
+	if (path->count > 0 && key->frame <= path->keys[path->count - 1].frame) {
+		fprintf(stderr, "Parse error: keyframe %d after keyframe %d\n",
+				key->frame, path->keys[path->count - 1].frame);
+		exit(-1);
+	}
+	if (key->direction.x == 0 && key->direction.y == 0) {
+		fprintf(stderr, "Parse error: keyframe %d looks straight up or down\n",
+				key->frame);
+		exit(-1);
+	}
+	if (path->count == path->capacity) {
+		const int capacity = path->capacity > 0 ? 2 * path->capacity : 8;
+		Keyframe* keys = realloc(path->keys, sizeof(Keyframe) * capacity);
+		if (keys == NULL) {
+			fprintf(stderr, "Error: malloc failed in camera_path_push()\n");
+			exit(-1);
+		}
+		path->keys = keys;
+		path->capacity = capacity;
+	}
+	path->keys[path->count++] = *key;
+}
+
+Camera camera_path_camera(const CameraPath* path, const int frame,
+						  const Camera* like) {
+	if (path->count == 0) {
+		fprintf(stderr, "Error: the scene has no keyframe\n");
+		exit(-1);
+	}
+	// the last key at or before `frame`, the first one if there is none
+	int i = 0;
+	while (i + 1 < path->count && path->keys[i + 1].frame <= frame) i++;
+	const Keyframe* from = &path->keys[i];
+	const Keyframe* to = i + 1 < path->count ? &path->keys[i + 1] : from;
+	// a keyframe gives the camera the scene would, to the bit
+	float t = 0;
+	if (to != from && frame > from->frame)
+		t = (float)(frame - from->frame) / (to->frame - from->frame);
+	if (t == 0)
+		return camera_new(&from->position, &from->direction, from->angle,
+						  like->width, like->height, like->sqrt_ray_per_pixel);
+	const Float3 position = float3_lerp(&from->position, &to->position, t);
+	// between normalized directions, so that a longer vector doesn't pull
+	const Float3 from_direction = float3_normalize(&from->direction);
+	const Float3 to_direction = float3_normalize(&to->direction);
+	Float3 direction = float3_lerp(&from_direction, &to_direction, t);
+	if (direction.x == 0 && direction.y == 0) direction = from->direction;
+	const float angle = from->angle + (to->angle - from->angle) * t;
+	return camera_new(&position, &direction, angle, like->width, like->height,
+					  like->sqrt_ray_per_pixel);
+}
+
+Float3 float3_lerp(const Float3* a, const Float3* b, const float t) {
+	return float3_new(a->x + (b->x - a->x) * t, a->y + (b->y - a->y) * t,
+					  a->z + (b->z - a->z) * t);
+}
+
+char* frame_filename(const char* filename, const int frame) {
+	const char* slash = strrchr(filename, '/');
+	const char* dot = strrchr(filename, '.');
+	// a dot in a directory name, or a hidden file, isn't an extension
+	if (dot == NULL || dot == filename || (slash != NULL && dot <= slash + 1))
+		dot = filename + strlen(filename);
+	const int stem = dot - filename;
+	const int size =
+		snprintf(NULL, 0, "%.*s.%04d%s", stem, filename, frame, dot);
+	char* name = malloc(size + 1);
+	if (name == NULL) {
+		fprintf(stderr, "Error: malloc failed in frame_filename()\n");
+		exit(-1);
+	}
+	snprintf(name, size + 1, "%.*s.%04d%s", stem, filename, frame, dot);
+	return name;
+}
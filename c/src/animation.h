@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "algebra.h"
+#include "camera.h"
+
+// The camera at one frame of an animation
+typedef struct _Keyframe {
+	Float3 position, direction;
+	float angle;
+	int32_t frame;
+} Keyframe;
+
+// Keyframes in increasing order of frame. Between two of them the camera
+// moves in a straight line, before the first and after the last it stays.
+typedef struct _CameraPath {
+	Keyframe* keys;
+	int count, capacity;
+} CameraPath;
+
+CameraPath camera_path_new(void);
+void camera_path_free(CameraPath* path);
+void camera_path_push(CameraPath* path, const Keyframe* key);
+// The camera of `frame`, with the image size and sampling of `like`
+Camera camera_path_camera(const CameraPath* path, const int frame,
+						  const Camera* like);
+// `filename` with the frame number before its extension: out.ppm, 7 gives
+// out.0007.ppm. To be freed.
+char* frame_filename(const char* filename, const int frame);
@@ -0,0 +1,312 @@
+#include "bvh.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "aabb.h"
+#include "algebra.h"
+#include "light.h"
+#include "object.h"
+
+typedef struct _BvhBuilder {
+	Bvh* bvh;
+	Aabb* bounds;
+	Float3* centroids;
+	int* indices;
+} BvhBuilder;
+
+typedef struct _BvhBin {
+	Aabb bounds;
+	int count;
+} BvhBin;
+
+void bvh_subdivide(BvhBuilder* builder, const int node_index, const int depth);
+void bvh_fill_leaves(BvhBuilder* builder, const int sphere_count,
+					 const int triangle_count);
+float bvh_find_split(const BvhBuilder* builder, const BvhNode* node,
+					 const Aabb* centroid_bounds, int* axis, int* split_bin);
+int bvh_bin_of(const Float3* centroid, const Aabb* centroid_bounds,
+			   const int axis);
+void* bvh_malloc(const size_t size);
+void bvh_intersect(const Bvh* bvh, const Ray3* ray, SoaHit* hit);
+
+Bvh bvh_new(const ObjectVec* objects, const int kernels_type) {
+	Bvh bvh;
+	bvh.objects = objects;
+	bvh.kernels = intersect_kernels(kernels_type);
+	bvh.planes = bvh_malloc(sizeof(int) * (objects->size + 1));
+	bvh.nodes = bvh_malloc(sizeof(BvhNode) * (2 * objects->size + 1));
+	bvh.plane_count = bvh.node_count = bvh.leaf_count = 0;
+	bvh.lights = light_list_new(objects);
+
+	BvhBuilder builder;
+	builder.bvh = &bvh;
+	builder.bounds = bvh_malloc(sizeof(Aabb) * (objects->size + 1));
+	builder.centroids = bvh_malloc(sizeof(Float3) * (objects->size + 1));
+	builder.indices = bvh_malloc(sizeof(int) * (objects->size + 1));
+	int index_count = 0, sphere_count = 0;
+	for (int i = 0; i < objects->size; i++) {
+		if (object_bounds(objects, &objects->ptr[i], &builder.bounds[i])) {
+			builder.centroids[i] = aabb_centroid(&builder.bounds[i]);
+			builder.indices[index_count++] = i;
+			sphere_count += objects->ptr[i].shape_type == TYPE_SPHERE;
+		} else {
+			bvh.planes[bvh.plane_count++] = i;
+		}
+	}
+
+	if (index_count > 0) {
+		BvhNode* root = &bvh.nodes[bvh.node_count++];
+		root->first = 0;
+		root->count = index_count;
+		bvh_subdivide(&builder, 0, 0);
+	}
+	bvh_fill_leaves(&builder, sphere_count, index_count - sphere_count);
+	free(builder.bounds);
+	free(builder.centroids);
+	free(builder.indices);
+	return bvh;
+}
+
+void bvh_free(Bvh* bvh) {
+	free(bvh->nodes);
+	free(bvh->leaves);
+	free(bvh->planes);
+	sphere_soa_free(&bvh->spheres);
+	triangle_soa_free(&bvh->triangles);
+	light_list_free(&bvh->lights);
+}
+
+// Copies the primitives into the SoA streams leaf after leaf, so that every
+// leaf is a contiguous range of spheres plus one of triangles.
+void bvh_fill_leaves(BvhBuilder* builder, const int sphere_count,
+					 const int triangle_count) {
+	Bvh* bvh = builder->bvh;
+	const Object* objects = bvh->objects->ptr;
+	const Float3* vertices = bvh->objects->vertices;
+	bvh->spheres = sphere_soa_new(sphere_count);
+	bvh->triangles = triangle_soa_new(triangle_count);
+	bvh->leaves = bvh_malloc(sizeof(BvhLeaf) * (bvh->node_count + 1));
+	for (int n = 0; n < bvh->node_count; n++) {
+		BvhNode* node = &bvh->nodes[n];
+		if (node->count == 0) continue;
+		BvhLeaf* leaf = &bvh->leaves[bvh->leaf_count];
+		leaf->sphere_first = bvh->spheres.size;
+		leaf->triangle_first = bvh->triangles.size;
+		for (int i = node->first; i < node->first + node->count; i++) {
+			const int idx = builder->indices[i];
+			const Object* object = &objects[idx];
+			if (object->shape_type == TYPE_SPHERE)
+				sphere_soa_push(&bvh->spheres, &object->shape.sphere, idx);
+			else
+				triangle_soa_push(&bvh->triangles,
+								  &vertices[object->shape.triangle.v[0]],
+								  &vertices[object->shape.triangle.v[1]],
+								  &vertices[object->shape.triangle.v[2]], idx);
+		}
+		leaf->sphere_count = bvh->spheres.size - leaf->sphere_first;
+		leaf->triangle_count = bvh->triangles.size - leaf->triangle_first;
+		node->first = bvh->leaf_count++;
+	}
+}
+
+void bvh_subdivide(BvhBuilder* builder, const int node_index,
+				   const int depth) {
+	Bvh* bvh = builder->bvh;
+	BvhNode* node = &bvh->nodes[node_index];
+	Aabb centroid_bounds = aabb_empty();
+	node->bounds = aabb_empty();
+	for (int i = node->first; i < node->first + node->count; i++) {
+		const int idx = builder->indices[i];
+		aabb_grow(&node->bounds, &builder->bounds[idx]);
+		aabb_grow_point(&centroid_bounds, &builder->centroids[idx]);
+	}
+	if (node->count == 1 || depth >= BVH_MAX_DEPTH - 1) return;
+
+	int axis, split_bin;
+	const float split_cost =
+		bvh_find_split(builder, node, &centroid_bounds, &axis, &split_bin);
+	const float leaf_cost = node->count * aabb_area(&node->bounds);
+	if (split_bin < 0) return;
+	if (split_cost >= leaf_cost && node->count <= BVH_MAX_LEAF) return;
+
+	int left = node->first, right = node->first + node->count - 1;
+	while (left <= right) {
+		const int idx = builder->indices[left];
+		if (bvh_bin_of(&builder->centroids[idx], &centroid_bounds, axis) <=
+			split_bin) {
+			left++;
+		} else {
+			builder->indices[left] = builder->indices[right];
+			builder->indices[right--] = idx;
+		}
+	}
+	const int left_count = left - node->first;
+	if (left_count == 0 || left_count == node->count) return;
+
+	const int children = bvh->node_count;
+	bvh->node_count += 2;
+	bvh->nodes[children].first = node->first;
+	bvh->nodes[children].count = left_count;
+	bvh->nodes[children + 1].first = left;
+	bvh->nodes[children + 1].count = node->count - left_count;
+	node->first = children;
+	node->count = 0;
+	bvh_subdivide(builder, children, depth + 1);
+	bvh_subdivide(builder, children + 1, depth + 1);
+}
+
+// Binned SAH: returns the cost of the best split, with the objects in bins
+// [0, split_bin] going left (split_bin == -1 if no split is possible).
+float bvh_find_split(const BvhBuilder* builder, const BvhNode* node,
+					 const Aabb* centroid_bounds, int* axis, int* split_bin) {
+	float best_cost = INFINITY;
+	*split_bin = -1;
+	*axis = 0;
+	for (int a = 0; a < 3; a++) {
+		const float extent = float3_axis(&centroid_bounds->max, a) -
+							 float3_axis(&centroid_bounds->min, a);
+		if (extent <= 0) continue;
+		BvhBin bins[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; b++) {
+			bins[b].bounds = aabb_empty();
+			bins[b].count = 0;
+		}
+		for (int i = node->first; i < node->first + node->count; i++) {
+			const int idx = builder->indices[i];
+			const int b = bvh_bin_of(&builder->centroids[idx], centroid_bounds, a);
+			bins[b].count++;
+			aabb_grow(&bins[b].bounds, &builder->bounds[idx]);
+		}
+		float left_area[BVH_BINS - 1];
+		int left_count[BVH_BINS - 1];
+		Aabb left_box = aabb_empty();
+		for (int b = 0, count = 0; b < BVH_BINS - 1; b++) {
+			count += bins[b].count;
+			aabb_grow(&left_box, &bins[b].bounds);
+			left_count[b] = count;
+			left_area[b] = aabb_area(&left_box);
+		}
+		Aabb right_box = aabb_empty();
+		for (int b = BVH_BINS - 1, count = 0; b > 0; b--) {
+			count += bins[b].count;
+			aabb_grow(&right_box, &bins[b].bounds);
+			if (left_count[b - 1] == 0 || count == 0) continue;
+			const float cost = left_count[b - 1] * left_area[b - 1] +
+							   count * aabb_area(&right_box);
+			if (cost < best_cost) {
+				best_cost = cost;
+				*axis = a;
+				*split_bin = b - 1;
+			}
+		}
+	}
+	// one traversal step costs about as much as one intersection
+	return best_cost + aabb_area(&node->bounds);
+}
+
+int bvh_bin_of(const Float3* centroid, const Aabb* centroid_bounds,
+			   const int axis) {
+	const float min = float3_axis(&centroid_bounds->min, axis);
+	const float extent = float3_axis(&centroid_bounds->max, axis) - min;
+	const int bin = (float3_axis(centroid, axis) - min) * BVH_BINS / extent;
+	return bin < 0 ? 0 : (bin >= BVH_BINS ? BVH_BINS - 1 : bin);
+}
+
+void* bvh_malloc(const size_t size) {
+	void* ptr = malloc(size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Error: malloc failed in bvh_new()\n");
+		exit(-1);
+	}
+	return ptr;
+}
+
+_Thread_local BvhStats bvh_stats;
+
+// The nearest hit of `ray` up to hit->distance, or any hit with hit->any:
+// then the first leaf that has one ends the traversal. The nearest child goes
+// first either way, a hit is likelier there.
+void bvh_intersect(const Bvh* bvh, const Ray3* ray, SoaHit* hit) {
+	const Object* objects = bvh->objects->ptr;
+	uint64_t intersections = 0;
+	bvh_stats.rays++;
+	for (int i = 0; i < bvh->plane_count; i++) {
+		intersections++;
+		soa_hit_update(hit,
+					   plane_intersect_distance(
+						   &objects[bvh->planes[i]].shape.plane, ray),
+					   bvh->planes[i]);
+		if (hit->any && hit->object >= 0) break;
+	}
+
+	if (bvh->node_count > 0 && !(hit->any && hit->object >= 0)) {
+		const Float3 inv_direction =
+			float3_new(1.0f / ray->direction.x, 1.0f / ray->direction.y,
+					   1.0f / ray->direction.z);
+		int stack[BVH_MAX_DEPTH];
+		float stack_distance[BVH_MAX_DEPTH];
+		int stack_size = 0;
+		if (aabb_intersect_distance(&bvh->nodes[0].bounds, &ray->origin,
+									&inv_direction, hit->distance) < INFINITY) {
+			stack[stack_size] = 0;
+			stack_distance[stack_size++] = 0;
+		}
+		while (stack_size > 0) {
+			stack_size--;
+			if (stack_distance[stack_size] > hit->distance) continue;
+			const BvhNode* node = &bvh->nodes[stack[stack_size]];
+			while (node->count == 0) {
+				int near = node->first, far = node->first + 1;
+				float near_distance = aabb_intersect_distance(
+					&bvh->nodes[near].bounds, &ray->origin, &inv_direction,
+					hit->distance);
+				float far_distance = aabb_intersect_distance(
+					&bvh->nodes[far].bounds, &ray->origin, &inv_direction,
+					hit->distance);
+				if (far_distance < near_distance) {
+					const int tmp = near;
+					near = far;
+					far = tmp;
+					const float tmp_distance = near_distance;
+					near_distance = far_distance;
+					far_distance = tmp_distance;
+				}
+				if (near_distance == INFINITY) break;
+				if (far_distance < INFINITY) {
+					stack[stack_size] = far;
+					stack_distance[stack_size++] = far_distance;
+				}
+				node = &bvh->nodes[near];
+			}
+			if (node->count == 0) continue;
+			const BvhLeaf* leaf = &bvh->leaves[node->first];
+			intersections += node->count;
+			if (leaf->sphere_count > 0)
+				bvh->kernels.spheres(&bvh->spheres, leaf->sphere_first,
+									 leaf->sphere_count, ray, hit);
+			if (hit->any && hit->object >= 0) break;
+			if (leaf->triangle_count > 0)
+				bvh->kernels.triangles(&bvh->triangles, leaf->triangle_first,
+									   leaf->triangle_count, ray, hit);
+			if (hit->any && hit->object >= 0) break;
+		}
+	}
+	bvh_stats.intersections += intersections;
+}
+
+Object* bvh_nearest_object(const Bvh* bvh, const Ray3* ray, float* distance) {
+	SoaHit hit = soa_hit_new();
+	bvh_intersect(bvh, ray, &hit);
+	if (distance != NULL) *distance = hit.distance;
+	return hit.object >= 0 ? &bvh->objects->ptr[hit.object] : NULL;
+}
+
+int bvh_occluded(const Bvh* bvh, const Ray3* ray, const float max_distance) {
+	SoaHit hit = soa_hit_new();
+	hit.distance = max_distance;
+	hit.any = 1;
+	bvh_intersect(bvh, ray, &hit);
+	return hit.object >= 0;
+}
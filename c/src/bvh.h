@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "aabb.h"
+#include "light.h"
+#include "object.h"
+#include "ray.h"
+#include "soa.h"
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 8
+#define BVH_MAX_DEPTH 64
+
+typedef struct _BvhNode {
+	Aabb bounds;
+	// leaf: `count` objects, described by leaves[first]; inner (count == 0):
+	// the children are the nodes first and first + 1
+	int first, count;
+} BvhNode;
+
+// Ranges of a leaf in the sphere and triangle streams
+typedef struct _BvhLeaf {
+	int sphere_first, sphere_count, triangle_first, triangle_count;
+} BvhLeaf;
+
+// Bounded objects go in the tree, planes are kept aside and always tested.
+// The emissive objects are listed too, for the traces that sample them.
+typedef struct _Bvh {
+	const ObjectVec* objects;
+	BvhNode* nodes;
+	BvhLeaf* leaves;
+	SphereSoa spheres;
+	TriangleSoa triangles;
+	IntersectKernels kernels;
+	int* planes;
+	int node_count, leaf_count, plane_count;
+	LightList lights;
+} Bvh;
+
+// What the traversals of the calling thread have done so far, read by the
+// benchmarks: rays traced and objects tested (a packet counts every lane).
+typedef struct _BvhStats {
+	uint64_t rays, intersections;
+} BvhStats;
+
+extern _Thread_local BvhStats bvh_stats;
+
+Bvh bvh_new(const ObjectVec* objects, const int kernels_type);
+void bvh_free(Bvh* bvh);
+// The nearest object `ray` hits, NULL if none. A ray leaving a surface must
+// start off it (ray3_offset()): it can hit that surface again, further (the
+// inside of a sphere, a concave mesh).
+Object* bvh_nearest_object(const Bvh* bvh, const Ray3* ray, float* distance);
+// Whether anything is hit before `max_distance`: stops at the first hit,
+// which needn't be the nearest.
+int bvh_occluded(const Bvh* bvh, const Ray3* ray, const float max_distance);
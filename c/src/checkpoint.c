@@ -0,0 +1,168 @@
+#include "checkpoint.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "algebra.h"
+#include "camera.h"
+#include "draw.h"
+#include "object.h"
+#include "scanner.h"
+
+#define CHECKPOINT_MAGIC "RTCKPT01"
+#define CHECKPOINT_MAGIC_LEN 8
+
+uint64_t hash_bytes(uint64_t hash, const void* data, const size_t size);
+uint64_t hash_object(uint64_t hash, const ObjectVec* objects,
+					 const Object* object);
+
+// FNV-1a, 64 bit
+uint64_t hash_bytes(uint64_t hash, const void* data, const size_t size) {
+	const unsigned char* bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Field by field: the padding of Shape isn't initialized.
+uint64_t hash_object(uint64_t hash, const ObjectVec* objects,
+					 const Object* object) {
+	const Shape* shape = &object->shape;
+	hash = hash_bytes(hash, &object->shape_type, sizeof(int));
+	if (object->shape_type == TYPE_SPHERE) {
+		hash = hash_bytes(hash, &shape->sphere.center, sizeof(Float3));
+		hash = hash_bytes(hash, &shape->sphere.radius, sizeof(float));
+	} else if (object->shape_type == TYPE_PLANE) {
+		hash = hash_bytes(hash, &shape->plane.normal, sizeof(Float3));
+		hash = hash_bytes(hash, &shape->plane.d, sizeof(float));
+	} else {
+		// the vertices, not their indices: the same scene loaded from another
+		// format may share them differently
+		for (int i = 0; i < 3; i++)
+			hash = hash_bytes(hash, &objects->vertices[shape->triangle.v[i]],
+							  sizeof(Float3));
+	}
+	const Material* material = &objects->materials[object->material];
+	hash = hash_bytes(hash, &material->color, sizeof(Float3));
+	hash = hash_bytes(hash, &material->light_emitted, sizeof(Float3));
+	return hash_bytes(hash, &material->reflection, sizeof(float));
+}
+
+// Everything that changes what a sample is worth. The number of passes isn't
+// part of it, so a finished render can be resumed with more, nor is the
+// target noise, only whether there is one: the file has more in it then.
+uint64_t scene_hash(const InputData* input_data) {
+	uint64_t hash = 14695981039346656037ULL;
+	// Camera is only floats and ints: no padding
+	hash = hash_bytes(hash, &input_data->camera, sizeof(Camera));
+	hash = hash_bytes(hash, &input_data->max_bounces, sizeof(int));
+	// the samplers the build was made with
+	const int sampling[3] = {DIFFUSE_SAMPLING, RUSSIAN_ROULETTE, NEXT_EVENT};
+	hash = hash_bytes(hash, sampling, sizeof(sampling));
+	hash = hash_bytes(hash, &input_data->background_color, sizeof(Float3));
+	if (input_data->target_noise > 0) hash = hash_bytes(hash, "adaptive", 8);
+	hash = hash_bytes(hash, &input_data->objects.size, sizeof(int));
+	for (int i = 0; i < input_data->objects.size; i++)
+		hash = hash_object(hash, &input_data->objects,
+						   &input_data->objects.ptr[i]);
+	return hash;
+}
+
+// Written next to `filename` and renamed over it, so a render killed while
+// saving still leaves the previous checkpoint intact.
+void checkpoint_save(const char* filename, const InputData* input_data,
+					 const uint64_t seed, const int passes,
+					 const Float3* pixel_sum, const float* square_sum,
+					 const int* pixel_passes) {
+	const int total_pixel = input_data->camera.width * input_data->camera.height;
+	const uint64_t hash = scene_hash(input_data);
+	char* tmp_filename = malloc(strlen(filename) + 5);
+	if (tmp_filename == NULL) {
+		fprintf(stderr, "Error: malloc failed in checkpoint_save()\n");
+		exit(-1);
+	}
+	sprintf(tmp_filename, "%s.tmp", filename);
+	FILE* file = fopen(tmp_filename, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open file %s\n", tmp_filename);
+		exit(-1);
+	}
+	fwrite(CHECKPOINT_MAGIC, sizeof(char), CHECKPOINT_MAGIC_LEN, file);
+	fwrite(&hash, sizeof(uint64_t), 1, file);
+	fwrite(&seed, sizeof(uint64_t), 1, file);
+	fwrite(&passes, sizeof(int), 1, file);
+	size_t written = fwrite(pixel_sum, sizeof(Float3), total_pixel, file);
+	if (square_sum != NULL) {
+		written += fwrite(square_sum, sizeof(float), total_pixel, file);
+		written += fwrite(pixel_passes, sizeof(int), total_pixel, file);
+	}
+	const size_t expected = square_sum != NULL ? 3 * (size_t)total_pixel
+											   : (size_t)total_pixel;
+	if (written != expected || fclose(file) != 0) {
+		fprintf(stderr, "Error: can't write checkpoint %s\n", tmp_filename);
+		exit(-1);
+	}
+	if (rename(tmp_filename, filename) != 0) {
+		fprintf(stderr, "Error: can't rename %s to %s\n", tmp_filename,
+				filename);
+		exit(-1);
+	}
+	free(tmp_filename);
+}
+
+// Fills `seed` and the sums, returns the number of passes already done.
+int checkpoint_load(const char* filename, const InputData* input_data,
+					uint64_t* seed, Float3* pixel_sum, float* square_sum,
+					int* pixel_passes) {
+	const int total_pixel = input_data->camera.width * input_data->camera.height;
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open checkpoint %s\n", filename);
+		exit(-1);
+	}
+	char magic[CHECKPOINT_MAGIC_LEN];
+	uint64_t hash;
+	int passes;
+	if (fread(magic, sizeof(char), CHECKPOINT_MAGIC_LEN, file) !=
+			CHECKPOINT_MAGIC_LEN ||
+		memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN) != 0 ||
+		fread(&hash, sizeof(uint64_t), 1, file) != 1 ||
+		fread(seed, sizeof(uint64_t), 1, file) != 1 ||
+		fread(&passes, sizeof(int), 1, file) != 1) {
+		fprintf(stderr, "Error: %s is not a checkpoint\n", filename);
+		exit(-1);
+	}
+	// saved after a pass only: the image of 0 passes can't be scaled
+	if (passes < 1) {
+		fprintf(stderr, "Error: checkpoint %s holds no pass\n", filename);
+		exit(-1);
+	}
+	if (hash != scene_hash(input_data)) {
+		fprintf(stderr, "Error: checkpoint %s was saved for another scene\n",
+				filename);
+		exit(-1);
+	}
+	if (fread(pixel_sum, sizeof(Float3), total_pixel, file) !=
+			(size_t)total_pixel ||
+		(square_sum != NULL &&
+		 (fread(square_sum, sizeof(float), total_pixel, file) !=
+			  (size_t)total_pixel ||
+		  fread(pixel_passes, sizeof(int), total_pixel, file) !=
+			  (size_t)total_pixel))) {
+		fprintf(stderr, "Error: checkpoint %s is truncated\n", filename);
+		exit(-1);
+	}
+	for (int i = 0; pixel_passes != NULL && i < total_pixel; i++) {
+		if (pixel_passes[i] < 1 || pixel_passes[i] > passes) {
+			fprintf(stderr, "Error: checkpoint %s has a pixel of %d passes\n",
+					filename, pixel_passes[i]);
+			exit(-1);
+		}
+	}
+	fclose(file);
+	return passes;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "algebra.h"
+#include "scanner.h"
+
+// Everything needed to go on with a progressive render: the raw sum of the
+// samples of every pixel after `passes` passes, and the seed they were drawn
+// with (the random streams only depend on the seed, the pass and the pixel).
+// A file is only accepted back for the same scene, camera and sampling.
+// With adaptive sampling every pixel also has its own number of passes and
+// the sum of the squares of their luminance: `square_sum` and `pixel_passes`,
+// NULL without it.
+
+uint64_t scene_hash(const InputData* input_data);
+void checkpoint_save(const char* filename, const InputData* input_data,
+					 const uint64_t seed, const int passes,
+					 const Float3* pixel_sum, const float* square_sum,
+					 const int* pixel_passes);
+int checkpoint_load(const char* filename, const InputData* input_data,
+					uint64_t* seed, Float3* pixel_sum, float* square_sum,
+					int* pixel_passes);
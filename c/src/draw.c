@@ -1,18 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
 #include "draw.h"
 
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "algebra.h"
+#include "animation.h"
+#include "bvh.h"
+#include "checkpoint.h"
+#include "light.h"
+#include "mapped_file.h"
 #include "object.h"
+#include "packet.h"
 #include "ray.h"
+#include "rng.h"
 #include "scanner.h"
 
 int int_min(int a, int b) { return a < b ? a : b; }
 
+#define TILE_SIZE 16
+// 64x64 pixels: the sums of a block stay in the L2
+#define TILE_BLOCK 4
+// a pixel isn't frozen before, its noise can't be told from less
+#define ADAPTIVE_MIN_PASSES 4
+#define PI 3.14159265358979323846
+
+typedef struct _RenderPass {
+	const InputData* input_data;
+	// the camera of input_data, unless a preview pass shifts it
+	const Camera* camera;
+	// albedo_sum and normal_sum are NULL in the passes that don't capture them
+	Float3 *pixel_sum, *albedo_sum, *normal_sum;
+	// the squared luminance of every pass of a pixel, summed, and the passes
+	// it got: NULL unless the pixels are sampled adaptively
+	float* square_sum;
+	int* pixel_passes;
+	unsigned char* buffer;
+	float to_multiply;
+	int tiles_x, total_tiles, n_threads;
+	TraceFn trace_fn;
+	uint64_t seed;
+	int pass_index;
+	atomic_int next_tile;
+} RenderPass;
+
+RenderPass render_pass_new(const InputData* input_data, Float3* pixel_sum,
+						   unsigned char* buffer, TraceFn trace_fn,
+						   const uint64_t seed);
+void render_pass(RenderPass* pass);
+void* render_worker(void* arg);
+void render_tile(const RenderPass* pass, const int tile);
+void tile_position(const RenderPass* pass, int tile, int* x, int* y);
+int morton_compact(const int code);
+int pixel_converged(const Float3* pixel_sum, const float square_sum,
+					const int passes, const int ray_per_pixel,
+					const float target_noise);
+Float3 next_event(const Bvh* bvh, const Object* obj, const Ray3* ray,
+				  const Float3* normal, Rng* rng);
+float power_heuristic(const float pdf, const float other_pdf);
+double elapsed_ms(const struct timespec* since);
+void* animate_worker(void* arg);
+void* frame_writer(void* arg);
+
 void shoot_and_draw(const InputData* input_data) {
 	char header[64];
 	const int width = input_data->camera.width;
@@ -21,150 +77,774 @@ void shoot_and_draw(const InputData* input_data) {
 	const int sqrt_ray_per_pixel = input_data->camera.sqrt_ray_per_pixel;
 	const int ray_per_pixel = sqrt_ray_per_pixel * sqrt_ray_per_pixel;
 	const int number_of_updates = input_data->number_of_updates;
-	const int max_bounces = input_data->max_bounces;
-	const Ray3* upper_left = &input_data->camera.upper_left;
-	const Float3* delta_x = &input_data->camera.delta_x;
-	const Float3* delta_y = &input_data->camera.delta_y;
-	const Float3* d_x = &input_data->camera.d_x;
-	const Float3* d_y = &input_data->camera.d_y;
-	const Float3* background = &input_data->background_color;
-	const ObjectVec* objects = &input_data->objects;
-
-	const int content_len = total_pixel * 3;
+
+	const char* color_pfm = input_data->color_pfm;
+	const char* albedo_pfm = input_data->albedo_pfm;
+	const char* normal_pfm = input_data->normal_pfm;
+	const int save_floats =
+		color_pfm != NULL && albedo_pfm != NULL && normal_pfm != NULL;
+	const float target_noise = input_data->target_noise;
+	const int adaptive = target_noise > 0;
 	Float3* pixel_sum = calloc(total_pixel, sizeof(Float3));
-	unsigned char* buffer = malloc(content_len * sizeof(unsigned char));
-	if (pixel_sum == NULL) {
+	Float3* albedo_sum = save_floats ? calloc(total_pixel, sizeof(Float3)) : NULL;
+	Float3* normal_sum = save_floats ? calloc(total_pixel, sizeof(Float3)) : NULL;
+	float* square_sum = adaptive ? calloc(total_pixel, sizeof(float)) : NULL;
+	int* pixel_passes = adaptive ? calloc(total_pixel, sizeof(int)) : NULL;
+	if (pixel_sum == NULL ||
+		(save_floats && (albedo_sum == NULL || normal_sum == NULL)) ||
+		(adaptive && (square_sum == NULL || pixel_passes == NULL))) {
 		fprintf(stderr, "Error: can't allocate memory for %d pixel\n",
 				total_pixel);
 		exit(-1);
 	}
 
-	const char* color_ppm = input_data->color_ppm;
+	// render_tile() converts its pixels straight into the mapped PPM
 	sprintf(header, "P6\n%d %d\n255\n", width, height);
-	const int heder_len = strlen(header);
-	FILE* file = fopen(color_ppm, "wb");
-	fwrite(header, sizeof(char), heder_len, file);
-
-	srand(time(NULL));
-	fprintf(stderr, "ray tracing: 0 / %d", number_of_updates);
-	for (int nou = 1; nou <= number_of_updates; nou++) {
-		const float to_multiply = 255.0f / (nou * ray_per_pixel);
-		Ray3 row = *upper_left;
-		for (int i = 0, idx = 0, idx_buffer = 0; i < height; i++) {
-			Ray3 col = row;
-			for (int j = 0; j < width; j++, idx++) {
-				shoot_a_pixel(&pixel_sum[idx], sqrt_ray_per_pixel, &col, d_x,
-							  d_y, objects, max_bounces, background, trace_ray);
-				buffer[idx_buffer++] =
-					int_min(pixel_sum[idx].x * to_multiply, 255);
-				buffer[idx_buffer++] =
-					int_min(pixel_sum[idx].y * to_multiply, 255);
-				buffer[idx_buffer++] =
-					int_min(pixel_sum[idx].z * to_multiply, 255);
-				float3_add_eq(&col.direction, delta_x);
-			}
-			float3_add_eq(&row.direction, delta_y);
+	MappedFile ppm = mapped_file_new(input_data->color_ppm, header,
+									 (size_t)total_pixel * 3);
+	unsigned char* buffer = ppm.data;
+
+	uint64_t seed =
+		input_data->seed != 0 ? input_data->seed : (uint64_t)time(NULL);
+	int passes_done = 0;
+	if (input_data->resume) {
+		passes_done = checkpoint_load(input_data->checkpoint, input_data, &seed,
+									  pixel_sum, square_sum, pixel_passes);
+		fprintf(stderr, "resumed from %s after %d passes\n",
+				input_data->checkpoint, passes_done);
+		for (int i = 0; i < total_pixel; i++) {
+			const int passes = adaptive ? pixel_passes[i] : passes_done;
+			const float to_multiply = 255.0f / (passes * ray_per_pixel);
+			buffer[i * 3] = int_min(pixel_sum[i].x * to_multiply, 255);
+			buffer[i * 3 + 1] = int_min(pixel_sum[i].y * to_multiply, 255);
+			buffer[i * 3 + 2] = int_min(pixel_sum[i].z * to_multiply, 255);
+		}
+	}
+	RenderPass pass =
+		render_pass_new(input_data, pixel_sum, buffer, trace_ray, seed);
+	pass.square_sum = square_sum;
+	pass.pixel_passes = pixel_passes;
+	fprintf(stderr, "seed: %llu\n", (unsigned long long)seed);
+	fprintf(stderr, "ray tracing (%d threads): %d / %d", pass.n_threads,
+			passes_done, number_of_updates);
+	time_t last_checkpoint = time(NULL);
+	// The primary rays are the same in every pass, so the first one is enough
+	// to capture the albedo and the normal at their hits.
+	const int first_pass = passes_done + 1;
+	for (int nou = first_pass; nou <= number_of_updates; nou++) {
+		pass.pass_index = nou;
+		pass.to_multiply = 255.0f / (nou * ray_per_pixel);
+		pass.albedo_sum = nou == first_pass ? albedo_sum : NULL;
+		pass.normal_sum = nou == first_pass ? normal_sum : NULL;
+		render_pass(&pass);
+		passes_done = nou;
+		int noisy = total_pixel;
+		if (adaptive) {
+			noisy = 0;
+			for (int i = 0; i < total_pixel; i++)
+				noisy += !pixel_converged(&pixel_sum[i], square_sum[i],
+										  pixel_passes[i], ray_per_pixel,
+										  target_noise);
 		}
+		// the render ends early once every pixel is under the target noise
+		const int last = nou == number_of_updates || noisy == 0;
 
-		fseek(file, heder_len, SEEK_SET);
-		fwrite(buffer, sizeof(unsigned char), content_len, file);
-		fflush(file);
-		fprintf(stderr, "\rray tracing: %d / %d", nou, number_of_updates);
+		// checkpoints only happen between passes, where pixel_sum is whole
+		const time_t now = time(NULL);
+		if (input_data->checkpoint_seconds > 0 &&
+			(now - last_checkpoint >= input_data->checkpoint_seconds || last)) {
+			checkpoint_save(input_data->checkpoint, input_data, seed, nou,
+							pixel_sum, square_sum, pixel_passes);
+			last_checkpoint = now;
+		}
+		fprintf(stderr, "\rray tracing (%d threads): %d / %d", pass.n_threads,
+				nou, number_of_updates);
+		if (adaptive) fprintf(stderr, ", %d noisy pixels ", noisy);
+		if (last) break;
 	}
-	fclose(file);
+	mapped_file_free(&ppm);
 	fprintf(stderr, "\n");
+	if (adaptive && passes_done > 0) {
+		// against all the passes asked for, the ones skipped at the end too
+		const int passes = passes_done > number_of_updates ? passes_done
+														   : number_of_updates;
+		uint64_t samples = 0;
+		for (int i = 0; i < total_pixel; i++) samples += pixel_passes[i];
+		fprintf(stderr, "adaptive sampling: %.1f%% of the samples of %d passes\n",
+				100.0 * samples / ((double)total_pixel * passes), passes);
+	}
 
-	const char* color_pfm = input_data->color_pfm;
-	const char* albedo_pfm = input_data->albedo_pfm;
-	const char* normal_pfm = input_data->normal_pfm;
-	if (color_pfm != NULL && albedo_pfm != NULL && normal_pfm != NULL) {
-		translate_and_write_pfm(color_pfm, input_data, pixel_sum);
-		calculate_and_write_pfm(albedo_pfm, input_data, pixel_sum,
-								trace_albedo);
-		calculate_and_write_pfm(normal_pfm, input_data, pixel_sum,
-								trace_normal);
+	if (save_floats) {
+		if (first_pass > number_of_updates) {
+			// resumed with nothing left to render: only the first hits
+			RenderPass aov_pass =
+				render_pass_new(input_data, NULL, NULL, trace_albedo, seed);
+			aov_pass.albedo_sum = albedo_sum;
+			aov_pass.normal_sum = normal_sum;
+			render_pass(&aov_pass);
+		}
+		translate_and_write_pfm(color_pfm, input_data, pixel_sum, passes_done,
+								pixel_passes);
+		translate_and_write_pfm(albedo_pfm, input_data, albedo_sum, 1, NULL);
+		translate_and_write_pfm(normal_pfm, input_data, normal_sum, 1, NULL);
 	}
 
-	free(buffer);
+	free(pixel_passes);
+	free(square_sum);
+	free(normal_sum);
+	free(albedo_sum);
 	free(pixel_sum);
 }
 
-inline void shoot_a_pixel(Float3* pixel_to_update, const int sqrt_ray_per_pixel,
+// Renders one ray per pixel a pass, going through the sub-pixel grid of the
+// scene, and starts over as soon as the camera moves: the first frame after a
+// move is ray_per_pixel times quicker than a pass of shoot_and_draw(), and
+// `sqrt_ray_per_pixel`^2 of them add up to one. The scene and its BVH stay
+// as they are, only the camera is rebuilt.
+void shoot_and_preview(InputData* input_data, PreviewInput* commands) {
+	char header[64];
+	const Camera* camera = &input_data->camera;
+	const int width = camera->width;
+	const int height = camera->height;
+	const int total_pixel = width * height;
+	const int sqrt_ray_per_pixel = camera->sqrt_ray_per_pixel;
+	const int ray_per_pixel = sqrt_ray_per_pixel * sqrt_ray_per_pixel;
+	const int max_passes = input_data->number_of_updates * ray_per_pixel;
+	Float3* pixel_sum = calloc(total_pixel, sizeof(Float3));
+	if (pixel_sum == NULL) {
+		fprintf(stderr, "Error: can't allocate memory for %d pixel\n",
+				total_pixel);
+		exit(-1);
+	}
+	sprintf(header, "P6\n%d %d\n255\n", width, height);
+	MappedFile ppm = mapped_file_new(input_data->color_ppm, header,
+									 (size_t)total_pixel * 3);
+
+	const uint64_t seed =
+		input_data->seed != 0 ? input_data->seed : (uint64_t)time(NULL);
+	RenderPass pass =
+		render_pass_new(input_data, pixel_sum, ppm.data, trace_ray, seed);
+	Camera frame;
+	pass.camera = &frame;
+	fprintf(stderr, "preview (%d threads), %d passes a frame\n",
+			pass.n_threads, max_passes);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int passes = 0;
+	for (;;) {
+		const int done = passes == max_passes;
+		const int moved = preview_input_read(commands, input_data, done);
+		if (commands->quit) break;
+		if (moved) {
+			memset(pixel_sum, 0, sizeof(Float3) * total_pixel);
+			passes = 0;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+		} else if (done && commands->closed) {
+			break;
+		} else if (done) {
+			continue;
+		}
+		// the sub-pixel ray shoot_a_pixel() would shoot in k-th place
+		const int k = passes % ray_per_pixel;
+		frame = *camera;
+		frame.sqrt_ray_per_pixel = 1;
+		const Float3 offset_x =
+			float3_mul(&camera->d_x, k % sqrt_ray_per_pixel);
+		const Float3 offset_y =
+			float3_mul(&camera->d_y, k / sqrt_ray_per_pixel);
+		float3_add_eq(&frame.upper_left.direction, &offset_x);
+		float3_add_eq(&frame.upper_left.direction, &offset_y);
+		pass.pass_index = ++passes;
+		pass.to_multiply = 255.0f / passes;
+		render_pass(&pass);
+		fprintf(stderr, "\rpreview: %d / %d passes, %.0f ms ", passes,
+				max_passes, elapsed_ms(&start));
+	}
+	fprintf(stderr, "\n");
+	mapped_file_free(&ppm);
+	free(pixel_sum);
+}
+
+// The frames of an animation, shared by the FrameSlots that render them
+typedef struct _Animation {
+	const InputData* input_data;
+	int last_frame, total_frames, n_threads, n_slots;
+	uint64_t seed;
+	atomic_int next_frame, frames_done;
+} Animation;
+
+// A PPM to write, in its own thread, while the next frame is traced
+typedef struct _FrameWrite {
+	char* filename;
+	const unsigned char* buffer;
+	int width, height;
+} FrameWrite;
+
+// Renders frames one after the other with `n_threads`. Its buffers are
+// allocated once and reused by all its frames.
+typedef struct _FrameSlot {
+	Animation* animation;
+	int n_threads;
+	Camera camera;
+	Float3* pixel_sum;
+	// two, so one can be written while the other one is traced
+	unsigned char* buffer[2];
+	FrameWrite write;
+	pthread_t writer;
+	int writing;
+} FrameSlot;
+
+// Renders frames `first` to `last` of the camera path, each one like
+// shoot_and_draw() would with the camera of its frame, to the PPM name with
+// the frame number added. Small frames, whose tiles are fewer than the
+// threads, go several at a time, each one with its share of the threads.
+void shoot_and_animate(const InputData* input_data, const int first,
+					   const int last) {
+	const Camera* camera = &input_data->camera;
+	const int total_pixel = camera->width * camera->height;
+	const int total_tiles = ((camera->width + TILE_SIZE - 1) / TILE_SIZE) *
+							((camera->height + TILE_SIZE - 1) / TILE_SIZE);
+	int n_threads = input_data->n_threads;
+	if (n_threads <= 0) n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_threads <= 0) n_threads = 1;
+	int n_slots = n_threads > total_tiles ? n_threads / total_tiles : 1;
+	n_slots = int_min(n_slots, last - first + 1);
+
+	Animation animation;
+	animation.input_data = input_data;
+	animation.last_frame = last;
+	animation.total_frames = last - first + 1;
+	animation.n_threads = n_threads;
+	animation.n_slots = n_slots;
+	animation.seed =
+		input_data->seed != 0 ? input_data->seed : (uint64_t)time(NULL);
+	atomic_init(&animation.next_frame, first);
+	atomic_init(&animation.frames_done, 0);
+	FrameSlot* slots = malloc(sizeof(FrameSlot) * n_slots);
+	pthread_t* threads = malloc(sizeof(pthread_t) * n_slots);
+	if (slots == NULL || threads == NULL) {
+		fprintf(stderr, "Error: malloc failed in shoot_and_animate()\n");
+		exit(-1);
+	}
+	for (int i = 0; i < n_slots; i++) {
+		FrameSlot* slot = &slots[i];
+		slot->animation = &animation;
+		// the threads left over go to the first slots
+		slot->n_threads = n_threads / n_slots + (i < n_threads % n_slots);
+		slot->pixel_sum = malloc(sizeof(Float3) * total_pixel);
+		slot->buffer[0] = malloc((size_t)total_pixel * 3);
+		slot->buffer[1] = malloc((size_t)total_pixel * 3);
+		slot->writing = 0;
+		if (slot->pixel_sum == NULL || slot->buffer[0] == NULL ||
+			slot->buffer[1] == NULL) {
+			fprintf(stderr, "Error: can't allocate memory for %d pixel\n",
+					total_pixel);
+			exit(-1);
+		}
+	}
+	fprintf(stderr, "seed: %llu\n", (unsigned long long)animation.seed);
+	fprintf(stderr, "animation (%d threads, %d frames at a time): 0 / %d",
+			n_threads, n_slots, animation.total_frames);
+	for (int i = 1; i < n_slots; i++) {
+		if (pthread_create(&threads[i], NULL, animate_worker, &slots[i]) != 0) {
+			fprintf(stderr, "Error: can't create thread %d\n", i);
+			exit(-1);
+		}
+	}
+	animate_worker(&slots[0]);
+	for (int i = 1; i < n_slots; i++) pthread_join(threads[i], NULL);
+	fprintf(stderr, "\n");
+	for (int i = 0; i < n_slots; i++) {
+		free(slots[i].buffer[1]);
+		free(slots[i].buffer[0]);
+		free(slots[i].pixel_sum);
+	}
+	free(threads);
+	free(slots);
+}
+
+void* animate_worker(void* arg) {
+	FrameSlot* slot = arg;
+	Animation* animation = slot->animation;
+	const InputData* input_data = animation->input_data;
+	const Camera* camera = &input_data->camera;
+	const int total_pixel = camera->width * camera->height;
+	const int ray_per_pixel =
+		camera->sqrt_ray_per_pixel * camera->sqrt_ray_per_pixel;
+	const int number_of_updates = input_data->number_of_updates;
+	for (int b = 0;; b ^= 1) {
+		const int frame = atomic_fetch_add(&animation->next_frame, 1);
+		if (frame > animation->last_frame) break;
+		slot->camera =
+			camera_path_camera(&input_data->camera_path, frame, camera);
+		memset(slot->pixel_sum, 0, sizeof(Float3) * total_pixel);
+		// every frame has its own random numbers, whichever slot renders it
+		RenderPass pass = render_pass_new(input_data, slot->pixel_sum, NULL,
+										  trace_ray, animation->seed + frame);
+		pass.camera = &slot->camera;
+		pass.n_threads = slot->n_threads;
+		for (int nou = 1; nou <= number_of_updates; nou++) {
+			pass.pass_index = nou;
+			pass.to_multiply = 255.0f / (nou * ray_per_pixel);
+			// only the last pass is converted
+			pass.buffer = nou == number_of_updates ? slot->buffer[b] : NULL;
+			render_pass(&pass);
+		}
+		// the previous frame is written by now: its buffer is the next one
+		if (slot->writing) {
+			pthread_join(slot->writer, NULL);
+			free(slot->write.filename);
+		}
+		slot->write.filename = frame_filename(input_data->color_ppm, frame);
+		slot->write.buffer = slot->buffer[b];
+		slot->write.width = camera->width;
+		slot->write.height = camera->height;
+		if (pthread_create(&slot->writer, NULL, frame_writer, &slot->write) !=
+			0) {
+			fprintf(stderr, "Error: can't create a writer thread\n");
+			exit(-1);
+		}
+		slot->writing = 1;
+		fprintf(stderr,
+				"\ranimation (%d threads, %d frames at a time): %d / %d",
+				animation->n_threads, animation->n_slots,
+				atomic_fetch_add(&animation->frames_done, 1) + 1,
+				animation->total_frames);
+	}
+	if (slot->writing) {
+		pthread_join(slot->writer, NULL);
+		free(slot->write.filename);
+		slot->writing = 0;
+	}
+	return NULL;
+}
+
+void* frame_writer(void* arg) {
+	const FrameWrite* write = arg;
+	FILE* file = fopen(write->filename, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open file %s\n", write->filename);
+		exit(-1);
+	}
+	const size_t size = (size_t)write->width * write->height * 3;
+	fprintf(file, "P6\n%d %d\n255\n", write->width, write->height);
+	if (fwrite(write->buffer, 1, size, file) != size || fclose(file) != 0) {
+		fprintf(stderr, "Error: can't write file %s\n", write->filename);
+		exit(-1);
+	}
+	return NULL;
+}
+
+double elapsed_ms(const struct timespec* since) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1e3 +
+		   (now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+RenderPass render_pass_new(const InputData* input_data, Float3* pixel_sum,
+						   unsigned char* buffer, TraceFn trace_fn,
+						   const uint64_t seed) {
+	RenderPass pass;
+	pass.input_data = input_data;
+	pass.camera = &input_data->camera;
+	pass.pixel_sum = pixel_sum;
+	pass.albedo_sum = NULL;
+	pass.normal_sum = NULL;
+	pass.square_sum = NULL;
+	pass.pixel_passes = NULL;
+	pass.buffer = buffer;
+	pass.to_multiply = 1.0f;
+	pass.trace_fn = trace_fn;
+	pass.seed = seed;
+	pass.pass_index = 0;
+	pass.tiles_x = (input_data->camera.width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tiles_y = (input_data->camera.height + TILE_SIZE - 1) / TILE_SIZE;
+	pass.total_tiles = pass.tiles_x * tiles_y;
+	pass.n_threads = input_data->n_threads;
+	if (pass.n_threads <= 0) pass.n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (pass.n_threads <= 0) pass.n_threads = 1;
+	atomic_init(&pass.next_tile, 0);
+	return pass;
+}
+
+// Every thread, the calling one included, pulls tiles from `next_tile` until
+// the image is done: tiles never overlap, so no locking is needed on the sums
+// or `buffer`.
+void render_pass(RenderPass* pass) {
+	const int n_workers = pass->n_threads - 1;
+	pthread_t* workers = malloc(sizeof(pthread_t) * (n_workers + 1));
+	if (workers == NULL) {
+		fprintf(stderr, "Error: malloc failed in render_pass()\n");
+		exit(-1);
+	}
+	atomic_store(&pass->next_tile, 0);
+	for (int i = 0; i < n_workers; i++) {
+		if (pthread_create(&workers[i], NULL, render_worker, pass) != 0) {
+			fprintf(stderr, "Error: can't create thread %d\n", i);
+			exit(-1);
+		}
+	}
+	render_worker(pass);
+	for (int i = 0; i < n_workers; i++) pthread_join(workers[i], NULL);
+	free(workers);
+}
+
+void* render_worker(void* arg) {
+	RenderPass* pass = arg;
+	for (;;) {
+		const int tile = atomic_fetch_add(&pass->next_tile, 1);
+		if (tile >= pass->total_tiles) break;
+		render_tile(pass, tile);
+	}
+	return NULL;
+}
+
+void render_tile(const RenderPass* pass, const int tile) {
+	const InputData* input_data = pass->input_data;
+	const Camera* camera = pass->camera;
+	const int width = camera->width;
+	int tile_x, tile_y;
+	tile_position(pass, tile, &tile_x, &tile_y);
+	const int x_start = tile_x * TILE_SIZE;
+	const int y_start = tile_y * TILE_SIZE;
+	const int x_end = int_min(x_start + TILE_SIZE, width);
+	const int y_end = int_min(y_start + TILE_SIZE, camera->height);
+	const int ray_per_pixel =
+		camera->sqrt_ray_per_pixel * camera->sqrt_ray_per_pixel;
+
+	Ray3 row = camera->upper_left;
+	const Float3 offset_x = float3_mul(&camera->delta_x, x_start);
+	const Float3 offset_y = float3_mul(&camera->delta_y, y_start);
+	float3_add_eq(&row.direction, &offset_x);
+	float3_add_eq(&row.direction, &offset_y);
+	for (int i = y_start; i < y_end; i++) {
+		Ray3 col = row;
+		for (int j = x_start, idx = i * width + x_start; j < x_end;
+			 j++, idx++) {
+			// One stream per (pass, pixel): the image only depends on the seed
+			Rng rng = rng_new(pass->seed,
+							  ((uint64_t)pass->pass_index << 32) | idx);
+			PixelSums sums;
+			sums.color = pass->pixel_sum != NULL ? &pass->pixel_sum[idx] : NULL;
+			sums.albedo = pass->albedo_sum != NULL ? &pass->albedo_sum[idx] : NULL;
+			sums.normal = pass->normal_sum != NULL ? &pass->normal_sum[idx] : NULL;
+			// a converged pixel is frozen, it may still need its albedo and
+			// normal after a resume
+			const int adaptive = pass->pixel_passes != NULL && sums.color != NULL;
+			if (adaptive &&
+				pixel_converged(sums.color, pass->square_sum[idx],
+								pass->pixel_passes[idx], ray_per_pixel,
+								input_data->target_noise))
+				sums.color = NULL;
+			Float3 before = float3_new(0, 0, 0);
+			if (sums.color != NULL) before = *sums.color;
+			if (sums.color != NULL || sums.albedo != NULL || sums.normal != NULL)
+				shoot_a_pixel(&sums, camera->sqrt_ray_per_pixel, &col,
+							  &camera->d_x, &camera->d_y, &input_data->bvh,
+							  input_data->max_bounces,
+							  &input_data->background_color, pass->trace_fn,
+							  &rng);
+			float to_multiply = pass->to_multiply;
+			if (adaptive && sums.color != NULL) {
+				// one sample of the pixel's mean: the mean of this pass's rays
+				const Float3 added = float3_sub(sums.color, &before);
+				const float mean = float3_luminance(&added) / ray_per_pixel;
+				pass->square_sum[idx] += mean * mean;
+				const int passes = ++pass->pixel_passes[idx];
+				to_multiply = 255.0f / (passes * ray_per_pixel);
+			}
+			if (pass->buffer != NULL && sums.color != NULL) {
+				unsigned char* rgb = &pass->buffer[idx * 3];
+				rgb[0] = int_min(sums.color->x * to_multiply, 255);
+				rgb[1] = int_min(sums.color->y * to_multiply, 255);
+				rgb[2] = int_min(sums.color->z * to_multiply, 255);
+			}
+			float3_add_eq(&col.direction, &camera->delta_x);
+		}
+		float3_add_eq(&row.direction, &camera->delta_y);
+	}
+}
+
+// The tile taken `tile`-th in a pass, in tiles from the upper left corner. The
+// pixels are still indexed row by row: only the order they are traced in
+// changes, and so nothing of the image.
+void tile_position(const RenderPass* pass, int tile, int* x, int* y) {
+#if TILE_ORDER == TILE_ORDER_MORTON
+	const int tiles_y = pass->total_tiles / pass->tiles_x;
+	// every block row before is whole, and so is every block before in a row
+	const int block_y = tile / (pass->tiles_x * TILE_BLOCK);
+	tile -= block_y * pass->tiles_x * TILE_BLOCK;
+	const int height = int_min(TILE_BLOCK, tiles_y - block_y * TILE_BLOCK);
+	const int block_x = tile / (TILE_BLOCK * height);
+	tile -= block_x * TILE_BLOCK * height;
+	const int width =
+		int_min(TILE_BLOCK, pass->tiles_x - block_x * TILE_BLOCK);
+	// a block cut by the edge of the image skips its missing tiles
+	for (int code = 0;; code++) {
+		const int in_x = morton_compact(code);
+		const int in_y = morton_compact(code >> 1);
+		if (in_x < width && in_y < height && tile-- == 0) {
+			*x = block_x * TILE_BLOCK + in_x;
+			*y = block_y * TILE_BLOCK + in_y;
+			return;
+		}
+	}
+#else
+	*x = tile % pass->tiles_x;
+	*y = tile / pass->tiles_x;
+#endif
+}
+
+// The even bits of a Morton code, packed: one of its two coordinates
+int morton_compact(const int code) {
+	int value = 0;
+	for (int bit = 0; code >> (2 * bit); bit++)
+		value |= ((code >> (2 * bit)) & 1) << bit;
+	return value;
+}
+
+// Whether the standard error of the mean luminance of a pixel, estimated
+// from its passes, is under `target_noise`. Each pass is one sample: the mean
+// of its `ray_per_pixel` rays.
+int pixel_converged(const Float3* pixel_sum, const float square_sum,
+					const int passes, const int ray_per_pixel,
+					const float target_noise) {
+	if (passes < ADAPTIVE_MIN_PASSES) return 0;
+	const float mean =
+		float3_luminance(pixel_sum) / ((float)passes * ray_per_pixel);
+	const float variance =
+		fmaxf(square_sum - passes * mean * mean, 0) / (passes - 1);
+	return variance / passes <= target_noise * target_noise;
+}
+
+// With PACKET_SIZE > 1 the primary rays go through the BVH PACKET_SIZE at a
+// time; the ones left over, and packets that aren't coherent, go one by one.
+// Either way trace_fn() sees the rays in the same order, so the random
+// numbers they draw don't change.
+inline void shoot_a_pixel(const PixelSums* sums, const int sqrt_ray_per_pixel,
 						  const Ray3* upper_left, const Float3* d_x,
-						  const Float3* d_y, const ObjectVec* objects,
+						  const Float3* d_y, const Bvh* bvh,
 						  const float max_bounces, const Float3* background,
-						  Float3 (*trace_fn)(const Ray3*, const ObjectVec*,
-											 const int, const Float3*)) {
+						  TraceFn trace_fn, Rng* rng) {
 	Ray3 ray = *upper_left;
 	Float3 starting_direction = ray.direction;
+#if PACKET_SIZE > 1
+	RayPacket packet;
+	PacketHit hit;
+	packet.origin = upper_left->origin;
+	int lanes = 0;
+#endif
 	for (int ii = 0; ii < sqrt_ray_per_pixel; ii++) {
 		ray.direction = starting_direction;
 		for (int jj = 0; jj < sqrt_ray_per_pixel; jj++) {
-			Float3 light = trace_fn(&ray, objects, max_bounces, background);
-			float3_add_eq(pixel_to_update, &light);
+#if PACKET_SIZE > 1
+			packet.dx[lanes] = ray.direction.x;
+			packet.dy[lanes] = ray.direction.y;
+			packet.dz[lanes] = ray.direction.z;
+			if (++lanes == PACKET_SIZE) {
+				const int coherent = ray_packet_prepare(&packet);
+				if (coherent) bvh_nearest_packet(bvh, &packet, &hit);
+				for (int l = 0; l < PACKET_SIZE; l++) {
+					const Ray3 lane_ray = ray_packet_ray(&packet, l);
+					if (coherent) {
+						Object* obj = hit.object[l] >= 0
+										  ? &bvh->objects->ptr[hit.object[l]]
+										  : NULL;
+						shoot_a_sample(sums, &lane_ray, obj, hit.distance[l], bvh,
+									   max_bounces, background, trace_fn, rng);
+					} else {
+						shoot_a_ray(sums, &lane_ray, bvh, max_bounces,
+									background, trace_fn, rng);
+					}
+				}
+				lanes = 0;
+			}
+#else
+			shoot_a_ray(sums, &ray, bvh, max_bounces, background, trace_fn,
+						rng);
+#endif
 			float3_add_eq(&ray.direction, d_x);
 		}
 		float3_add_eq(&starting_direction, d_y);
 	}
+#if PACKET_SIZE > 1
+	for (int l = 0; l < lanes; l++) {
+		const Ray3 lane_ray = ray_packet_ray(&packet, l);
+		shoot_a_ray(sums, &lane_ray, bvh, max_bounces, background, trace_fn,
+					rng);
+	}
+#endif
+}
+
+inline void shoot_a_ray(const PixelSums* sums, const Ray3* ray,
+						const Bvh* bvh, const int max_bounces,
+						const Float3* background, TraceFn trace_fn, Rng* rng) {
+	float distance;
+	Object* obj = bvh_nearest_object(bvh, ray, &distance);
+	shoot_a_sample(sums, ray, obj, distance, bvh, max_bounces, background,
+				   trace_fn, rng);
+}
+
+// Adds one primary ray, whose first hit is `obj` at `distance`, to the sums.
+// The albedo and the normal come from that same hit, so capturing them costs
+// no extra traversal.
+inline void shoot_a_sample(const PixelSums* sums, const Ray3* ray, Object* obj,
+						   const float distance, const Bvh* bvh,
+						   const int max_bounces, const Float3* background,
+						   TraceFn trace_fn, Rng* rng) {
+	if (sums->albedo != NULL) {
+		const Float3 albedo = trace_albedo(ray, obj, distance, bvh,
+										   max_bounces, background, rng);
+		float3_add_eq(sums->albedo, &albedo);
+	}
+	if (sums->normal != NULL) {
+		const Float3 normal = trace_normal(ray, obj, distance, bvh,
+										   max_bounces, background, rng);
+		float3_add_eq(sums->normal, &normal);
+	}
+	if (sums->color != NULL) {
+		const Float3 light = trace_fn(ray, obj, distance, bvh, max_bounces,
+									  background, rng);
+		float3_add_eq(sums->color, &light);
+	}
 }
 
-inline Float3 trace_ray(const Ray3* ray, const ObjectVec* objects,
-						const int max_bounces, const Float3* background) {
+inline Float3 trace_ray(const Ray3* ray, Object* obj, float distance,
+						const Bvh* bvh, const int max_bounces,
+						const Float3* background, Rng* rng) {
 	Float3 color = float3_new(1, 1, 1);
 	Float3 light = float3_new(0, 0, 0);
 	Ray3 local_ray = *ray;
-	Object* prev = NULL;
+#if NEXT_EVENT
+	// the density of the last bounce (0 unless it was diffuse) and the object
+	// it left
+	float bounce_pdf = 0;
+	const Object* bounced_from = NULL;
+#endif
 	for (int i = 0; i < max_bounces; i++) {
-		float distance;
-		Object* obj = nearest_object(&local_ray, objects, prev, &distance);
+		if (i > 0) obj = bvh_nearest_object(bvh, &local_ray, &distance);
 		if (obj == NULL) {
 			const Float3 added_light = float3_mul_float3(background, &color);
 			float3_add_eq(&light, &added_light);
 			break;
 		} else {
-			prev = obj;
-			object_reflect_ray(obj, &local_ray, distance);
-			const Float3 added_light =
-				float3_mul_float3(&obj->light_emitted, &color);
+			const Material* material = &bvh->objects->materials[obj->material];
+			Float3 added_light =
+				float3_mul_float3(&material->light_emitted, &color);
+#if NEXT_EVENT
+			// a light the last diffuse bounce found: next_event() could
+			// have sampled it too, the two share it. It never samples the
+			// object it is on: a bounce back onto that one keeps it all.
+			if (bounce_pdf > 0 && obj != bounced_from &&
+				float3_luminance(&added_light) > 0)
+				float3_mul_eq(&added_light,
+							  power_heuristic(
+								  bounce_pdf,
+								  light_pdf(&bvh->lights, bvh->objects, obj,
+											&local_ray, distance)));
+#endif
 			float3_add_eq(&light, &added_light);
-			float3_mul_eq_float3(&color, &obj->color);
+			Float3 normal;
+			const int diffuse = object_reflect_ray(bvh->objects, obj, &local_ray,
+												   distance, &normal, rng);
+#if NEXT_EVENT
+			bounce_pdf = 0;
+			bounced_from = obj;
+			if (diffuse) {
+				bounce_pdf =
+					fmaxf(float3_dot(&normal, &local_ray.direction), 0) / PI;
+				if (i + 1 < max_bounces) {
+					Float3 direct =
+						next_event(bvh, obj, &local_ray, &normal, rng);
+					float3_mul_eq_float3(&direct, &material->color);
+					float3_mul_eq_float3(&direct, &color);
+					float3_add_eq(&light, &direct);
+				}
+			}
+#else
+			(void)diffuse;
+#endif
+			float3_mul_eq_float3(&color, &material->color);
+#if RUSSIAN_ROULETTE
+			// the path goes on with the probability of its brightest channel
+			// and is divided by it, so the sum is still right on average
+			const float survive = fmaxf(color.x, fmaxf(color.y, color.z));
+			if (i + 1 >= ROULETTE_MIN_BOUNCES && i + 1 < max_bounces &&
+				survive < 1) {
+				if (rng_next_float(rng) >= survive) break;
+				float3_div_eq(&color, survive);
+			}
+#endif
 		}
 	}
 	return light;
 }
 
-inline Float3 trace_albedo(const Ray3* ray, const ObjectVec* objects,
+// The light of one point of a light, seen from the diffuse hit `ray` leaves,
+// weighted against finding it by the bounce. The surface's color isn't in.
+Float3 next_event(const Bvh* bvh, const Object* obj, const Ray3* ray,
+				  const Float3* normal, Rng* rng) {
+	LightSample sample;
+	if (!light_sample(&bvh->lights, bvh->objects, &ray->origin, rng, &sample) ||
+		sample.light == obj)
+		return float3_new(0, 0, 0);
+	const float cos_theta = float3_dot(normal, &sample.direction);
+	if (cos_theta <= 0) return float3_new(0, 0, 0);
+	const Ray3 shadow = ray3_new(&ray->origin, &sample.direction);
+	// short of the light, not to count it as its own shadow
+	if (bvh_occluded(bvh, &shadow, sample.distance * (1 - RAY_EPSILON)))
+		return float3_new(0, 0, 0);
+	const float bounce_pdf = cos_theta / PI;
+	return float3_mul(
+		&bvh->objects->materials[sample.light->material].light_emitted,
+		bounce_pdf / sample.pdf * power_heuristic(sample.pdf, bounce_pdf));
+}
+
+// Veach's weight for the sample of a strategy of density `pdf` when another
+// one of density `other_pdf` could have drawn it
+float power_heuristic(const float pdf, const float other_pdf) {
+	const float a = pdf * pdf, b = other_pdf * other_pdf;
+	return a / (a + b);
+}
+
+inline Float3 trace_albedo(__attribute__((unused)) const Ray3* ray,
+						   Object* obj,
+						   __attribute__((unused)) const float distance,
+						   const Bvh* bvh,
 						   __attribute__((unused)) const int max_bounces,
-						   __attribute__((unused)) const Float3* background) {
-	Object* obj = nearest_object(ray, objects, NULL, NULL);
+						   __attribute__((unused)) const Float3* background,
+						   __attribute__((unused)) Rng* rng) {
 	if (obj != NULL) {
-		return obj->color;
+		return bvh->objects->materials[obj->material].color;
 	}
 	return float3_new(0, 0, 0);
 }
 
-inline Float3 trace_normal(const Ray3* ray, const ObjectVec* objects,
+inline Float3 trace_normal(const Ray3* ray, Object* obj, const float distance,
+						   const Bvh* bvh,
 						   __attribute__((unused)) const int max_bounces,
-						   __attribute__((unused)) const Float3* background) {
+						   __attribute__((unused)) const Float3* background,
+						   __attribute__((unused)) Rng* rng) {
 	Ray3 local_ray = *ray;
-	float distance;
-	Object* obj = nearest_object(&local_ray, objects, NULL, &distance);
 	if (obj != NULL) {
 		ray3_move_along(&local_ray, distance);
-		return object_normal_normalized(obj, &local_ray);
+		return object_normal_normalized(bvh->objects, obj, &local_ray);
 	}
 	return float3_new(0, 0, 0);
 }
 
-inline Object* nearest_object(const Ray3* ray, const ObjectVec* objects,
-							  const Object* prev, float* distance) {
+// Reference for bvh_nearest_object(), only used to benchmark and check it on
+// rays that don't start on a surface.
+Object* nearest_object_linear(const Ray3* ray, const ObjectVec* objects,
+							  float* distance) {
 	Object* nearest_object = NULL;
 	float nearest_distance = INFINITY;
 	for (int j = 0; j < objects->size; j++) {
 		Object* object_found = &objects->ptr[j];
-		float distance_found = object_intersect_distance(object_found, ray);
-		if (distance_found > 0 && prev != object_found &&
-			distance_found < nearest_distance) {
+		float distance_found =
+			object_intersect_distance(objects, object_found, ray);
+		if (distance_found > 0 && distance_found < nearest_distance) {
 			nearest_object = object_found;
 			nearest_distance = distance_found;
 		}
@@ -173,69 +853,40 @@ inline Object* nearest_object(const Ray3* ray, const ObjectVec* objects,
 	return nearest_object;
 }
 
+// `pixel_passes` is the number of passes of each pixel, NULL if they all had
+// `passes`.
 inline void translate_and_write_pfm(const char* filename,
 									const InputData* input_data,
-									Float3* pixel_sum) {
-	const int height = input_data->camera.height;
-	const int width = input_data->camera.width;
-	const int total_pixel = width * height;
+									Float3* pixel_sum, const int passes,
+									const int* pixel_passes) {
 	const int sqrt_ray_per_pixel = input_data->camera.sqrt_ray_per_pixel;
 	const int ray_per_pixel = sqrt_ray_per_pixel * sqrt_ray_per_pixel;
-	const int number_of_updates = input_data->number_of_updates;
-
-	fprintf(stderr, "%s: 0 / 1", filename);
-	float to_multiply = 1.0f / (number_of_updates * ray_per_pixel);
-	for (int i = 0; i < total_pixel; i++)
-		float3_mul_eq(&pixel_sum[i], to_multiply);
-	write_pfm(filename, pixel_sum, width, height);
-	fprintf(stderr, "\r%s: 1 / 1\n", filename);
-}
 
-inline void calculate_and_write_pfm(
-	const char* filename, const InputData* input_data, Float3* pixel_sum,
-	Float3 (*trace_fn)(const Ray3*, const ObjectVec*, const int,
-					   const Float3*)) {
-	const int height = input_data->camera.height;
-	const int width = input_data->camera.width;
-	const int sqrt_ray_per_pixel = input_data->camera.sqrt_ray_per_pixel;
-	const int max_bounces = input_data->max_bounces;
-	const Float3* delta_x = &input_data->camera.delta_x;
-	const Float3* delta_y = &input_data->camera.delta_y;
-	const Float3* d_x = &input_data->camera.d_x;
-	const Float3* d_y = &input_data->camera.d_y;
-	const ObjectVec* objects = &input_data->objects;
-	const int ray_per_pixel = input_data->camera.sqrt_ray_per_pixel *
-							  input_data->camera.sqrt_ray_per_pixel;
-	const Float3* background = &input_data->background_color;
-
-	Ray3 row = input_data->camera.upper_left;
 	fprintf(stderr, "%s: 0 / 1", filename);
-	float to_multiply = 1.0f / ray_per_pixel;
-	for (int i = 0, idx = 0; i < height; i++) {
-		Ray3 col = row;
-		for (int j = 0; j < width; j++, idx++) {
-			pixel_sum[idx] = float3_new(0, 0, 0);
-			shoot_a_pixel(&pixel_sum[idx], sqrt_ray_per_pixel, &col, d_x, d_y,
-						  objects, max_bounces, background, trace_fn);
-			float3_mul_eq(&pixel_sum[idx], to_multiply);
-			float3_add_eq(&col.direction, delta_x);
-		}
-		float3_add_eq(&row.direction, delta_y);
-	}
-	write_pfm(filename, pixel_sum, width, height);
+	write_pfm(filename, pixel_sum, input_data->camera.width,
+			  input_data->camera.height,
+			  pixel_passes != NULL ? 1.0f / ray_per_pixel
+								   : 1.0f / (passes * ray_per_pixel),
+			  pixel_passes);
 	fprintf(stderr, "\r%s: 1 / 1\n", filename);
 }
 
-inline void write_pfm(const char* filename, Float3* pixel_sum, const int width,
-					  const int height) {
+// Scales `pixel_sum` by `to_multiply`, divided by `pixel_passes` if it isn't
+// NULL, straight into the mapped file. The header has no fixed length, so the
+// floats may be unaligned there: memcpy.
+inline void write_pfm(const char* filename, const Float3* pixel_sum,
+					  const int width, const int height,
+					  const float to_multiply, const int* pixel_passes) {
 	const int total_pixel = width * height;
-
-	FILE* file = fopen(filename, "wb");
-	if (file == NULL) {
-		fprintf(stderr, "Error: can't open file %s\n", filename);
-		exit(-1);
+	char header[64];
+	sprintf(header, "PF\n%d %d\n-1.0\n", width, height);
+	MappedFile pfm =
+		mapped_file_new(filename, header, sizeof(Float3) * total_pixel);
+	for (int i = 0; i < total_pixel; i++) {
+		const Float3 pixel = float3_mul(
+			&pixel_sum[i], pixel_passes != NULL ? to_multiply / pixel_passes[i]
+												: to_multiply);
+		memcpy(pfm.data + sizeof(Float3) * i, &pixel, sizeof(Float3));
 	}
-	fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
-	fwrite(pixel_sum, sizeof(Float3), total_pixel, file);
-	fclose(file);
+	mapped_file_free(&pfm);
 }
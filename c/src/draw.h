@@ -1,33 +1,84 @@
 #pragma once
 
 #include "algebra.h"
+#include "bvh.h"
+#include "preview.h"
+#include "rng.h"
 #include "scanner.h"
 
+// Paths are ended at random once their throughput gets low (Russian roulette)
+// unless built with `make ROULETTE=0`. The first bounces are always traced.
+#ifndef RUSSIAN_ROULETTE
+#define RUSSIAN_ROULETTE 1
+#endif
+#define ROULETTE_MIN_BOUNCES 3
+// At every diffuse hit a point of a light is sampled and tested with a shadow
+// ray (next-event estimation), unless built with `make NEE=0`. Its weight
+// needs the density of the bounce: only the cosine sampler gives it.
+#ifndef NEXT_EVENT
+#define NEXT_EVENT 1
+#endif
+#if DIFFUSE_SAMPLING != DIFFUSE_COSINE
+#undef NEXT_EVENT
+#define NEXT_EVENT 0
+#endif
+
+// The 16x16 tiles of a pass are taken in Z-order (Morton) inside blocks of
+// TILE_BLOCK x TILE_BLOCK tiles, the blocks row by row, so the tiles traced
+// one after another, by one thread or by all of them, are close on screen and
+// hit the same part of the BVH. `make ORDER=rows` takes them row by row.
+#define TILE_ORDER_ROWS 1
+#define TILE_ORDER_MORTON 2
+#ifndef TILE_ORDER
+#define TILE_ORDER TILE_ORDER_MORTON
+#endif
+
+// `obj` and `distance` are the first hit of `ray` (obj == NULL if there is
+// none): the caller finds them, one ray or one packet at a time.
+typedef Float3 (*TraceFn)(const Ray3* ray, Object* obj, const float distance,
+						  const Bvh* bvh, const int max_bounces,
+						  const Float3* background, Rng* rng);
+
+// The sums of one pixel. A NULL one isn't computed: albedo and normal are only
+// captured in one pass, color is NULL when only they are.
+typedef struct _PixelSums {
+	Float3 *color, *albedo, *normal;
+} PixelSums;
+
 void shoot_and_draw(const InputData* input_data);
-void shoot_a_pixel(Float3* pixel_to_update, const int sqrt_ray_per_pixel,
+// Until `quit`, or the end of `commands` once the image is done
+void shoot_and_preview(InputData* input_data, PreviewInput* commands);
+void shoot_and_animate(const InputData* input_data, const int first,
+					   const int last);
+void shoot_a_pixel(const PixelSums* sums, const int sqrt_ray_per_pixel,
 				   const Ray3* upper_left, const Float3* d_x, const Float3* d_y,
-				   const ObjectVec* objects, const float max_bounces,
-				   const Float3* background,
-				   Float3 (*trace_fn)(const Ray3*, const ObjectVec*, const int,
-									  const Float3*));
+				   const Bvh* bvh, const float max_bounces,
+				   const Float3* background, TraceFn trace_fn, Rng* rng);
+void shoot_a_ray(const PixelSums* sums, const Ray3* ray, const Bvh* bvh,
+				 const int max_bounces, const Float3* background,
+				 TraceFn trace_fn, Rng* rng);
+void shoot_a_sample(const PixelSums* sums, const Ray3* ray, Object* obj,
+					const float distance, const Bvh* bvh,
+					const int max_bounces, const Float3* background,
+					TraceFn trace_fn, Rng* rng);
 
-Float3 trace_ray(const Ray3* ray, const ObjectVec* objects,
-				 const int max_bounces, const Float3* background);
+Float3 trace_ray(const Ray3* ray, Object* obj, const float distance,
+				 const Bvh* bvh, const int max_bounces,
+				 const Float3* background, Rng* rng);
 
-Float3 trace_albedo(const Ray3* ray, const ObjectVec* objects,
- 				   const int max_bounces, const Float3* background);
+Float3 trace_albedo(const Ray3* ray, Object* obj, const float distance,
+					const Bvh* bvh, const int max_bounces,
+					const Float3* background, Rng* rng);
 
-Float3 trace_normal(const Ray3* ray, const ObjectVec* objects,
- 				   const int max_bounces, const Float3* background);
-Object* nearest_object(const Ray3* ray, const ObjectVec* objects,
-							  const Object* prev, float* distance);
+Float3 trace_normal(const Ray3* ray, Object* obj, const float distance,
+					const Bvh* bvh, const int max_bounces,
+					const Float3* background, Rng* rng);
+Object* nearest_object_linear(const Ray3* ray, const ObjectVec* objects,
+							 float* distance);
 
 void translate_and_write_pfm(const char* filename, const InputData* input_data,
-							 Float3* pixel_sum);
-void calculate_and_write_pfm(
-	const char* filename, const InputData* input_data, Float3* pixel_sum,
-	Float3 (*trace_fn)(const Ray3*, const ObjectVec*, const int,
-					   const Float3*));
-void write_pfm(const char* filename, Float3* pixel_sum, const int width,
-			   const int height);
-
+							 Float3* pixel_sum, const int passes,
+							 const int* pixel_passes);
+void write_pfm(const char* filename, const Float3* pixel_sum, const int width,
+			   const int height, const float to_multiply,
+			   const int* pixel_passes);
@@ -0,0 +1,194 @@
+#include "light.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "algebra.h"
+#include "object.h"
+#include "ray.h"
+#include "rng.h"
+#include "sphere.h"
+
+#define PI 3.14159265358979323846
+
+float light_power(const ObjectVec* objects, const Object* object);
+int light_index(const LightList* lights, const int object);
+float light_pick(const LightList* lights, const int index);
+float light_cone(const Sphere* sphere, const Float3* point);
+
+LightList light_list_new(const ObjectVec* objects) {
+	LightList lights;
+	lights.objects = NULL;
+	lights.cdf = NULL;
+	lights.count = 0;
+	int count = 0;
+	for (int i = 0; i < objects->size; i++)
+		count += light_power(objects, &objects->ptr[i]) > 0;
+	if (count == 0) return lights;
+	lights.objects = malloc(sizeof(int) * count);
+	lights.cdf = malloc(sizeof(float) * count);
+	if (lights.objects == NULL || lights.cdf == NULL) {
+		fprintf(stderr, "Error: malloc failed in light_list_new()\n");
+		exit(-1);
+	}
+	// in double: a mesh can have millions of small emissive triangles
+	double* sums = malloc(sizeof(double) * count);
+	if (sums == NULL) {
+		fprintf(stderr, "Error: malloc failed in light_list_new()\n");
+		exit(-1);
+	}
+	double total = 0;
+	for (int i = 0; i < objects->size; i++) {
+		const float power = light_power(objects, &objects->ptr[i]);
+		if (power <= 0) continue;
+		total += power;
+		lights.objects[lights.count] = i;
+		sums[lights.count++] = total;
+	}
+	for (int i = 0; i < count; i++) lights.cdf[i] = sums[i] / total;
+	lights.cdf[count - 1] = 1;
+	free(sums);
+	return lights;
+}
+
+void light_list_free(LightList* lights) {
+	free(lights->objects);
+	free(lights->cdf);
+}
+
+int light_sample(const LightList* lights, const ObjectVec* objects,
+				 const Float3* point, Rng* rng, LightSample* sample) {
+	if (lights->count == 0) return 0;
+	// the first light whose cdf is over u
+	const float u = rng_next_float(rng);
+	int low = 0, high = lights->count - 1;
+	while (low < high) {
+		const int middle = (low + high) / 2;
+		if (lights->cdf[middle] > u) high = middle;
+		else low = middle + 1;
+	}
+	const Object* light = &objects->ptr[lights->objects[low]];
+	const float pick = light_pick(lights, low);
+	const float u1 = rng_next_float(rng), u2 = rng_next_float(rng);
+	sample->light = light;
+	if (light->shape_type == TYPE_SPHERE) {
+		// uniform in the cone of directions the sphere covers
+		const Sphere* sphere = &light->shape.sphere;
+		const float cone = light_cone(sphere, point);
+		if (cone <= 0) return 0;
+		Float3 axis = float3_sub(&sphere->center, point);
+		const float center_distance = float3_length(&axis);
+		float3_div_eq(&axis, center_distance);
+		const float cos_theta = 1 - u1 * cone;
+		const float sin2_theta = u1 * cone * (2 - u1 * cone);
+		const float sin_theta = sqrtf(sin2_theta);
+		const float phi = 2 * PI * u2;
+		sample->direction = float3_from_frame(&axis, sin_theta * cosf(phi),
+											  sin_theta * sinf(phi), cos_theta);
+		// the near side of the sphere along that direction
+		const float radius2 = sphere->radius * sphere->radius;
+		const float half_chord2 =
+			radius2 - center_distance * center_distance * sin2_theta;
+		sample->distance = center_distance * cos_theta -
+						   sqrtf(fmaxf(half_chord2, 0));
+		sample->pdf = pick / (2 * PI * cone);
+		return 1;
+	}
+	// uniform in the area of the triangle
+	const uint32_t* v = light->shape.triangle.v;
+	const Float3* p1 = &objects->vertices[v[0]];
+	const Float3* p2 = &objects->vertices[v[1]];
+	const Float3* p3 = &objects->vertices[v[2]];
+	const float su = sqrtf(u1);
+	const float b1 = 1 - su, b2 = u2 * su, b3 = 1 - b1 - b2;
+	const Float3 target =
+		float3_new(b1 * p1->x + b2 * p2->x + b3 * p3->x,
+				   b1 * p1->y + b2 * p2->y + b3 * p3->y,
+				   b1 * p1->z + b2 * p2->z + b3 * p3->z);
+	sample->direction = float3_sub(&target, point);
+	const float distance2 =
+		float3_dot(&sample->direction, &sample->direction);
+	if (distance2 <= 0) return 0;
+	sample->distance = sqrtf(distance2);
+	float3_div_eq(&sample->direction, sample->distance);
+	const Float3 e1 = float3_sub(p2, p1);
+	const Float3 e2 = float3_sub(p3, p1);
+	const Float3 cross = float3_cross(&e1, &e2);
+	// twice the area times the cosine at the light
+	const float projected = fabsf(float3_dot(&cross, &sample->direction));
+	if (projected <= 0) return 0;
+	sample->pdf = pick * distance2 / (0.5f * projected);
+	return 1;
+}
+
+float light_pdf(const LightList* lights, const ObjectVec* objects,
+				const Object* light, const Ray3* ray, const float distance) {
+	const int index = light_index(lights, light - objects->ptr);
+	if (index < 0) return 0;
+	const float pick = light_pick(lights, index);
+	if (light->shape_type == TYPE_SPHERE) {
+		const float cone = light_cone(&light->shape.sphere, &ray->origin);
+		return cone > 0 ? pick / (2 * PI * cone) : 0;
+	}
+	const uint32_t* v = light->shape.triangle.v;
+	const Float3 e1 =
+		float3_sub(&objects->vertices[v[1]], &objects->vertices[v[0]]);
+	const Float3 e2 =
+		float3_sub(&objects->vertices[v[2]], &objects->vertices[v[0]]);
+	const Float3 cross = float3_cross(&e1, &e2);
+	// `distance` is in lengths of the direction, which may not be 1
+	const float length = float3_length(&ray->direction);
+	const float projected =
+		fabsf(float3_dot(&cross, &ray->direction)) / length;
+	if (projected <= 0) return 0;
+	const float real_distance = distance * length;
+	return pick * real_distance * real_distance / (0.5f * projected);
+}
+
+// Area times emitted luminance, 0 for what isn't a light
+float light_power(const ObjectVec* objects, const Object* object) {
+	const float luminance =
+		float3_luminance(&objects->materials[object->material].light_emitted);
+	if (luminance <= 0) return 0;
+	if (object->shape_type == TYPE_SPHERE) {
+		const float radius = object->shape.sphere.radius;
+		return 4 * PI * radius * radius * luminance;
+	} else if (object->shape_type == TYPE_TRIANGLE) {
+		const uint32_t* v = object->shape.triangle.v;
+		const Float3 e1 =
+			float3_sub(&objects->vertices[v[1]], &objects->vertices[v[0]]);
+		const Float3 e2 =
+			float3_sub(&objects->vertices[v[2]], &objects->vertices[v[0]]);
+		const Float3 cross = float3_cross(&e1, &e2);
+		return 0.5f * float3_length(&cross) * luminance;
+	}
+	return 0;
+}
+
+// Where `object` is in the list, -1 if it isn't a light
+int light_index(const LightList* lights, const int object) {
+	int low = 0, high = lights->count;
+	while (low < high) {
+		const int middle = (low + high) / 2;
+		if (lights->objects[middle] < object) low = middle + 1;
+		else high = middle;
+	}
+	return low < lights->count && lights->objects[low] == object ? low : -1;
+}
+
+float light_pick(const LightList* lights, const int index) {
+	return lights->cdf[index] - (index > 0 ? lights->cdf[index - 1] : 0);
+}
+
+// 1 - cos of the half angle of the cone the sphere covers from `point`, 0
+// from inside it. Written so it doesn't cancel out for small far lights.
+float light_cone(const Sphere* sphere, const Float3* point) {
+	const Float3 axis = float3_sub(&sphere->center, point);
+	const float distance2 = float3_dot(&axis, &axis);
+	const float radius2 = sphere->radius * sphere->radius;
+	if (distance2 <= radius2) return 0;
+	const float sin2_max = radius2 / distance2;
+	return sin2_max / (1 + sqrtf(1 - sin2_max));
+}
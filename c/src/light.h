@@ -0,0 +1,36 @@
+#pragma once
+
+#include "algebra.h"
+#include "object.h"
+#include "ray.h"
+#include "rng.h"
+
+// The emissive spheres and triangles of a scene, picked in proportion to
+// their power (area times emitted luminance) for next-event estimation.
+// Emissive planes have no area to sample: they are only found by bounces.
+typedef struct _LightList {
+	// indices in the ObjectVec, in increasing order
+	int* objects;
+	// cdf[i]: the probability to pick one of the lights 0 to i
+	float* cdf;
+	int count;
+} LightList;
+
+// A point of a light seen from somewhere: the direction to it (normalized),
+// how far it is, and the density of the direction in solid angle, the pick
+// of the light included.
+typedef struct _LightSample {
+	const Object* light;
+	Float3 direction;
+	float distance, pdf;
+} LightSample;
+
+LightList light_list_new(const ObjectVec* objects);
+void light_list_free(LightList* lights);
+// Returns 0 if no light can be seen from `point`
+int light_sample(const LightList* lights, const ObjectVec* objects,
+				 const Float3* point, Rng* rng, LightSample* sample);
+// The density light_sample() has for `ray`, from `ray->origin`, if it hits
+// `light` after `distance`. 0 if it isn't in the list.
+float light_pdf(const LightList* lights, const ObjectVec* objects,
+				const Object* light, const Ray3* ray, const float distance);
@@ -1,9 +1,73 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bvh.h"
 #include "draw.h"
+#include "preview.h"
 #include "scanner.h"
+#include "scene_file.h"
+#include "soa.h"
 
-int main() {
-	InputData input_data = scan_input();
-	shoot_and_draw(&input_data);
+int main(int argc, char** argv) {
+	int resume = 0;
+	const char* scene = NULL;
+	const char* convert = NULL;
+	const char* preview = NULL;
+	// animation frames, none if first > last
+	long long first = 0, last = -1;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--resume") == 0) {
+			resume = 1;
+		} else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+			scene = argv[++i];
+		} else if (strcmp(argv[i], "--convert") == 0 && i + 1 < argc) {
+			convert = argv[++i];
+		} else if (strcmp(argv[i], "--preview") == 0 && i + 1 < argc) {
+			preview = argv[++i];
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 2 < argc &&
+				   parse_int(argv[i + 1], &first) &&
+				   parse_int(argv[i + 2], &last) && 0 <= first &&
+				   first <= last && last < INT32_MAX) {
+			i += 2;
+		} else {
+			fprintf(stderr,
+					"Usage: %s [--resume] [--scene scene.bin] < input.txt\n"
+					"       %s --convert scene.bin < input.txt\n"
+					"       %s --preview commands [--scene scene.bin] "
+					"< input.txt\n"
+					"       %s --frames first last [--scene scene.bin] "
+					"< input.txt\n",
+					argv[0], argv[0], argv[0], argv[0]);
+			return -1;
+		}
+	}
+	// stdin can't carry both the text scene and the camera updates
+	if (preview != NULL && strcmp(preview, "-") == 0 && scene == NULL) {
+		fprintf(stderr, "Error: --preview - needs a --scene\n");
+		return -1;
+	}
+	// a binary scene replaces the text one on stdin
+	InputData input_data =
+		scene != NULL ? scene_file_load(scene) : scan_input(stdin);
+	if (convert != NULL) {
+		scene_file_save(convert, &input_data);
+		object_vec_free(&input_data.objects);
+		return 0;
+	}
+	input_data.resume = resume;
+	input_data.bvh =
+		bvh_new(&input_data.objects, intersect_kernels_best_type());
+	fprintf(stderr, "intersection kernels: %s\n", input_data.bvh.kernels.name);
+	if (first <= last) {
+		shoot_and_animate(&input_data, first, last);
+	} else if (preview != NULL) {
+		PreviewInput commands = preview_input_open(preview);
+		shoot_and_preview(&input_data, &commands);
+		preview_input_close(&commands);
+	} else {
+		shoot_and_draw(&input_data);
+	}
 	free_input_data(&input_data);
 	return 0;
 }
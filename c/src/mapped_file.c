@@ -0,0 +1,42 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedFile mapped_file_new(const char* filename, const char* header,
+						   const size_t data_size) {
+	const size_t header_len = strlen(header);
+	MappedFile file;
+	file.size = header_len + data_size;
+	const int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	if (ftruncate(fd, file.size) != 0) {
+		fprintf(stderr, "Error: can't resize file %s\n", filename);
+		exit(-1);
+	}
+	file.map = mmap(NULL, file.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (file.map == MAP_FAILED) {
+		fprintf(stderr, "Error: can't map file %s\n", filename);
+		exit(-1);
+	}
+	// the mapping keeps the file open
+	close(fd);
+	memcpy(file.map, header, header_len);
+	file.data = file.map + header_len;
+	return file;
+}
+
+void mapped_file_free(MappedFile* file) {
+	munmap(file->map, file->size);
+	file->map = NULL;
+	file->data = NULL;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+
+// A file created at its final size and mapped in memory: what is written to
+// `data` ends up in the file without any write() or copy.
+typedef struct _MappedFile {
+	unsigned char* map;
+	size_t size;
+	// right after the header
+	unsigned char* data;
+} MappedFile;
+
+MappedFile mapped_file_new(const char* filename, const char* header,
+						   const size_t data_size);
+void mapped_file_free(MappedFile* file);
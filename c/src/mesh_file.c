@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mesh_file.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "algebra.h"
+#include "object.h"
+#include "scanner.h"
+#include "triangle.h"
+
+// A thread isn't worth it for less than this
+#define MESH_CHUNK_MIN (1 << 20)
+#define MESH_WORD 256
+#define PI 3.14159265358979323846
+
+// Lines [begin, end) of the file. The vertices of all the chunks go straight
+// in the vertex buffer of the ObjectVec, from `vertices` on; the faces of a
+// chunk are kept apart, 3 vertex indices a triangle, until they are checked
+// against all the vertices.
+typedef struct _MeshChunk {
+	const char *begin, *end;
+	const MeshTransform* transform;
+	Float3* vertices;
+	int vertex_first, vertex_count, vertex_total;
+	uint32_t vertex_base;
+	int* faces;
+	int face_count, face_capacity;
+	const char* error;
+	// where its triangles go in the ObjectVec
+	Object* objects;
+	int material;
+} MeshChunk;
+
+void mesh_run(MeshChunk* chunks, const int n_chunks,
+			  void* (*phase)(void* chunk));
+void* mesh_count_vertices(void* chunk);
+void* mesh_parse(void* chunk);
+void* mesh_build(void* chunk);
+int mesh_line_is(const char* line, const char* end, const char type);
+int mesh_next_word(const char** cursor, const char* end, char* word);
+int mesh_face_index(MeshChunk* chunk, const char* word, const int seen);
+void mesh_face_push(MeshChunk* chunk, const int a, const int b, const int c);
+
+MeshTransform mesh_transform_new(const Float3* position,
+								 const Float3* rotation, const float scale) {
+	const Mat3 x = mat3_pitch(rotation->x * PI / 180);
+	const Mat3 y = mat3_yaw(rotation->y * PI / 180);
+	const Mat3 z = mat3_roll(rotation->z * PI / 180);
+	const Mat3 yx = mat3_mul(&y, &x);
+	MeshTransform transform;
+	transform.linear = mat3_mul(&z, &yx);
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++) transform.linear.m[i][j] *= scale;
+	transform.translation = *position;
+	return transform;
+}
+
+void mesh_file_load(const char* filename, const MeshTransform* transform,
+					const Float3* color, const float reflection,
+					const float emission_intensity, int n_threads,
+					ObjectVec* objects) {
+	const int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	const size_t size = st.st_size;
+	if (size == 0) {
+		close(fd);
+		return;
+	}
+	char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: can't map file %s\n", filename);
+		exit(-1);
+	}
+	close(fd);
+	posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+	if (n_threads <= 0) n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int n_chunks = size / MESH_CHUNK_MIN + 1;
+	if (n_threads > 0 && n_chunks > n_threads) n_chunks = n_threads;
+	MeshChunk* chunks = calloc(n_chunks, sizeof(MeshChunk));
+	if (chunks == NULL) {
+		fprintf(stderr, "Error: malloc failed in mesh_file_load()\n");
+		exit(-1);
+	}
+	// chunks of about the same size, cut after a new line
+	const char* begin = map;
+	for (int i = 0; i < n_chunks; i++) {
+		const char* end = map + size * (i + 1) / n_chunks;
+		if (end < begin) end = begin;
+		const char* new_line = memchr(end, '\n', map + size - end);
+		end = i == n_chunks - 1 || new_line == NULL ? map + size : new_line + 1;
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		chunks[i].transform = transform;
+		begin = end;
+	}
+
+	// the indices of a face can be relative to the vertices before it, so
+	// every chunk has to know how many there are in the ones before
+	mesh_run(chunks, n_chunks, mesh_count_vertices);
+	int64_t vertex_total = 0;
+	for (int i = 0; i < n_chunks; i++) {
+		chunks[i].vertex_first = vertex_total;
+		vertex_total += chunks[i].vertex_count;
+	}
+	if (objects->vertex_count + vertex_total > INT32_MAX) {
+		fprintf(stderr, "Parse error: too many vertices in %s\n", filename);
+		exit(-1);
+	}
+	object_vec_reserve_vertices(objects, objects->vertex_count + vertex_total);
+	const Material material =
+		material_new(color, emission_intensity, reflection);
+	const int material_index = object_vec_push_material(objects, &material);
+	for (int i = 0; i < n_chunks; i++) {
+		chunks[i].vertices = objects->vertices + objects->vertex_count;
+		chunks[i].vertex_base = objects->vertex_count;
+		chunks[i].vertex_total = vertex_total;
+		chunks[i].material = material_index;
+	}
+	mesh_run(chunks, n_chunks, mesh_parse);
+	objects->vertex_count += vertex_total;
+
+	int64_t triangles = 0;
+	for (int i = 0; i < n_chunks; i++) {
+		if (chunks[i].error != NULL) {
+			fprintf(stderr, "Parse error: %s in %s\n", chunks[i].error,
+					filename);
+			exit(-1);
+		}
+		triangles += chunks[i].face_count;
+	}
+	if (objects->size + triangles > INT32_MAX) {
+		fprintf(stderr, "Error: too many objects\n");
+		exit(-1);
+	}
+	object_vec_reserve(objects, objects->size + triangles);
+	Object* next = objects->ptr + objects->size;
+	for (int i = 0; i < n_chunks; i++) {
+		chunks[i].objects = next;
+		next += chunks[i].face_count;
+	}
+	mesh_run(chunks, n_chunks, mesh_build);
+	objects->size += triangles;
+
+	for (int i = 0; i < n_chunks; i++) free(chunks[i].faces);
+	free(chunks);
+	munmap(map, size);
+}
+
+// One phase on every chunk, the first one on this thread
+void mesh_run(MeshChunk* chunks, const int n_chunks,
+			  void* (*phase)(void* chunk)) {
+	pthread_t* threads = malloc(sizeof(pthread_t) * n_chunks);
+	if (threads == NULL) {
+		fprintf(stderr, "Error: malloc failed in mesh_file_load()\n");
+		exit(-1);
+	}
+	for (int i = 1; i < n_chunks; i++) {
+		if (pthread_create(&threads[i], NULL, phase, &chunks[i]) != 0) {
+			fprintf(stderr, "Error: can't create a thread\n");
+			exit(-1);
+		}
+	}
+	phase(&chunks[0]);
+	for (int i = 1; i < n_chunks; i++) pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+void* mesh_count_vertices(void* arg) {
+	MeshChunk* chunk = arg;
+	int count = 0;
+	for (const char* line = chunk->begin; line < chunk->end;) {
+		const char* end = memchr(line, '\n', chunk->end - line);
+		if (end == NULL) end = chunk->end;
+		count += mesh_line_is(line, end, 'v');
+		line = end + 1;
+	}
+	chunk->vertex_count = count;
+	return NULL;
+}
+
+void* mesh_parse(void* arg) {
+	MeshChunk* chunk = arg;
+	const MeshTransform* transform = chunk->transform;
+	char word[MESH_WORD];
+	int seen = 0;
+	for (const char* line = chunk->begin; line < chunk->end;) {
+		const char* end = memchr(line, '\n', chunk->end - line);
+		if (end == NULL) end = chunk->end;
+		const char* cursor = line;
+		line = end + 1;
+		if (mesh_line_is(cursor, end, 'v')) {
+			mesh_next_word(&cursor, end, word);
+			float p[3];
+			for (int i = 0; i < 3; i++) {
+				if (!mesh_next_word(&cursor, end, word) ||
+					!parse_float(word, &p[i])) {
+					chunk->error = "bad vertex";
+					return NULL;
+				}
+			}
+			const Float3 vertex = float3_new(p[0], p[1], p[2]);
+			Float3* moved = &chunk->vertices[chunk->vertex_first + seen++];
+			*moved = mat3_mul_float3(&transform->linear, &vertex);
+			float3_add_eq(moved, &transform->translation);
+		} else if (mesh_line_is(cursor, end, 'f')) {
+			mesh_next_word(&cursor, end, word);
+			int first = -1, previous = -1, n = 0;
+			while (mesh_next_word(&cursor, end, word)) {
+				const int index = mesh_face_index(chunk, word, seen);
+				if (index < 0) return NULL;
+				if (n == 0) first = index;
+				else if (n >= 2) mesh_face_push(chunk, first, previous, index);
+				previous = index;
+				n++;
+			}
+			if (n < 3) {
+				chunk->error = "face with less than 3 vertices";
+				return NULL;
+			}
+		}
+	}
+	return NULL;
+}
+
+void* mesh_build(void* arg) {
+	MeshChunk* chunk = arg;
+	for (int i = 0; i < chunk->face_count; i++) {
+		const int* face = &chunk->faces[3 * i];
+		Shape shape;
+		for (int v = 0; v < 3; v++)
+			shape.triangle.v[v] = chunk->vertex_base + face[v];
+		chunk->objects[i] = object_new(TYPE_TRIANGLE, &shape, chunk->material);
+	}
+	return NULL;
+}
+
+// Whether the line starts with `type` and a space
+int mesh_line_is(const char* line, const char* end, const char type) {
+	while (line < end && (*line == ' ' || *line == '\t')) line++;
+	return end - line >= 2 && line[0] == type &&
+		   (line[1] == ' ' || line[1] == '\t');
+}
+
+int mesh_next_word(const char** cursor, const char* end, char* word) {
+	const char* c = *cursor;
+	while (c < end && (unsigned char)*c <= ' ') c++;
+	const char* begin = c;
+	while (c < end && (unsigned char)*c > ' ') c++;
+	*cursor = c;
+	if (c == begin || c - begin >= MESH_WORD) return 0;
+	memcpy(word, begin, c - begin);
+	word[c - begin] = '\0';
+	return 1;
+}
+
+// The vertex of `v/vt/vn`, from 0. Negative indices count back from the
+// `seen`-th vertex of the chunk.
+int mesh_face_index(MeshChunk* chunk, const char* word, const int seen) {
+	char* slash = strchr(word, '/');
+	if (slash != NULL) *slash = '\0';
+	long long index;
+	if (!parse_int(word, &index) || index == 0) {
+		chunk->error = "bad face";
+		return -1;
+	}
+	index = index > 0 ? index - 1 : chunk->vertex_first + seen + index;
+	if (index < 0 || index >= chunk->vertex_total) {
+		chunk->error = "face with a vertex out of range";
+		return -1;
+	}
+	return index;
+}
+
+void mesh_face_push(MeshChunk* chunk, const int a, const int b, const int c) {
+	if (chunk->face_count >= chunk->face_capacity) {
+		chunk->face_capacity =
+			chunk->face_capacity > 0 ? 2 * chunk->face_capacity : 1024;
+		chunk->faces =
+			realloc(chunk->faces, sizeof(int) * 3 * chunk->face_capacity);
+		if (chunk->faces == NULL) {
+			fprintf(stderr, "Error: malloc failed in mesh_file_load()\n");
+			exit(-1);
+		}
+	}
+	int* face = &chunk->faces[3 * chunk->face_count++];
+	face[0] = a;
+	face[1] = b;
+	face[2] = c;
+}
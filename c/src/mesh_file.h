@@ -0,0 +1,22 @@
+#pragma once
+
+#include "algebra.h"
+#include "object.h"
+
+// Wavefront OBJ meshes: only the `v` and `f` lines are read, faces with more
+// than 3 vertices are split in a fan. Big files are parsed by n_threads
+// threads, one chunk of lines each.
+
+// vertex -> linear * vertex + translation
+typedef struct _MeshTransform {
+	Mat3 linear;
+	Float3 translation;
+} MeshTransform;
+
+// Rotations in degrees around x, then y, then z, then the scale
+MeshTransform mesh_transform_new(const Float3* position,
+								 const Float3* rotation, const float scale);
+void mesh_file_load(const char* filename, const MeshTransform* transform,
+					const Float3* color, const float reflection,
+					const float emission_intensity, int n_threads,
+					ObjectVec* objects);
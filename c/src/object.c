@@ -1,86 +1,233 @@
+#define _DEFAULT_SOURCE
 #include "object.h"
 
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "algebra.h"
+#include "rng.h"
 
-Object object_new(const int shape_type, const Shape* shape, const Float3* color,
-				  const float emission_intensity, const float reflection) {
-	static int id = 0;
+#define OBJECTVEC_HUGE_PAGE (2 << 20)
+#define OBJECTVEC_MIN_CAPACITY 64
+
+void* object_vec_grow(void* ptr, const int used, const int n,
+					  const size_t element_size);
+int object_vec_next_capacity(const int capacity);
+
+Material material_new(const Float3* color, const float emission_intensity,
+					  const float reflection) {
+	Material material;
+	material.color = *color;
+	material.light_emitted = float3_mul(color, emission_intensity);
+	material.reflection = reflection;
+	return material;
+}
+
+Object object_new(const int shape_type, const Shape* shape,
+				  const int material) {
 	Object object;
-	object.id = id++;
 	object.shape = *shape;
-	object.color = *color;
-	object.light_emitted = float3_mul(color, emission_intensity);
-	object.reflection = reflection;
+	object.material = material;
 	object.shape_type = shape_type;
-	if (shape_type == TYPE_SPHERE) {
-		object.intersect_distance = sphere_intersect_distance;
-		object.normal_normalized = sphere_normal_normalized;
-	} else if (shape_type == TYPE_PLANE) {
-		object.intersect_distance = plane_intersect_distance;
-		object.normal_normalized = plane_normal_normalized;
-	} else if (shape_type == TYPE_TRIANGLE) {
-		object.intersect_distance = triangle_intersect_distance;
-		object.normal_normalized = triangle_normal_normalized;
-	} else {
+	if (shape_type != TYPE_SPHERE && shape_type != TYPE_PLANE &&
+		shape_type != TYPE_TRIANGLE) {
 		fprintf(stderr, "Error: unknown shape type %d\n", shape_type);
 		exit(-1);
 	}
 	return object;
 }
 
-float object_intersect_distance(const Object* object, const Ray3* ray) {
-	return object->intersect_distance(&object->shape, ray);
+// The triangle with everything its intersection tests precompute
+Triangle object_triangle(const ObjectVec* objects, const Object* object) {
+	const uint32_t* v = object->shape.triangle.v;
+	return triangle_new(&objects->vertices[v[0]], &objects->vertices[v[1]],
+						&objects->vertices[v[2]]);
 }
 
-Float3 object_normal_normalized(const Object* object, const Ray3* ray) {
-	Float3 direction = object->normal_normalized(&object->shape, &ray->origin);
+float object_intersect_distance(const ObjectVec* objects, const Object* object,
+								const Ray3* ray) {
+	if (object->shape_type == TYPE_SPHERE)
+		return sphere_intersect_distance(&object->shape.sphere, ray);
+	else if (object->shape_type == TYPE_PLANE)
+		return plane_intersect_distance(&object->shape.plane, ray);
+	const Triangle triangle = object_triangle(objects, object);
+	return triangle_intersect_distance(&triangle, ray);
+}
+
+Float3 object_normal_normalized(const ObjectVec* objects, const Object* object,
+								const Ray3* ray) {
+	Float3 direction;
+	if (object->shape_type == TYPE_SPHERE) {
+		direction = sphere_normal_normalized(&object->shape.sphere, &ray->origin);
+	} else if (object->shape_type == TYPE_PLANE) {
+		direction = plane_normal_normalized(&object->shape.plane, &ray->origin);
+	} else {
+		// the same normal triangle_new() would have stored
+		const uint32_t* v = object->shape.triangle.v;
+		direction = plane_from_points(&objects->vertices[v[0]],
+									  &objects->vertices[v[1]],
+									  &objects->vertices[v[2]])
+						.normal;
+	}
 	if (float3_dot(&ray->direction, &direction) > 0.0)
 		float3_invert_eq(&direction);
 	return direction;
 }
 
+// Returns 0 for unbounded shapes (planes), which can't go in a BVH.
+int object_bounds(const ObjectVec* objects, const Object* object,
+				  Aabb* bounds) {
+	if (object->shape_type == TYPE_SPHERE) {
+		*bounds = sphere_bounds(&object->shape.sphere);
+		return 1;
+	} else if (object->shape_type == TYPE_TRIANGLE) {
+		*bounds = aabb_empty();
+		for (int i = 0; i < 3; i++)
+			aabb_grow_point(bounds,
+							&objects->vertices[object->shape.triangle.v[i]]);
+		return 1;
+	}
+	return 0;
+}
+
 ObjectVec objectvec_new(const int n) {
 	ObjectVec obj_container;
+	obj_container.ptr = NULL;
 	obj_container.size = 0;
-	obj_container.capacity = n;
-	obj_container.ptr = malloc(sizeof(Object) * n);
-	if (obj_container.ptr == NULL) {
-		fprintf(stderr, "Error: malloc failed in new_object_container()\n");
-		exit(-1);
-	}
+	obj_container.capacity = 0;
+	obj_container.vertices = NULL;
+	obj_container.vertex_count = 0;
+	obj_container.vertex_capacity = 0;
+	obj_container.materials = NULL;
+	obj_container.material_count = 0;
+	obj_container.material_capacity = 0;
+	object_vec_reserve(&obj_container, n);
 	return obj_container;
 }
 
+// Makes room for `n` objects, keeping the ones already pushed.
+void object_vec_reserve(ObjectVec* object_v, const int n) {
+	if (n <= object_v->capacity) return;
+	object_v->ptr =
+		object_vec_grow(object_v->ptr, object_v->size, n, sizeof(Object));
+	object_v->capacity = n;
+}
+
+void object_vec_reserve_vertices(ObjectVec* object_v, const int n) {
+	if (n <= object_v->vertex_capacity) return;
+	object_v->vertices = object_vec_grow(
+		object_v->vertices, object_v->vertex_count, n, sizeof(Float3));
+	object_v->vertex_capacity = n;
+}
+
 void object_vec_push(ObjectVec* object_v, const Object* object) {
-	if (object_v->size >= object_v->capacity) {
-		fprintf(stderr, "Error: object_v->size >= object_v->capacity\n");
-		exit(-1);
-	}
+	if (object_v->size >= object_v->capacity)
+		object_vec_reserve(object_v,
+						   object_vec_next_capacity(object_v->capacity));
 	memcpy(object_v->ptr + object_v->size, object, sizeof(Object));
 	object_v->size++;
 }
 
-void object_reflect_ray(const Object* object, Ray3* ray, const float distance) {
-	ray3_move_along(ray, distance);
-	const Float3 normal = object_normal_normalized(object, ray);
-	const float flip = (float)rand() / RAND_MAX;
-	if (flip < object->reflection) {
-		ray->direction = float3_mirror(&ray->direction, &normal);
+int object_vec_push_material(ObjectVec* object_v, const Material* material) {
+	const int last = object_v->material_count - 1;
+	if (last >= 0 &&
+		memcmp(&object_v->materials[last], material, sizeof(Material)) == 0)
+		return last;
+	if (object_v->material_count >= object_v->material_capacity) {
+		const int capacity =
+			object_vec_next_capacity(object_v->material_capacity);
+		object_v->materials =
+			object_vec_grow(object_v->materials, object_v->material_count,
+							capacity, sizeof(Material));
+		object_v->material_capacity = capacity;
+	}
+	object_v->materials[object_v->material_count] = *material;
+	return object_v->material_count++;
+}
+
+uint32_t object_vec_push_vertex(ObjectVec* object_v, const Float3* vertex) {
+	if (object_v->vertex_count >= object_v->vertex_capacity)
+		object_vec_reserve_vertices(
+			object_v, object_vec_next_capacity(object_v->vertex_capacity));
+	object_v->vertices[object_v->vertex_count] = *vertex;
+	return object_v->vertex_count++;
+}
+
+void object_vec_push_triangle(ObjectVec* object_v, const Float3* p1,
+							  const Float3* p2, const Float3* p3,
+							  const int material) {
+	Shape shape;
+	shape.triangle.v[0] = object_vec_push_vertex(object_v, p1);
+	shape.triangle.v[1] = object_vec_push_vertex(object_v, p2);
+	shape.triangle.v[2] = object_vec_push_vertex(object_v, p3);
+	const Object object = object_new(TYPE_TRIANGLE, &shape, material);
+	object_vec_push(object_v, &object);
+}
+
+int object_vec_next_capacity(const int capacity) {
+	if (capacity > INT_MAX / 2) {
+		fprintf(stderr, "Error: too many objects\n");
+		exit(-1);
+	}
+	return capacity > 0 ? 2 * capacity : OBJECTVEC_MIN_CAPACITY;
+}
+
+// Moves the `used` first elements of `ptr` to a buffer of `n`
+void* object_vec_grow(void* ptr, const int used, const int n,
+					  const size_t element_size) {
+	const size_t size = element_size * n;
+	void* grown = NULL;
+	if (size >= OBJECTVEC_HUGE_PAGE) {
+		// zero-filling 4 KiB pages one by one is most of the time taken to
+		// load a big mesh: ask for huge pages where the kernel has them
+		if (posix_memalign(&grown, OBJECTVEC_HUGE_PAGE, size) != 0)
+			grown = NULL;
+#ifdef MADV_HUGEPAGE
+		if (grown != NULL) madvise(grown, size, MADV_HUGEPAGE);
+#endif
+		if (grown != NULL && used > 0) memcpy(grown, ptr, element_size * used);
+		if (grown != NULL) free(ptr);
 	} else {
-		ray->direction = half_sphere_random(&normal);
+		grown = realloc(ptr, size);
+	}
+	if (grown == NULL) {
+		fprintf(stderr, "Error: malloc failed in new_object_container()\n");
+		exit(-1);
+	}
+	return grown;
+}
+
+int object_reflect_ray(const ObjectVec* objects, const Object* object,
+					   Ray3* ray, const float distance, Float3* normal,
+					   Rng* rng) {
+	ray3_move_along(ray, distance);
+	if (object->shape_type == TYPE_SPHERE)
+		ray->origin = sphere_project(&object->shape.sphere, &ray->origin);
+	*normal = object_normal_normalized(objects, object, ray);
+	// off the surface, on the side the ray leaves from
+	ray3_offset(ray, normal);
+	const float flip = rng_next_float(rng);
+	if (flip < objects->materials[object->material].reflection) {
+		ray->direction = float3_mirror(&ray->direction, normal);
+		return 0;
 	}
+#if DIFFUSE_SAMPLING == DIFFUSE_COSINE
+	ray->direction = half_sphere_cosine(normal, rng);
+#else
+	ray->direction = half_sphere_random(normal, rng);
+#endif
+	return 1;
 }
 
 #define PI 3.14159265358979323846
 
-Float3 half_sphere_random(const Float3* normal) {
-	const float phi = 2 * PI * (float)rand() / RAND_MAX;
-	const float theta = PI * (float)rand() / RAND_MAX;
+Float3 half_sphere_random(const Float3* normal, Rng* rng) {
+	const float phi = 2 * PI * rng_next_float(rng);
+	const float theta = PI * rng_next_float(rng);
 	const float sin_theta = sinf(theta);
 	Float3 retval =
 		float3_new(sin_theta * cosf(phi), sin_theta * sinf(phi), cosf(theta));
@@ -90,6 +237,18 @@ Float3 half_sphere_random(const Float3* normal) {
 	return retval;
 }
 
+// Malley's method: a uniform point of the unit disk, lifted to the half
+// sphere, has a density of cos(theta) / PI.
+Float3 half_sphere_cosine(const Float3* normal, Rng* rng) {
+	const float r2 = rng_next_float(rng);
+	const float phi = 2 * PI * rng_next_float(rng);
+	const float r = sqrtf(r2);
+	return float3_from_frame(normal, r * cosf(phi), r * sinf(phi),
+							 sqrtf(1 - r2));
+}
+
 void object_vec_free(ObjectVec* object_v) {
 	free(object_v->ptr);
+	free(object_v->vertices);
+	free(object_v->materials);
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+
+#include "aabb.h"
 #include "algebra.h"
 #include "plane.h"
 #include "ray.h"
+#include "rng.h"
 #include "sphere.h"
 #include "triangle.h"
 
@@ -10,33 +14,77 @@
 #define TYPE_PLANE 2
 #define TYPE_TRIANGLE 3
 
+// Direction of a diffuse bounce, picked at build time with `make DIFFUSE=...`:
+// - angles: uniform theta and phi, flipped to the side of the normal (bunched
+//   up at the pole, and not weighted by the cosine)
+// - cosine: cosine weighted, so the albedo is all a diffuse bounce weighs
+#define DIFFUSE_ANGLES 1
+#define DIFFUSE_COSINE 2
+#ifndef DIFFUSE_SAMPLING
+#define DIFFUSE_SAMPLING DIFFUSE_COSINE
+#endif
+
+// Shared by the objects that look the same, the ones of a mesh for example
+typedef struct _Material {
+	Float3 color, light_emitted;
+	float reflection;
+} Material;
+
+// The vertices of a triangle, in the vertex buffer of its ObjectVec
+typedef struct _MeshTriangle {
+	uint32_t v[3];
+} MeshTriangle;
+
 typedef union _Shape {
 	Sphere sphere;
 	Plane plane;
-	Triangle triangle;
+	MeshTriangle triangle;
 } Shape;
 
+// 24 bytes: the material and the vertices are indices in the ObjectVec
 typedef struct _Object {
-	int shape_type, id;
+	int shape_type, material;
 	Shape shape;
-	Float3 color, light_emitted;
-	float reflection;
-	float (*intersect_distance)(const void* obj, const Ray3* ray);
-	Float3 (*normal_normalized)(const void* obj, const Float3* point);
 } Object;
 
-Object object_new(const int shape_id, const Shape* shape, const Float3* color,
-				  const float emission_intensity, const float reflection);
-float object_intersect_distance(const Object* object, const Ray3* ray);
-Float3 object_normal_normalized(const Object* object, const Ray3* ray);
-void object_reflect_ray(const Object* object, Ray3* ray, const float distance);
-Float3 half_sphere_random(const Float3*);
-
 typedef struct _ObjectContainer {
 	Object* ptr;
 	int size, capacity;
+	Float3* vertices;
+	int vertex_count, vertex_capacity;
+	Material* materials;
+	int material_count, material_capacity;
 } ObjectVec;
 
+Material material_new(const Float3* color, const float emission_intensity,
+					  const float reflection);
+Object object_new(const int shape_type, const Shape* shape,
+				  const int material);
+Triangle object_triangle(const ObjectVec* objects, const Object* object);
+float object_intersect_distance(const ObjectVec* objects, const Object* object,
+								const Ray3* ray);
+Float3 object_normal_normalized(const ObjectVec* objects, const Object* object,
+								const Ray3* ray);
+int object_bounds(const ObjectVec* objects, const Object* object,
+				  Aabb* bounds);
+// Moves `ray` to its hit with `object` and bounces it. Returns 1 if the
+// bounce is diffuse, `normal` being then the side of the surface it leaves.
+int object_reflect_ray(const ObjectVec* objects, const Object* object,
+					   Ray3* ray, const float distance, Float3* normal,
+					   Rng* rng);
+Float3 half_sphere_random(const Float3* normal, Rng* rng);
+Float3 half_sphere_cosine(const Float3* normal, Rng* rng);
+
+// Starts with room for `n` objects, every buffer doubles when it is full
 ObjectVec objectvec_new(const int n);
+void object_vec_reserve(ObjectVec* object_v, const int n);
+void object_vec_reserve_vertices(ObjectVec* object_v, const int n);
 void object_vec_push(ObjectVec* object_v, const Object* object);
+// Returns the index of the material, the last one again if it is the same
+int object_vec_push_material(ObjectVec* object_v, const Material* material);
+uint32_t object_vec_push_vertex(ObjectVec* object_v, const Float3* vertex);
+// A triangle with three vertices of its own
+void object_vec_push_triangle(ObjectVec* object_v, const Float3* p1,
+							  const Float3* p2, const Float3* p3,
+							  const int material);
 void object_vec_free(ObjectVec* object_v);
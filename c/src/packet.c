@@ -0,0 +1,262 @@
+#include "packet.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include "algebra.h"
+#include "bvh.h"
+#include "object.h"
+#include "soa.h"
+#include "triangle.h"
+
+// Every lane does the same math, in the same order, as the scalar kernels in
+// soa.c, so a packet finds what its rays would find one by one with them.
+
+// Returns 0 if the rays can't be traced as a packet: in the watertight build
+// all of them must shear along the same axes.
+int ray_packet_prepare(RayPacket* packet) {
+	for (int l = 0; l < PACKET_SIZE; l++) {
+		packet->inv_dx[l] = 1.0f / packet->dx[l];
+		packet->inv_dy[l] = 1.0f / packet->dy[l];
+		packet->inv_dz[l] = 1.0f / packet->dz[l];
+		packet->a[l] = packet->dx[l] * packet->dx[l] +
+					   packet->dy[l] * packet->dy[l] +
+					   packet->dz[l] * packet->dz[l];
+		packet->inv_2a[l] = 0.5f / packet->a[l];
+	}
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+	for (int l = 0; l < PACKET_SIZE; l++) {
+		const Ray3 ray = ray_packet_ray(packet, l);
+		const RayShear shear = ray_shear_new(&ray);
+		if (l == 0) {
+			packet->kx = shear.kx;
+			packet->ky = shear.ky;
+			packet->kz = shear.kz;
+		} else if (shear.kx != packet->kx || shear.ky != packet->ky ||
+				   shear.kz != packet->kz) {
+			return 0;
+		}
+		packet->sx[l] = shear.sx;
+		packet->sy[l] = shear.sy;
+		packet->sz[l] = shear.sz;
+	}
+#endif
+	return 1;
+}
+
+Ray3 ray_packet_ray(const RayPacket* packet, const int lane) {
+	const Float3 direction =
+		float3_new(packet->dx[lane], packet->dy[lane], packet->dz[lane]);
+	return ray3_new(&packet->origin, &direction);
+}
+
+// Same rule as soa_hit_update()
+void packet_hit_update(PacketHit* hit, const int lane, const float distance,
+					   const int object) {
+	if (distance > 0 &&
+		(distance < hit->distance[lane] ||
+		 (distance == hit->distance[lane] && object < hit->object[lane]))) {
+		hit->distance[lane] = distance;
+		hit->object[lane] = object;
+	}
+}
+
+// The SIMD kernels need PACKET_SIZE to be a multiple of their width.
+PacketKernels packet_kernels(const int type) {
+	PacketKernels kernels;
+	kernels.aabb = packet_aabb_scalar;
+	kernels.spheres = packet_spheres_scalar;
+	kernels.triangles = packet_triangles_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	if (type == KERNELS_AVX2 && PACKET_SIZE % 8 == 0) {
+		kernels.aabb = packet_aabb_avx2;
+		kernels.spheres = packet_spheres_avx2;
+		kernels.triangles = packet_triangles_avx2;
+	} else if (type >= KERNELS_SSE && PACKET_SIZE % 4 == 0) {
+		kernels.aabb = packet_aabb_sse;
+		kernels.spheres = packet_spheres_sse;
+		kernels.triangles = packet_triangles_sse;
+	}
+#else
+	(void)type;
+#endif
+	return kernels;
+}
+
+// bvh_nearest_object() for the whole packet: a node is entered if any lane
+// hits it, leaves are tested against every lane.
+void bvh_nearest_packet(const Bvh* bvh, const RayPacket* packet,
+						PacketHit* hit) {
+	const PacketKernels kernels = packet_kernels(bvh->kernels.type);
+	const Object* objects = bvh->objects->ptr;
+	uint64_t intersections = bvh->plane_count;
+	bvh_stats.rays += PACKET_SIZE;
+	for (int l = 0; l < PACKET_SIZE; l++) {
+		hit->distance[l] = INFINITY;
+		hit->object[l] = -1;
+	}
+	for (int i = 0; i < bvh->plane_count; i++) {
+		const Plane* plane = &objects[bvh->planes[i]].shape.plane;
+		const float b = float3_dot(&plane->normal, &packet->origin) + plane->d;
+		for (int l = 0; l < PACKET_SIZE; l++) {
+			const float a = plane->normal.x * packet->dx[l] +
+							plane->normal.y * packet->dy[l] +
+							plane->normal.z * packet->dz[l];
+			if (fabsf(a) < 1e-6) continue;
+			packet_hit_update(hit, l, -b / a, bvh->planes[i]);
+		}
+	}
+	if (bvh->node_count == 0) {
+		bvh_stats.intersections += intersections * PACKET_SIZE;
+		return;
+	}
+
+	int stack[BVH_MAX_DEPTH];
+	float stack_distance[BVH_MAX_DEPTH];
+	int stack_size = 0;
+	if (kernels.aabb(&bvh->nodes[0].bounds, packet, hit) < INFINITY) {
+		stack[stack_size] = 0;
+		stack_distance[stack_size++] = 0;
+	}
+	while (stack_size > 0) {
+		stack_size--;
+		float farthest_hit = 0;
+		for (int l = 0; l < PACKET_SIZE; l++)
+			farthest_hit = fmaxf(farthest_hit, hit->distance[l]);
+		if (stack_distance[stack_size] > farthest_hit) continue;
+		const BvhNode* node = &bvh->nodes[stack[stack_size]];
+		while (node->count == 0) {
+			int near = node->first, far = node->first + 1;
+			float near_distance =
+				kernels.aabb(&bvh->nodes[near].bounds, packet, hit);
+			float far_distance =
+				kernels.aabb(&bvh->nodes[far].bounds, packet, hit);
+			if (far_distance < near_distance) {
+				const int tmp = near;
+				near = far;
+				far = tmp;
+				const float tmp_distance = near_distance;
+				near_distance = far_distance;
+				far_distance = tmp_distance;
+			}
+			if (near_distance == INFINITY) break;
+			if (far_distance < INFINITY) {
+				stack[stack_size] = far;
+				stack_distance[stack_size++] = far_distance;
+			}
+			node = &bvh->nodes[near];
+		}
+		if (node->count == 0) continue;
+		const BvhLeaf* leaf = &bvh->leaves[node->first];
+		intersections += node->count;
+		if (leaf->sphere_count > 0)
+			kernels.spheres(&bvh->spheres, leaf->sphere_first,
+							leaf->sphere_count, packet, hit);
+		if (leaf->triangle_count > 0)
+			kernels.triangles(&bvh->triangles, leaf->triangle_first,
+							  leaf->triangle_count, packet, hit);
+	}
+	bvh_stats.intersections += intersections * PACKET_SIZE;
+}
+
+float packet_aabb_scalar(const Aabb* aabb, const RayPacket* packet,
+						 const PacketHit* hit) {
+	float nearest = INFINITY;
+	for (int l = 0; l < PACKET_SIZE; l++) {
+		const Float3 inv_direction = float3_new(
+			packet->inv_dx[l], packet->inv_dy[l], packet->inv_dz[l]);
+		nearest = fminf(nearest,
+						aabb_intersect_distance(aabb, &packet->origin,
+												&inv_direction,
+												hit->distance[l]));
+	}
+	return nearest;
+}
+
+void packet_spheres_scalar(const SphereSoa* soa, const int first,
+						   const int count, const RayPacket* packet,
+						   PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	for (int i = first; i < first + count; i++) {
+		const float px = o->x - soa->center_x[i];
+		const float py = o->y - soa->center_y[i];
+		const float pz = o->z - soa->center_z[i];
+		const float c = px * px + py * py + pz * pz - soa->radius2[i];
+		for (int l = 0; l < PACKET_SIZE; l++) {
+			const float b =
+				2 * (px * packet->dx[l] + py * packet->dy[l] + pz * packet->dz[l]);
+			const float discriminant = b * b - 4 * packet->a[l] * c;
+			if (discriminant < 0) continue;
+			const float sqrt_discriminant = sqrtf(discriminant);
+			const float near = (-b - sqrt_discriminant) * packet->inv_2a[l];
+			const float distance =
+				near > 0 ? near : (-b + sqrt_discriminant) * packet->inv_2a[l];
+			packet_hit_update(hit, l, distance, soa->object[i]);
+		}
+	}
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+void packet_triangles_scalar(const TriangleSoa* soa, const int first,
+							 const int count, const RayPacket* packet,
+							 PacketHit* hit) {
+	for (int i = first; i < first + count; i++)
+		for (int l = 0; l < PACKET_SIZE; l++)
+			packet_triangle_exact(soa, i, packet, l, hit);
+}
+
+// One lane against one triangle with triangle_intersect_watertight(): the
+// SIMD kernels fall back to it where an edge function is exactly 0.
+void packet_triangle_exact(const TriangleSoa* soa, const int i,
+						   const RayPacket* packet, const int lane,
+						   PacketHit* hit) {
+	const Float3 p1 = float3_new(soa->v0_x[i], soa->v0_y[i], soa->v0_z[i]);
+	const Float3 p2 = float3_new(soa->v1_x[i], soa->v1_y[i], soa->v1_z[i]);
+	const Float3 p3 = float3_new(soa->v2_x[i], soa->v2_y[i], soa->v2_z[i]);
+	const Ray3 ray = ray_packet_ray(packet, lane);
+	RayShear shear;
+	shear.kx = packet->kx;
+	shear.ky = packet->ky;
+	shear.kz = packet->kz;
+	shear.sx = packet->sx[lane];
+	shear.sy = packet->sy[lane];
+	shear.sz = packet->sz[lane];
+	TriangleHit triangle_hit;
+	if (triangle_intersect_watertight(&p1, &p2, &p3, &ray, &shear,
+									  &triangle_hit))
+		packet_hit_update(hit, lane, triangle_hit.distance, soa->object[i]);
+}
+#else
+// Möller–Trumbore: with a shared origin t and q only depend on the triangle.
+void packet_triangles_scalar(const TriangleSoa* soa, const int first,
+							 const int count, const RayPacket* packet,
+							 PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	for (int i = first; i < first + count; i++) {
+		const float e1x = soa->e1_x[i], e1y = soa->e1_y[i], e1z = soa->e1_z[i];
+		const float e2x = soa->e2_x[i], e2y = soa->e2_y[i], e2z = soa->e2_z[i];
+		const float tx = o->x - soa->v0_x[i];
+		const float ty = o->y - soa->v0_y[i];
+		const float tz = o->z - soa->v0_z[i];
+		const float qx = ty * e1z - tz * e1y;
+		const float qy = tz * e1x - tx * e1z;
+		const float qz = tx * e1y - ty * e1x;
+		const float e2_q = e2x * qx + e2y * qy + e2z * qz;
+		for (int l = 0; l < PACKET_SIZE; l++) {
+			const float dx = packet->dx[l], dy = packet->dy[l];
+			const float dz = packet->dz[l];
+			const float px = dy * e2z - dz * e2y;
+			const float py = dz * e2x - dx * e2z;
+			const float pz = dx * e2y - dy * e2x;
+			const float det = e1x * px + e1y * py + e1z * pz;
+			if (fabsf(det) < TRIANGLE_DET_EPSILON) continue;
+			const float inv_det = 1.0f / det;
+			const float u = (tx * px + ty * py + tz * pz) * inv_det;
+			if (u < 0 || u > 1) continue;
+			const float v = (dx * qx + dy * qy + dz * qz) * inv_det;
+			if (v < 0 || u + v > 1) continue;
+			packet_hit_update(hit, l, e2_q * inv_det, soa->object[i]);
+		}
+	}
+}
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "algebra.h"
+#include "bvh.h"
+#include "ray.h"
+#include "soa.h"
+#include "triangle.h"
+
+// Primary rays traced together through the BVH, one per lane. Picked at build
+// time with `make PACKET=...` (4, 8 or 16; 1 traces every ray alone).
+#ifndef PACKET_SIZE
+#define PACKET_SIZE 8
+#endif
+
+// Rays sharing their origin: fill `origin` and the directions, then call
+// ray_packet_prepare().
+typedef struct _RayPacket {
+	Float3 origin;
+	float dx[PACKET_SIZE] __attribute__((aligned(64)));
+	float dy[PACKET_SIZE] __attribute__((aligned(64)));
+	float dz[PACKET_SIZE] __attribute__((aligned(64)));
+	float inv_dx[PACKET_SIZE] __attribute__((aligned(64)));
+	float inv_dy[PACKET_SIZE] __attribute__((aligned(64)));
+	float inv_dz[PACKET_SIZE] __attribute__((aligned(64)));
+	// |direction|^2 and 0.5 / |direction|^2, for the spheres
+	float a[PACKET_SIZE] __attribute__((aligned(64)));
+	float inv_2a[PACKET_SIZE] __attribute__((aligned(64)));
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+	// the axes of the shear are shared by the whole packet
+	int kx, ky, kz;
+	float sx[PACKET_SIZE] __attribute__((aligned(64)));
+	float sy[PACKET_SIZE] __attribute__((aligned(64)));
+	float sz[PACKET_SIZE] __attribute__((aligned(64)));
+#endif
+} RayPacket;
+
+// `object` is an index in the ObjectVec, -1 where nothing has been hit.
+typedef struct _PacketHit {
+	float distance[PACKET_SIZE] __attribute__((aligned(64)));
+	int object[PACKET_SIZE] __attribute__((aligned(64)));
+} PacketHit;
+
+// Test a box, or the leaf range [first, first + count) of a SoA, against every
+// lane. A box returns the nearest distance at which a lane enters it before
+// its own hit, INFINITY if none does.
+typedef float (*PacketAabbKernel)(const Aabb* aabb, const RayPacket* packet,
+								  const PacketHit* hit);
+typedef void (*PacketSphereKernel)(const SphereSoa* soa, const int first,
+								   const int count, const RayPacket* packet,
+								   PacketHit* hit);
+typedef void (*PacketTriangleKernel)(const TriangleSoa* soa, const int first,
+									 const int count, const RayPacket* packet,
+									 PacketHit* hit);
+
+typedef struct _PacketKernels {
+	PacketAabbKernel aabb;
+	PacketSphereKernel spheres;
+	PacketTriangleKernel triangles;
+} PacketKernels;
+
+int ray_packet_prepare(RayPacket* packet);
+Ray3 ray_packet_ray(const RayPacket* packet, const int lane);
+void packet_hit_update(PacketHit* hit, const int lane, const float distance,
+					   const int object);
+void bvh_nearest_packet(const Bvh* bvh, const RayPacket* packet,
+						PacketHit* hit);
+PacketKernels packet_kernels(const int type);
+
+float packet_aabb_scalar(const Aabb* aabb, const RayPacket* packet,
+						 const PacketHit* hit);
+void packet_spheres_scalar(const SphereSoa* soa, const int first,
+						   const int count, const RayPacket* packet,
+						   PacketHit* hit);
+void packet_triangles_scalar(const TriangleSoa* soa, const int first,
+							 const int count, const RayPacket* packet,
+							 PacketHit* hit);
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+void packet_triangle_exact(const TriangleSoa* soa, const int i,
+						   const RayPacket* packet, const int lane,
+						   PacketHit* hit);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+float packet_aabb_sse(const Aabb* aabb, const RayPacket* packet,
+					  const PacketHit* hit);
+void packet_spheres_sse(const SphereSoa* soa, const int first,
+						const int count, const RayPacket* packet,
+						PacketHit* hit);
+void packet_triangles_sse(const TriangleSoa* soa, const int first,
+						  const int count, const RayPacket* packet,
+						  PacketHit* hit);
+float packet_aabb_avx2(const Aabb* aabb, const RayPacket* packet,
+					   const PacketHit* hit);
+void packet_spheres_avx2(const SphereSoa* soa, const int first,
+						 const int count, const RayPacket* packet,
+						 PacketHit* hit);
+void packet_triangles_avx2(const TriangleSoa* soa, const int first,
+						   const int count, const RayPacket* packet,
+						   PacketHit* hit);
+#endif
@@ -0,0 +1,517 @@
+#include "packet.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <math.h>
+
+// Same math as the scalar packet kernels in packet.c, 4 (SSE) or 8 (AVX2)
+// lanes at a time. The nearest hit of each lane stays in registers while a
+// leaf is walked. No fma, so the lanes round as the scalar kernels do.
+
+__attribute__((target("sse2"))) void packet_update_sse(
+	const __m128 distance, const __m128 valid, const __m128i object,
+	__m128* best, __m128i* best_object) {
+	const __m128 tie = _mm_and_ps(
+		_mm_cmpeq_ps(distance, *best),
+		_mm_castsi128_ps(_mm_cmplt_epi32(object, *best_object)));
+	const __m128 closer = _mm_and_ps(
+		_mm_and_ps(valid, _mm_cmpgt_ps(distance, _mm_setzero_ps())),
+		_mm_or_ps(_mm_cmplt_ps(distance, *best), tie));
+	*best = _mm_or_ps(_mm_and_ps(closer, distance), _mm_andnot_ps(closer, *best));
+	*best_object = _mm_castps_si128(
+		_mm_or_ps(_mm_and_ps(closer, _mm_castsi128_ps(object)),
+				  _mm_andnot_ps(closer, _mm_castsi128_ps(*best_object))));
+}
+
+__attribute__((target("sse2"))) float packet_aabb_sse(const Aabb* aabb,
+													  const RayPacket* packet,
+													  const PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	const __m128 min_x = _mm_set1_ps(aabb->min.x - o->x);
+	const __m128 min_y = _mm_set1_ps(aabb->min.y - o->y);
+	const __m128 min_z = _mm_set1_ps(aabb->min.z - o->z);
+	const __m128 max_x = _mm_set1_ps(aabb->max.x - o->x);
+	const __m128 max_y = _mm_set1_ps(aabb->max.y - o->y);
+	const __m128 max_z = _mm_set1_ps(aabb->max.z - o->z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 infinity = _mm_set1_ps(INFINITY);
+	__m128 nearest = infinity;
+	for (int c = 0; c + 4 <= PACKET_SIZE; c += 4) {
+		const __m128 inv_dx = _mm_load_ps(packet->inv_dx + c);
+		const __m128 inv_dy = _mm_load_ps(packet->inv_dy + c);
+		const __m128 inv_dz = _mm_load_ps(packet->inv_dz + c);
+		const __m128 tx1 = _mm_mul_ps(min_x, inv_dx);
+		const __m128 tx2 = _mm_mul_ps(max_x, inv_dx);
+		__m128 t_min = _mm_min_ps(tx1, tx2), t_max = _mm_max_ps(tx1, tx2);
+		const __m128 ty1 = _mm_mul_ps(min_y, inv_dy);
+		const __m128 ty2 = _mm_mul_ps(max_y, inv_dy);
+		t_min = _mm_max_ps(t_min, _mm_min_ps(ty1, ty2));
+		t_max = _mm_min_ps(t_max, _mm_max_ps(ty1, ty2));
+		const __m128 tz1 = _mm_mul_ps(min_z, inv_dz);
+		const __m128 tz2 = _mm_mul_ps(max_z, inv_dz);
+		t_min = _mm_max_ps(t_min, _mm_min_ps(tz1, tz2));
+		t_max = _mm_min_ps(t_max, _mm_max_ps(tz1, tz2));
+		const __m128 miss = _mm_or_ps(
+			_mm_or_ps(_mm_cmplt_ps(t_max, t_min), _mm_cmple_ps(t_max, zero)),
+			_mm_cmpgt_ps(t_min, _mm_load_ps(hit->distance + c)));
+		nearest = _mm_min_ps(nearest, _mm_or_ps(_mm_and_ps(miss, infinity),
+												_mm_andnot_ps(miss, t_min)));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, nearest);
+	return fminf(fminf(lanes[0], lanes[1]), fminf(lanes[2], lanes[3]));
+}
+
+__attribute__((target("sse2"))) void packet_spheres_sse(
+	const SphereSoa* soa, const int first, const int count,
+	const RayPacket* packet, PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 four = _mm_set1_ps(4.0f);
+	for (int c = 0; c + 4 <= PACKET_SIZE; c += 4) {
+		const __m128 dx = _mm_load_ps(packet->dx + c);
+		const __m128 dy = _mm_load_ps(packet->dy + c);
+		const __m128 dz = _mm_load_ps(packet->dz + c);
+		const __m128 four_a = _mm_mul_ps(four, _mm_load_ps(packet->a + c));
+		const __m128 inv_2a = _mm_load_ps(packet->inv_2a + c);
+		__m128 best = _mm_load_ps(hit->distance + c);
+		__m128i best_object = _mm_load_si128((const __m128i*)(hit->object + c));
+		for (int i = first; i < first + count; i++) {
+			const float px = o->x - soa->center_x[i];
+			const float py = o->y - soa->center_y[i];
+			const float pz = o->z - soa->center_z[i];
+			const __m128 sphere_c =
+				_mm_set1_ps(px * px + py * py + pz * pz - soa->radius2[i]);
+			const __m128 b = _mm_mul_ps(
+				two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(px), dx),
+										   _mm_mul_ps(_mm_set1_ps(py), dy)),
+								_mm_mul_ps(_mm_set1_ps(pz), dz)));
+			const __m128 discriminant =
+				_mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(four_a, sphere_c));
+			const __m128 valid = _mm_cmpge_ps(discriminant, zero);
+			if (_mm_movemask_ps(valid) == 0) continue;
+			const __m128 sqrt_discriminant =
+				_mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+			const __m128 minus_b = _mm_sub_ps(zero, b);
+			const __m128 near =
+				_mm_mul_ps(_mm_sub_ps(minus_b, sqrt_discriminant), inv_2a);
+			const __m128 far =
+				_mm_mul_ps(_mm_add_ps(minus_b, sqrt_discriminant), inv_2a);
+			const __m128 use_near = _mm_cmpgt_ps(near, zero);
+			const __m128 distance = _mm_or_ps(_mm_and_ps(use_near, near),
+											  _mm_andnot_ps(use_near, far));
+			packet_update_sse(distance, valid, _mm_set1_epi32(soa->object[i]),
+							  &best, &best_object);
+		}
+		_mm_store_ps(hit->distance + c, best);
+		_mm_store_si128((__m128i*)(hit->object + c), best_object);
+	}
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+__attribute__((target("sse2"))) void packet_triangles_sse(
+	const TriangleSoa* soa, const int first, const int count,
+	const RayPacket* packet, PacketHit* hit) {
+	const float* v0[3] = {soa->v0_x, soa->v0_y, soa->v0_z};
+	const float* v1[3] = {soa->v1_x, soa->v1_y, soa->v1_z};
+	const float* v2[3] = {soa->v2_x, soa->v2_y, soa->v2_z};
+	const int kx = packet->kx, ky = packet->ky, kz = packet->kz;
+	const float ox = float3_axis(&packet->origin, kx);
+	const float oy = float3_axis(&packet->origin, ky);
+	const float oz = float3_axis(&packet->origin, kz);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (int c = 0; c + 4 <= PACKET_SIZE; c += 4) {
+		const __m128 sx = _mm_load_ps(packet->sx + c);
+		const __m128 sy = _mm_load_ps(packet->sy + c);
+		const __m128 sz = _mm_load_ps(packet->sz + c);
+		__m128 best = _mm_load_ps(hit->distance + c);
+		__m128i best_object = _mm_load_si128((const __m128i*)(hit->object + c));
+		for (int i = first; i < first + count; i++) {
+			const __m128 az = _mm_set1_ps(v0[kz][i] - oz);
+			const __m128 bz = _mm_set1_ps(v1[kz][i] - oz);
+			const __m128 cz = _mm_set1_ps(v2[kz][i] - oz);
+			const __m128 ax =
+				_mm_sub_ps(_mm_set1_ps(v0[kx][i] - ox), _mm_mul_ps(sx, az));
+			const __m128 ay =
+				_mm_sub_ps(_mm_set1_ps(v0[ky][i] - oy), _mm_mul_ps(sy, az));
+			const __m128 bx =
+				_mm_sub_ps(_mm_set1_ps(v1[kx][i] - ox), _mm_mul_ps(sx, bz));
+			const __m128 by =
+				_mm_sub_ps(_mm_set1_ps(v1[ky][i] - oy), _mm_mul_ps(sy, bz));
+			const __m128 cx =
+				_mm_sub_ps(_mm_set1_ps(v2[kx][i] - ox), _mm_mul_ps(sx, cz));
+			const __m128 cy =
+				_mm_sub_ps(_mm_set1_ps(v2[ky][i] - oy), _mm_mul_ps(sy, cz));
+			const __m128 w1 = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+			const __m128 w2 = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+			const __m128 w3 = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+			const __m128 any_negative = _mm_or_ps(
+				_mm_or_ps(_mm_cmplt_ps(w1, zero), _mm_cmplt_ps(w2, zero)),
+				_mm_cmplt_ps(w3, zero));
+			const __m128 any_positive = _mm_or_ps(
+				_mm_or_ps(_mm_cmpgt_ps(w1, zero), _mm_cmpgt_ps(w2, zero)),
+				_mm_cmpgt_ps(w3, zero));
+			const __m128 any_zero = _mm_or_ps(
+				_mm_or_ps(_mm_cmpeq_ps(w1, zero), _mm_cmpeq_ps(w2, zero)),
+				_mm_cmpeq_ps(w3, zero));
+			const __m128 outside = _mm_and_ps(any_negative, any_positive);
+			if (_mm_movemask_ps(_mm_andnot_ps(any_zero, outside)) == 0xf)
+				continue;
+			const __m128 det = _mm_add_ps(_mm_add_ps(w1, w2), w3);
+			const __m128 distance = _mm_mul_ps(
+				_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w1, az),
+												 _mm_mul_ps(w2, bz)),
+									  _mm_mul_ps(w3, cz)),
+						   sz),
+				_mm_div_ps(one, det));
+			const __m128 valid =
+				_mm_andnot_ps(_mm_or_ps(outside, any_zero),
+							  _mm_cmpneq_ps(det, zero));
+			packet_update_sse(distance, valid, _mm_set1_epi32(soa->object[i]),
+							  &best, &best_object);
+			int exact = _mm_movemask_ps(any_zero);
+			if (exact == 0) continue;
+			_mm_store_ps(hit->distance + c, best);
+			_mm_store_si128((__m128i*)(hit->object + c), best_object);
+			for (; exact != 0; exact &= exact - 1)
+				packet_triangle_exact(soa, i, packet, c + __builtin_ctz(exact),
+									  hit);
+			best = _mm_load_ps(hit->distance + c);
+			best_object = _mm_load_si128((const __m128i*)(hit->object + c));
+		}
+		_mm_store_ps(hit->distance + c, best);
+		_mm_store_si128((__m128i*)(hit->object + c), best_object);
+	}
+}
+#else
+__attribute__((target("sse2"))) void packet_triangles_sse(
+	const TriangleSoa* soa, const int first, const int count,
+	const RayPacket* packet, PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 epsilon = _mm_set1_ps(TRIANGLE_DET_EPSILON);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	for (int c = 0; c + 4 <= PACKET_SIZE; c += 4) {
+		const __m128 dx = _mm_load_ps(packet->dx + c);
+		const __m128 dy = _mm_load_ps(packet->dy + c);
+		const __m128 dz = _mm_load_ps(packet->dz + c);
+		__m128 best = _mm_load_ps(hit->distance + c);
+		__m128i best_object = _mm_load_si128((const __m128i*)(hit->object + c));
+		for (int i = first; i < first + count; i++) {
+			const float e1x = soa->e1_x[i], e1y = soa->e1_y[i];
+			const float e1z = soa->e1_z[i];
+			const float tx = o->x - soa->v0_x[i];
+			const float ty = o->y - soa->v0_y[i];
+			const float tz = o->z - soa->v0_z[i];
+			const float qx = ty * e1z - tz * e1y;
+			const float qy = tz * e1x - tx * e1z;
+			const float qz = tx * e1y - ty * e1x;
+			const __m128 e2x = _mm_set1_ps(soa->e2_x[i]);
+			const __m128 e2y = _mm_set1_ps(soa->e2_y[i]);
+			const __m128 e2z = _mm_set1_ps(soa->e2_z[i]);
+			const __m128 e2_q = _mm_set1_ps(soa->e2_x[i] * qx +
+											soa->e2_y[i] * qy +
+											soa->e2_z[i] * qz);
+			const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			const __m128 det = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1x), px),
+						   _mm_mul_ps(_mm_set1_ps(e1y), py)),
+				_mm_mul_ps(_mm_set1_ps(e1z), pz));
+			const __m128 inv_det = _mm_div_ps(one, det);
+			const __m128 u = _mm_mul_ps(
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tx), px),
+									  _mm_mul_ps(_mm_set1_ps(ty), py)),
+						   _mm_mul_ps(_mm_set1_ps(tz), pz)),
+				inv_det);
+			const __m128 v = _mm_mul_ps(
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(qx)),
+									  _mm_mul_ps(dy, _mm_set1_ps(qy))),
+						   _mm_mul_ps(dz, _mm_set1_ps(qz))),
+				inv_det);
+			__m128 valid = _mm_cmpge_ps(_mm_andnot_ps(sign, det), epsilon);
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+			valid = _mm_and_ps(valid, _mm_cmple_ps(u, one));
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+			valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			if (_mm_movemask_ps(valid) == 0) continue;
+			packet_update_sse(_mm_mul_ps(e2_q, inv_det), valid,
+							  _mm_set1_epi32(soa->object[i]), &best,
+							  &best_object);
+		}
+		_mm_store_ps(hit->distance + c, best);
+		_mm_store_si128((__m128i*)(hit->object + c), best_object);
+	}
+}
+#endif
+
+__attribute__((target("avx2"))) void packet_update_avx2(
+	const __m256 distance, const __m256 valid, const __m256i object,
+	__m256* best, __m256i* best_object) {
+	const __m256 tie = _mm256_and_ps(
+		_mm256_cmp_ps(distance, *best, _CMP_EQ_OQ),
+		_mm256_castsi256_ps(_mm256_cmpgt_epi32(*best_object, object)));
+	const __m256 closer = _mm256_and_ps(
+		_mm256_and_ps(valid,
+					  _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GT_OQ)),
+		_mm256_or_ps(_mm256_cmp_ps(distance, *best, _CMP_LT_OQ), tie));
+	*best = _mm256_blendv_ps(*best, distance, closer);
+	*best_object = _mm256_castps_si256(
+		_mm256_blendv_ps(_mm256_castsi256_ps(*best_object),
+						 _mm256_castsi256_ps(object), closer));
+}
+
+__attribute__((target("avx2"))) float packet_aabb_avx2(const Aabb* aabb,
+													   const RayPacket* packet,
+													   const PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	const __m256 min_x = _mm256_set1_ps(aabb->min.x - o->x);
+	const __m256 min_y = _mm256_set1_ps(aabb->min.y - o->y);
+	const __m256 min_z = _mm256_set1_ps(aabb->min.z - o->z);
+	const __m256 max_x = _mm256_set1_ps(aabb->max.x - o->x);
+	const __m256 max_y = _mm256_set1_ps(aabb->max.y - o->y);
+	const __m256 max_z = _mm256_set1_ps(aabb->max.z - o->z);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 infinity = _mm256_set1_ps(INFINITY);
+	__m256 nearest = infinity;
+	for (int c = 0; c + 8 <= PACKET_SIZE; c += 8) {
+		const __m256 inv_dx = _mm256_load_ps(packet->inv_dx + c);
+		const __m256 inv_dy = _mm256_load_ps(packet->inv_dy + c);
+		const __m256 inv_dz = _mm256_load_ps(packet->inv_dz + c);
+		const __m256 tx1 = _mm256_mul_ps(min_x, inv_dx);
+		const __m256 tx2 = _mm256_mul_ps(max_x, inv_dx);
+		__m256 t_min = _mm256_min_ps(tx1, tx2);
+		__m256 t_max = _mm256_max_ps(tx1, tx2);
+		const __m256 ty1 = _mm256_mul_ps(min_y, inv_dy);
+		const __m256 ty2 = _mm256_mul_ps(max_y, inv_dy);
+		t_min = _mm256_max_ps(t_min, _mm256_min_ps(ty1, ty2));
+		t_max = _mm256_min_ps(t_max, _mm256_max_ps(ty1, ty2));
+		const __m256 tz1 = _mm256_mul_ps(min_z, inv_dz);
+		const __m256 tz2 = _mm256_mul_ps(max_z, inv_dz);
+		t_min = _mm256_max_ps(t_min, _mm256_min_ps(tz1, tz2));
+		t_max = _mm256_min_ps(t_max, _mm256_max_ps(tz1, tz2));
+		const __m256 miss = _mm256_or_ps(
+			_mm256_or_ps(_mm256_cmp_ps(t_max, t_min, _CMP_LT_OQ),
+						 _mm256_cmp_ps(t_max, zero, _CMP_LE_OQ)),
+			_mm256_cmp_ps(t_min, _mm256_load_ps(hit->distance + c),
+						  _CMP_GT_OQ));
+		nearest =
+			_mm256_min_ps(nearest, _mm256_blendv_ps(t_min, infinity, miss));
+	}
+	const __m128 half = _mm_min_ps(_mm256_castps256_ps128(nearest),
+								   _mm256_extractf128_ps(nearest, 1));
+	float lanes[4];
+	_mm_storeu_ps(lanes, half);
+	return fminf(fminf(lanes[0], lanes[1]), fminf(lanes[2], lanes[3]));
+}
+
+__attribute__((target("avx2"))) void packet_spheres_avx2(
+	const SphereSoa* soa, const int first, const int count,
+	const RayPacket* packet, PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 four = _mm256_set1_ps(4.0f);
+	for (int c = 0; c + 8 <= PACKET_SIZE; c += 8) {
+		const __m256 dx = _mm256_load_ps(packet->dx + c);
+		const __m256 dy = _mm256_load_ps(packet->dy + c);
+		const __m256 dz = _mm256_load_ps(packet->dz + c);
+		const __m256 four_a = _mm256_mul_ps(four, _mm256_load_ps(packet->a + c));
+		const __m256 inv_2a = _mm256_load_ps(packet->inv_2a + c);
+		__m256 best = _mm256_load_ps(hit->distance + c);
+		__m256i best_object =
+			_mm256_load_si256((const __m256i*)(hit->object + c));
+		for (int i = first; i < first + count; i++) {
+			const float px = o->x - soa->center_x[i];
+			const float py = o->y - soa->center_y[i];
+			const float pz = o->z - soa->center_z[i];
+			const __m256 sphere_c =
+				_mm256_set1_ps(px * px + py * py + pz * pz - soa->radius2[i]);
+			const __m256 b = _mm256_mul_ps(
+				two,
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(px), dx),
+											_mm256_mul_ps(_mm256_set1_ps(py), dy)),
+							  _mm256_mul_ps(_mm256_set1_ps(pz), dz)));
+			const __m256 discriminant = _mm256_sub_ps(
+				_mm256_mul_ps(b, b), _mm256_mul_ps(four_a, sphere_c));
+			const __m256 valid = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+			if (_mm256_movemask_ps(valid) == 0) continue;
+			const __m256 sqrt_discriminant =
+				_mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+			const __m256 minus_b = _mm256_sub_ps(zero, b);
+			const __m256 near = _mm256_mul_ps(
+				_mm256_sub_ps(minus_b, sqrt_discriminant), inv_2a);
+			const __m256 far = _mm256_mul_ps(
+				_mm256_add_ps(minus_b, sqrt_discriminant), inv_2a);
+			const __m256 distance = _mm256_blendv_ps(
+				far, near, _mm256_cmp_ps(near, zero, _CMP_GT_OQ));
+			packet_update_avx2(distance, valid,
+							   _mm256_set1_epi32(soa->object[i]), &best,
+							   &best_object);
+		}
+		_mm256_store_ps(hit->distance + c, best);
+		_mm256_store_si256((__m256i*)(hit->object + c), best_object);
+	}
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+__attribute__((target("avx2"))) void packet_triangles_avx2(
+	const TriangleSoa* soa, const int first, const int count,
+	const RayPacket* packet, PacketHit* hit) {
+	const float* v0[3] = {soa->v0_x, soa->v0_y, soa->v0_z};
+	const float* v1[3] = {soa->v1_x, soa->v1_y, soa->v1_z};
+	const float* v2[3] = {soa->v2_x, soa->v2_y, soa->v2_z};
+	const int kx = packet->kx, ky = packet->ky, kz = packet->kz;
+	const float ox = float3_axis(&packet->origin, kx);
+	const float oy = float3_axis(&packet->origin, ky);
+	const float oz = float3_axis(&packet->origin, kz);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	for (int c = 0; c + 8 <= PACKET_SIZE; c += 8) {
+		const __m256 sx = _mm256_load_ps(packet->sx + c);
+		const __m256 sy = _mm256_load_ps(packet->sy + c);
+		const __m256 sz = _mm256_load_ps(packet->sz + c);
+		__m256 best = _mm256_load_ps(hit->distance + c);
+		__m256i best_object =
+			_mm256_load_si256((const __m256i*)(hit->object + c));
+		for (int i = first; i < first + count; i++) {
+			const __m256 az = _mm256_set1_ps(v0[kz][i] - oz);
+			const __m256 bz = _mm256_set1_ps(v1[kz][i] - oz);
+			const __m256 cz = _mm256_set1_ps(v2[kz][i] - oz);
+			const __m256 ax = _mm256_sub_ps(_mm256_set1_ps(v0[kx][i] - ox),
+											_mm256_mul_ps(sx, az));
+			const __m256 ay = _mm256_sub_ps(_mm256_set1_ps(v0[ky][i] - oy),
+											_mm256_mul_ps(sy, az));
+			const __m256 bx = _mm256_sub_ps(_mm256_set1_ps(v1[kx][i] - ox),
+											_mm256_mul_ps(sx, bz));
+			const __m256 by = _mm256_sub_ps(_mm256_set1_ps(v1[ky][i] - oy),
+											_mm256_mul_ps(sy, bz));
+			const __m256 cx = _mm256_sub_ps(_mm256_set1_ps(v2[kx][i] - ox),
+											_mm256_mul_ps(sx, cz));
+			const __m256 cy = _mm256_sub_ps(_mm256_set1_ps(v2[ky][i] - oy),
+											_mm256_mul_ps(sy, cz));
+			const __m256 w1 =
+				_mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+			const __m256 w2 =
+				_mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+			const __m256 w3 =
+				_mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+			const __m256 any_negative = _mm256_or_ps(
+				_mm256_or_ps(_mm256_cmp_ps(w1, zero, _CMP_LT_OQ),
+							 _mm256_cmp_ps(w2, zero, _CMP_LT_OQ)),
+				_mm256_cmp_ps(w3, zero, _CMP_LT_OQ));
+			const __m256 any_positive = _mm256_or_ps(
+				_mm256_or_ps(_mm256_cmp_ps(w1, zero, _CMP_GT_OQ),
+							 _mm256_cmp_ps(w2, zero, _CMP_GT_OQ)),
+				_mm256_cmp_ps(w3, zero, _CMP_GT_OQ));
+			const __m256 any_zero = _mm256_or_ps(
+				_mm256_or_ps(_mm256_cmp_ps(w1, zero, _CMP_EQ_OQ),
+							 _mm256_cmp_ps(w2, zero, _CMP_EQ_OQ)),
+				_mm256_cmp_ps(w3, zero, _CMP_EQ_OQ));
+			const __m256 outside = _mm256_and_ps(any_negative, any_positive);
+			if (_mm256_movemask_ps(_mm256_andnot_ps(any_zero, outside)) == 0xff)
+				continue;
+			const __m256 det = _mm256_add_ps(_mm256_add_ps(w1, w2), w3);
+			const __m256 distance = _mm256_mul_ps(
+				_mm256_mul_ps(
+					_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w1, az),
+												_mm256_mul_ps(w2, bz)),
+								  _mm256_mul_ps(w3, cz)),
+					sz),
+				_mm256_div_ps(one, det));
+			const __m256 valid =
+				_mm256_andnot_ps(_mm256_or_ps(outside, any_zero),
+								 _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+			packet_update_avx2(distance, valid,
+							   _mm256_set1_epi32(soa->object[i]), &best,
+							   &best_object);
+			int exact = _mm256_movemask_ps(any_zero);
+			if (exact == 0) continue;
+			_mm256_store_ps(hit->distance + c, best);
+			_mm256_store_si256((__m256i*)(hit->object + c), best_object);
+			for (; exact != 0; exact &= exact - 1)
+				packet_triangle_exact(soa, i, packet, c + __builtin_ctz(exact),
+									  hit);
+			best = _mm256_load_ps(hit->distance + c);
+			best_object = _mm256_load_si256((const __m256i*)(hit->object + c));
+		}
+		_mm256_store_ps(hit->distance + c, best);
+		_mm256_store_si256((__m256i*)(hit->object + c), best_object);
+	}
+}
+#else
+__attribute__((target("avx2"))) void packet_triangles_avx2(
+	const TriangleSoa* soa, const int first, const int count,
+	const RayPacket* packet, PacketHit* hit) {
+	const Float3* o = &packet->origin;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 epsilon = _mm256_set1_ps(TRIANGLE_DET_EPSILON);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	for (int c = 0; c + 8 <= PACKET_SIZE; c += 8) {
+		const __m256 dx = _mm256_load_ps(packet->dx + c);
+		const __m256 dy = _mm256_load_ps(packet->dy + c);
+		const __m256 dz = _mm256_load_ps(packet->dz + c);
+		__m256 best = _mm256_load_ps(hit->distance + c);
+		__m256i best_object =
+			_mm256_load_si256((const __m256i*)(hit->object + c));
+		for (int i = first; i < first + count; i++) {
+			const float e1x = soa->e1_x[i], e1y = soa->e1_y[i];
+			const float e1z = soa->e1_z[i];
+			const float tx = o->x - soa->v0_x[i];
+			const float ty = o->y - soa->v0_y[i];
+			const float tz = o->z - soa->v0_z[i];
+			const float qx = ty * e1z - tz * e1y;
+			const float qy = tz * e1x - tx * e1z;
+			const float qz = tx * e1y - ty * e1x;
+			const __m256 e2x = _mm256_set1_ps(soa->e2_x[i]);
+			const __m256 e2y = _mm256_set1_ps(soa->e2_y[i]);
+			const __m256 e2z = _mm256_set1_ps(soa->e2_z[i]);
+			const __m256 e2_q = _mm256_set1_ps(soa->e2_x[i] * qx +
+											   soa->e2_y[i] * qy +
+											   soa->e2_z[i] * qz);
+			const __m256 px =
+				_mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+			const __m256 py =
+				_mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+			const __m256 pz =
+				_mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+			const __m256 det = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e1x), px),
+							  _mm256_mul_ps(_mm256_set1_ps(e1y), py)),
+				_mm256_mul_ps(_mm256_set1_ps(e1z), pz));
+			const __m256 inv_det = _mm256_div_ps(one, det);
+			const __m256 u = _mm256_mul_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tx), px),
+											_mm256_mul_ps(_mm256_set1_ps(ty), py)),
+							  _mm256_mul_ps(_mm256_set1_ps(tz), pz)),
+				inv_det);
+			const __m256 v = _mm256_mul_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, _mm256_set1_ps(qx)),
+											_mm256_mul_ps(dy, _mm256_set1_ps(qy))),
+							  _mm256_mul_ps(dz, _mm256_set1_ps(qz))),
+				inv_det);
+			__m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(sign, det), epsilon,
+										 _CMP_GE_OQ);
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+			valid = _mm256_and_ps(
+				valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+			if (_mm256_movemask_ps(valid) == 0) continue;
+			packet_update_avx2(_mm256_mul_ps(e2_q, inv_det), valid,
+							   _mm256_set1_epi32(soa->object[i]), &best,
+							   &best_object);
+		}
+		_mm256_store_ps(hit->distance + c, best);
+		_mm256_store_si256((__m256i*)(hit->object + c), best_object);
+	}
+}
+#endif
+
+#endif
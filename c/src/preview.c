@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+#include "preview.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "algebra.h"
+#include "camera.h"
+#include "scanner.h"
+
+#define PREVIEW_SEPARATORS " \t\r"
+
+int preview_apply(PreviewInput* input, InputData* input_data, char* line);
+
+PreviewInput preview_input_open(const char* filename) {
+	PreviewInput input;
+	input.length = 0;
+	input.closed = 0;
+	input.quit = 0;
+	if (strcmp(filename, "-") == 0) {
+		input.fd = STDIN_FILENO;
+		return input;
+	}
+	struct stat st;
+	const int fifo = stat(filename, &st) == 0 && S_ISFIFO(st.st_mode);
+	input.fd = open(filename, fifo ? O_RDWR : O_RDONLY);
+	if (input.fd < 0) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	return input;
+}
+
+void preview_input_close(PreviewInput* input) {
+	if (input->fd != STDIN_FILENO) close(input->fd);
+	input->fd = -1;
+}
+
+int preview_input_read(PreviewInput* input, InputData* input_data,
+					   const int wait) {
+	int changed = 0;
+	while (!input->closed) {
+		struct pollfd ready = {input->fd, POLLIN, 0};
+		if (poll(&ready, 1, wait && !changed ? -1 : 0) <= 0) break;
+		char chunk[PREVIEW_LINE];
+		const ssize_t n = read(input->fd, chunk, sizeof(chunk));
+		if (n <= 0) {
+			// the last line may have no new line
+			input->closed = 1;
+			input->line[input->length] = '\0';
+			changed |= preview_apply(input, input_data, input->line);
+			break;
+		}
+		for (ssize_t i = 0; i < n && !input->quit; i++) {
+			if (chunk[i] != '\n') {
+				// too long a line is cut, and then rejected
+				if (input->length < PREVIEW_LINE - 1)
+					input->line[input->length++] = chunk[i];
+				continue;
+			}
+			input->line[input->length] = '\0';
+			input->length = 0;
+			changed |= preview_apply(input, input_data, input->line);
+		}
+		if (input->quit) input->closed = 1;
+	}
+	return changed;
+}
+
+// One line. Returns 1 if it changed the camera, a line that can't be read is
+// reported and skipped: a typo mustn't end the session.
+int preview_apply(PreviewInput* input, InputData* input_data, char* line) {
+	char copy[PREVIEW_LINE];
+	strcpy(copy, line);
+	char* save;
+	const char* name = strtok_r(line, PREVIEW_SEPARATORS, &save);
+	if (name == NULL) return 0;
+	float value[3];
+	int n = 0;
+	for (char* word; (word = strtok_r(NULL, PREVIEW_SEPARATORS, &save));) {
+		if (n == 3 || !parse_float(word, &value[n])) {
+			n = -1;
+			break;
+		}
+		n++;
+	}
+	Float3 position = input_data->camera_position;
+	Float3 direction = input_data->camera_direction;
+	float angle = input_data->camera_angle;
+	if (strcmp(name, "quit") == 0 && n == 0) {
+		input->quit = 1;
+		return 0;
+	} else if (strcmp(name, "camera_position") == 0 && n == 3) {
+		position = float3_new(value[0], value[1], value[2]);
+	} else if (strcmp(name, "camera_vector") == 0 && n == 3 &&
+			   (value[0] != 0 || value[1] != 0)) {
+		direction = float3_new(value[0], value[1], value[2]);
+	} else if (strcmp(name, "camera_angle") == 0 && n == 1) {
+		angle = value[0];
+	} else {
+		fprintf(stderr, "\npreview: can't read \"%s\"\n", copy);
+		return 0;
+	}
+	input_data->camera_position = position;
+	input_data->camera_direction = direction;
+	input_data->camera_angle = angle;
+	const Camera* camera = &input_data->camera;
+	input_data->camera =
+		camera_new(&position, &direction, angle, camera->width,
+				   camera->height, camera->sqrt_ray_per_pixel);
+	return 1;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "scanner.h"
+
+#define PREVIEW_LINE 256
+
+// The camera updates of `ray-tracer --preview`, one a line, read from a file,
+// a FIFO or stdin:
+//   camera_position x y z
+//   camera_vector x y z
+//   camera_angle a
+//   quit
+// A FIFO is opened for writing too, so it never reads an end of file: the
+// writers can come and go until `quit`.
+typedef struct _PreviewInput {
+	int fd;
+	// the start of a line that hasn't come whole yet
+	char line[PREVIEW_LINE];
+	int length;
+	// closed: nothing more will come, quit: stop now
+	int closed, quit;
+} PreviewInput;
+
+PreviewInput preview_input_open(const char* filename);
+void preview_input_close(PreviewInput* input);
+// Applies the lines that came so far to the camera of `input_data`, after
+// waiting for one if `wait`. Returns 1 if the camera changed.
+int preview_input_read(PreviewInput* input, InputData* input_data,
+					   const int wait);
@@ -1,5 +1,7 @@
 #include "ray.h"
 
+#include <math.h>
+
 #include "algebra.h"
 
 Ray3 ray3_new(const Float3* position, const Float3* direction) {
@@ -14,6 +16,14 @@ void ray3_move_along(Ray3* ray, const float distance) {
 	ray->origin = float3_add(&ray->origin, &movement);
 }
 
+void ray3_offset(Ray3* ray, const Float3* normal) {
+	const Float3* o = &ray->origin;
+	const float size =
+		fmaxf(1, fmaxf(fabsf(o->x), fmaxf(fabsf(o->y), fabsf(o->z))));
+	const Float3 offset = float3_mul(normal, RAY_EPSILON * size);
+	float3_add_eq(&ray->origin, &offset);
+}
+
 Ray2 ray2_new(const Float2* position, const Float2* direction) {
 	Ray2 ray;
 	ray.origin = *position;
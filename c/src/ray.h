@@ -6,8 +6,14 @@ typedef struct _Ray3 {
 	Float3 origin, direction;
 } Ray3;
 
+// A ray leaving a surface could hit it again right where it starts, rounding
+// putting the point a little off it: it starts RAY_EPSILON times the size of
+// its coordinates away, on the side it leaves.
+#define RAY_EPSILON 1e-4f
+
 Ray3 ray3_new(const Float3* position, const Float3* direction);
 void ray3_move_along(Ray3* ray, const float distance);
+void ray3_offset(Ray3* ray, const Float3* normal);
 
 typedef struct _Ray2 {
 	Float2 origin, direction;
@@ -0,0 +1,26 @@
+#include "rng.h"
+
+#include <stdint.h>
+
+Rng rng_new(const uint64_t seed, const uint64_t stream) {
+	Rng rng;
+	rng.state = 0;
+	rng.inc = (stream << 1) | 1;
+	rng_next(&rng);
+	rng.state += seed;
+	rng_next(&rng);
+	return rng;
+}
+
+uint32_t rng_next(Rng* rng) {
+	const uint64_t old = rng->state;
+	rng->state = old * 6364136223846793005ULL + rng->inc;
+	const uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+	const uint32_t rot = old >> 59;
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// Uniform in [0, 1): the top 24 bits fill exactly the float mantissa.
+float rng_next_float(Rng* rng) {
+	return (rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
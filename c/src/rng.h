@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+// PCG32 (pcg-random.org): 64 bit state, one independent stream per `inc`.
+typedef struct _Rng {
+	uint64_t state, inc;
+} Rng;
+
+Rng rng_new(const uint64_t seed, const uint64_t stream);
+uint32_t rng_next(Rng* rng);
+float rng_next_float(Rng* rng);
@@ -1,126 +1,397 @@
 #include "scanner.h"
 
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "algebra.h"
 #include "camera.h"
+#include "mesh_file.h"
 #include "object.h"
 
-void next_valid_word(char* buffer);
-int next_int(char* buffer);
-float next_float(char* buffer);
-Float3 next_float3(char* buffer);
-char* next_string(char* buffer);
+#define SCANNER_BUFFER (1 << 20)
+#define SCANNER_WORD 256
 
-InputData scan_input() {
-	char buffer[256];
+// The input is read SCANNER_BUFFER bytes at a time and cut into words in
+// place; numbers are parsed by hand, scanf was most of the time spent on
+// scenes with millions of objects.
+typedef struct _Scanner {
+	FILE* file;
+	char* data;
+	size_t begin, end;
+	int eof;
+	// the current word, ended by a '\0' written over the space after it
+	char* word;
+} Scanner;
+
+Scanner scanner_new(FILE* file);
+void scanner_free(Scanner* scanner);
+void scanner_fill(Scanner* scanner);
+int is_space(const char c);
+int next_word(Scanner* scanner);
+int next_optional_word(Scanner* scanner);
+void next_valid_word(Scanner* scanner);
+int next_int(Scanner* scanner);
+uint64_t next_uint64(Scanner* scanner);
+float next_float(Scanner* scanner);
+Float3 next_float3(Scanner* scanner);
+char* next_string(Scanner* scanner);
+int parse_float_strtof(const char* word, float* value);
+void next_entry(Scanner* scanner, InputData* input_data);
+void next_object(Scanner* scanner, const int n_threads, ObjectVec* objects);
+void next_keyframe(Scanner* scanner, CameraPath* path);
+int next_material(Scanner* scanner, ObjectVec* objects);
+
+InputData scan_input(FILE* file) {
+	Scanner scanner = scanner_new(file);
 	InputData input_data;
-	input_data.color_ppm = next_string(buffer);
-	const int width = next_int(buffer);
-	const int height = next_int(buffer);
-	const int save_floats = next_int(buffer);
+	input_data.color_ppm = next_string(&scanner);
+	const int width = next_int(&scanner);
+	const int height = next_int(&scanner);
+	input_data.n_threads = next_int(&scanner);
+	input_data.seed = next_uint64(&scanner);
+	const int save_floats = next_int(&scanner);
 	if (save_floats) {
-		input_data.color_pfm = next_string(buffer);
-		input_data.albedo_pfm = next_string(buffer);
-		input_data.normal_pfm = next_string(buffer);
+		input_data.color_pfm = next_string(&scanner);
+		input_data.albedo_pfm = next_string(&scanner);
+		input_data.normal_pfm = next_string(&scanner);
 	} else {
 		input_data.color_pfm = NULL;
 		input_data.albedo_pfm = NULL;
 		input_data.normal_pfm = NULL;
 	}
-	const int sqrt_ray_per_pixel = next_int(buffer);
-	input_data.number_of_updates = next_int(buffer);
-	const Float3 camera_position = next_float3(buffer);
-	const Float3 camera_direction = next_float3(buffer);
-	const float camera_angle = next_float(buffer);
-	input_data.camera =
-		camera_new(&camera_position, &camera_direction, camera_angle, width,
-				   height, sqrt_ray_per_pixel);
-	input_data.max_bounces = next_int(buffer);
-	input_data.background_color = next_float3(buffer);
-
-	const int n_objects = next_int(buffer);
-	input_data.objects = objectvec_new(n_objects);
-
-	for (int i = 0; i < n_objects; i++) {
-		next_valid_word(buffer);
-		int shape_type;
-		Shape shape;
-		if (strcmp(buffer, "sphere") == 0) {
-			Float3 center = next_float3(buffer);
-			float radius = next_float(buffer);
-			shape_type = TYPE_SPHERE;
-			shape.sphere = sphere_new(&center, radius);
-		} else if (strcmp(buffer, "plane") == 0) {
-			float a = next_float(buffer);
-			float b = next_float(buffer);
-			float c = next_float(buffer);
-			float d = next_float(buffer);
-			shape_type = TYPE_PLANE;
-			shape.plane = plane_new(a, b, c, d);
-		} else if (strcmp(buffer, "triangle") == 0) {
-			Float3 point_1 = next_float3(buffer);
-			Float3 point_2 = next_float3(buffer);
-			Float3 point_3 = next_float3(buffer);
-			shape_type = TYPE_TRIANGLE;
-			shape.triangle = triangle_new(&point_1, &point_2, &point_3);
-		} else {
-			fprintf(stderr, "Parse error: unknown object %s", buffer);
+	// the file is needed to resume even when no new checkpoint is saved
+	input_data.checkpoint_seconds = next_int(&scanner);
+	input_data.checkpoint = next_string(&scanner);
+	input_data.resume = 0;
+	const int sqrt_ray_per_pixel = next_int(&scanner);
+	input_data.number_of_updates = next_int(&scanner);
+	input_data.target_noise = next_float(&scanner);
+	input_data.camera_position = next_float3(&scanner);
+	input_data.camera_direction = next_float3(&scanner);
+	input_data.camera_angle = next_float(&scanner);
+	input_data.camera = camera_new(
+		&input_data.camera_position, &input_data.camera_direction,
+		input_data.camera_angle, width, height, sqrt_ray_per_pixel);
+	input_data.max_bounces = next_int(&scanner);
+	input_data.background_color = next_float3(&scanner);
+	input_data.camera_path = camera_path_new();
+
+	// the number of objects is optional: without it they are read up to the
+	// end of the input
+	long long n_objects = 0;
+	const int more = next_optional_word(&scanner);
+	if (more && parse_int(scanner.word, &n_objects)) {
+		if (n_objects < 0 || n_objects > INT32_MAX) {
+			fprintf(stderr, "Parse error: %s objects\n", scanner.word);
 			exit(-1);
 		}
-		const Float3 color = next_float3(buffer);
-		const float reflection = next_float(buffer);
-		const float emission_intensity = next_float(buffer);
-		const Object object = object_new(shape_type, &shape, &color,
-										 emission_intensity, reflection);
-		object_vec_push(&input_data.objects, &object);
+		input_data.objects = objectvec_new(n_objects);
+		for (long long i = 0; i < n_objects; i++) {
+			next_valid_word(&scanner);
+			next_entry(&scanner, &input_data);
+		}
+	} else {
+		input_data.objects = objectvec_new(0);
+		for (int word = more; word; word = next_optional_word(&scanner))
+			next_entry(&scanner, &input_data);
 	}
+	scanner_free(&scanner);
 	return input_data;
 }
 
-void next_valid_word(char* buffer) {
-	do {
-		if (scanf("%s", buffer) == 0) {
-			fprintf(stderr, "fscanf can't read any more data");
+// A keyframe of the camera path goes among the objects, and counts as one
+void next_entry(Scanner* scanner, InputData* input_data) {
+	if (strcmp(scanner->word, "keyframe") == 0)
+		next_keyframe(scanner, &input_data->camera_path);
+	else
+		next_object(scanner, input_data->n_threads, &input_data->objects);
+}
+
+// `keyframe frame  position  direction  angle`
+void next_keyframe(Scanner* scanner, CameraPath* path) {
+	Keyframe key;
+	key.frame = next_int(scanner);
+	key.position = next_float3(scanner);
+	key.direction = next_float3(scanner);
+	key.angle = next_float(scanner);
+	camera_path_push(path, &key);
+}
+
+// Pushes the object whose shape is the current word, or all the triangles
+// of a mesh
+void next_object(Scanner* scanner, const int n_threads, ObjectVec* objects) {
+	int shape_type;
+	Shape shape;
+	if (strcmp(scanner->word, "mesh") == 0) {
+		char* filename = next_string(scanner);
+		const Float3 position = next_float3(scanner);
+		const Float3 rotation = next_float3(scanner);
+		const float scale = next_float(scanner);
+		const Float3 color = next_float3(scanner);
+		const float reflection = next_float(scanner);
+		const float emission_intensity = next_float(scanner);
+		const MeshTransform transform =
+			mesh_transform_new(&position, &rotation, scale);
+		mesh_file_load(filename, &transform, &color, reflection,
+					   emission_intensity, n_threads, objects);
+		free(filename);
+		return;
+	} else if (strcmp(scanner->word, "sphere") == 0) {
+		Float3 center = next_float3(scanner);
+		float radius = next_float(scanner);
+		shape_type = TYPE_SPHERE;
+		shape.sphere = sphere_new(&center, radius);
+	} else if (strcmp(scanner->word, "plane") == 0) {
+		float a = next_float(scanner);
+		float b = next_float(scanner);
+		float c = next_float(scanner);
+		float d = next_float(scanner);
+		shape_type = TYPE_PLANE;
+		shape.plane = plane_new(a, b, c, d);
+	} else if (strcmp(scanner->word, "triangle") == 0) {
+		Float3 points[3];
+		for (int i = 0; i < 3; i++) points[i] = next_float3(scanner);
+		const int material = next_material(scanner, objects);
+		object_vec_push_triangle(objects, &points[0], &points[1], &points[2],
+								 material);
+		return;
+	} else {
+		fprintf(stderr, "Parse error: unknown object %s\n", scanner->word);
+		exit(-1);
+	}
+	const int material = next_material(scanner, objects);
+	const Object object = object_new(shape_type, &shape, material);
+	object_vec_push(objects, &object);
+}
+
+// Color, reflection and emission intensity, as an index in the materials
+int next_material(Scanner* scanner, ObjectVec* objects) {
+	const Float3 color = next_float3(scanner);
+	const float reflection = next_float(scanner);
+	const float emission_intensity = next_float(scanner);
+	const Material material =
+		material_new(&color, emission_intensity, reflection);
+	return object_vec_push_material(objects, &material);
+}
+
+Scanner scanner_new(FILE* file) {
+	Scanner scanner;
+	scanner.file = file;
+	// one more byte to end the last word of the input
+	scanner.data = malloc(SCANNER_BUFFER + 1);
+	if (scanner.data == NULL) {
+		fprintf(stderr, "Error: malloc failed in scan_input()\n");
+		exit(-1);
+	}
+	scanner.begin = 0;
+	scanner.end = 0;
+	scanner.eof = 0;
+	scanner.word = NULL;
+	return scanner;
+}
+
+void scanner_free(Scanner* scanner) {
+	free(scanner->data);
+}
+
+// Moves what is left to the front of the buffer and reads after it.
+void scanner_fill(Scanner* scanner) {
+	const size_t left = scanner->end - scanner->begin;
+	memmove(scanner->data, scanner->data + scanner->begin, left);
+	scanner->begin = 0;
+	scanner->end = left;
+	const size_t read = fread(scanner->data + left, 1, SCANNER_BUFFER - left,
+							  scanner->file);
+	if (read == 0) scanner->eof = 1;
+	scanner->end += read;
+}
+
+// Spaces, tabs, new lines and the other control characters
+int is_space(const char c) {
+	return (unsigned char)c <= ' ';
+}
+
+// Points scanner->word to the next word, returns 0 at the end of the input.
+int next_word(Scanner* scanner) {
+	for (;;) {
+		char* data = scanner->data;
+		size_t begin = scanner->begin;
+		while (begin < scanner->end && is_space(data[begin])) begin++;
+		size_t end = begin;
+		while (end < scanner->end && !is_space(data[end])) end++;
+		scanner->begin = begin;
+		if (end == scanner->end && !scanner->eof) {
+			// the word may go on in the next block
+			scanner_fill(scanner);
+			continue;
+		}
+		if (begin == end) return 0;
+		if (end - begin >= SCANNER_WORD) {
+			fprintf(stderr, "Parse error: word longer than %d characters\n",
+					SCANNER_WORD - 1);
 			exit(-1);
 		}
-	} while (buffer[0] == '_');
+		data[end] = '\0';
+		scanner->word = data + begin;
+		scanner->begin = end < scanner->end ? end + 1 : end;
+		return 1;
+	}
 }
 
-int next_int(char* buffer) {
-	int tmp;
-	next_valid_word(buffer);
-	sscanf(buffer, "%d", &tmp);
-	return tmp;
+// Skips the words starting with '_', returns 0 at the end of the input.
+int next_optional_word(Scanner* scanner) {
+	do {
+		if (!next_word(scanner)) return 0;
+	} while (scanner->word[0] == '_');
+	return 1;
 }
 
-float next_float(char* buffer) {
-	float tmp;
-	next_valid_word(buffer);
-	sscanf(buffer, "%f", &tmp);
-	return tmp;
+void next_valid_word(Scanner* scanner) {
+	if (!next_optional_word(scanner)) {
+		fprintf(stderr, "Parse error: unexpected end of input\n");
+		exit(-1);
+	}
 }
 
-Float3 next_float3(char* buffer) {
-	const float x = next_float(buffer);
-	const float y = next_float(buffer);
-	const float z = next_float(buffer);
+int next_int(Scanner* scanner) {
+	next_valid_word(scanner);
+	long long value;
+	if (!parse_int(scanner->word, &value) || value < INT32_MIN ||
+		value > INT32_MAX) {
+		fprintf(stderr, "Parse error: %s is not an int\n", scanner->word);
+		exit(-1);
+	}
+	return value;
+}
+
+uint64_t next_uint64(Scanner* scanner) {
+	next_valid_word(scanner);
+	char* end;
+	errno = 0;
+	const unsigned long long value = strtoull(scanner->word, &end, 10);
+	if (scanner->word[0] == '-' || *end != '\0' || errno != 0) {
+		fprintf(stderr, "Parse error: %s is not an uint64\n", scanner->word);
+		exit(-1);
+	}
+	return value;
+}
+
+float next_float(Scanner* scanner) {
+	next_valid_word(scanner);
+	float value;
+	if (!parse_float(scanner->word, &value)) {
+		fprintf(stderr, "Parse error: %s is not a float\n", scanner->word);
+		exit(-1);
+	}
+	return value;
+}
+
+Float3 next_float3(Scanner* scanner) {
+	const float x = next_float(scanner);
+	const float y = next_float(scanner);
+	const float z = next_float(scanner);
 	return float3_new(x, y, z);
 }
 
-char* next_string(char* buffer) {
-	next_valid_word(buffer);
-	char* ris = malloc(sizeof(char) * (strlen(buffer) + 1));
-	strcpy(ris, buffer);
+char* next_string(Scanner* scanner) {
+	next_valid_word(scanner);
+	char* ris = malloc(sizeof(char) * (strlen(scanner->word) + 1));
+	strcpy(ris, scanner->word);
 	return ris;
 }
 
+// Returns 0 if the whole word isn't an int
+int parse_int(const char* word, long long* value) {
+	const char* c = word;
+	const int negative = *c == '-';
+	if (*c == '-' || *c == '+') c++;
+	if (*c == '\0') return 0;
+	long long n = 0;
+	for (; *c != '\0'; c++) {
+		if (*c < '0' || *c > '9' || n > (LLONG_MAX - 9) / 10) return 0;
+		n = n * 10 + (*c - '0');
+	}
+	*value = negative ? -n : n;
+	return 1;
+}
+
+// Returns 0 if the whole word isn't a float. Decimal numbers of at most 7
+// significant digits and 10^-10..10^10 are exact as float, one float multiply
+// or divide rounds them correctly (Clinger's fast path); the rest goes to
+// strtof().
+int parse_float(const char* word, float* value) {
+	static const float powers_of_10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+										 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+	const char* c = word;
+	const int negative = *c == '-';
+	if (*c == '-' || *c == '+') c++;
+	uint32_t mantissa = 0;
+	int digits = 0, exponent = 0, seen_digit = 0;
+	for (; *c >= '0' && *c <= '9'; c++, seen_digit = 1) {
+		if (mantissa == 0 && *c == '0') continue;
+		if (digits++ < 9) mantissa = mantissa * 10 + (*c - '0');
+		else exponent++;
+	}
+	if (*c == '.') {
+		for (c++; *c >= '0' && *c <= '9'; c++, seen_digit = 1) {
+			if (mantissa == 0 && *c == '0') {
+				exponent--;
+				continue;
+			}
+			if (digits++ < 9) {
+				mantissa = mantissa * 10 + (*c - '0');
+				exponent--;
+			}
+		}
+	}
+	if (!seen_digit) return parse_float_strtof(word, value);
+	if (*c == 'e' || *c == 'E') {
+		const char* e = c + 1;
+		const int exponent_negative = *e == '-';
+		if (*e == '-' || *e == '+') e++;
+		if (*e < '0' || *e > '9') return parse_float_strtof(word, value);
+		int n = 0;
+		for (; *e >= '0' && *e <= '9'; e++)
+			if (n < 100000) n = n * 10 + (*e - '0');
+		exponent += exponent_negative ? -n : n;
+		c = e;
+	}
+	if (*c != '\0') return parse_float_strtof(word, value);
+	if (mantissa == 0) {
+		// by bits: with -Ofast, -0.0f and 0.0f are the same constant
+		const uint32_t bits = (uint32_t)negative << 31;
+		memcpy(value, &bits, sizeof(bits));
+		return 1;
+	}
+	if (digits <= 9 && mantissa <= (1 << 24) && exponent >= -10 &&
+		exponent <= 10) {
+		float f = mantissa;
+		if (exponent < 0) f /= powers_of_10[-exponent];
+		else f *= powers_of_10[exponent];
+		*value = negative ? -f : f;
+		return 1;
+	}
+	return parse_float_strtof(word, value);
+}
+
+// Everything else: long mantissas, big exponents, inf, nan, hex floats
+int parse_float_strtof(const char* word, float* value) {
+	char* end;
+	*value = strtof(word, &end);
+	return end != word && *end == '\0';
+}
+
 void free_input_data(InputData *input) {
 	free(input->color_ppm);
 	free(input->color_pfm);
 	free(input->albedo_pfm);
 	free(input->normal_pfm);
+	free(input->checkpoint);
+	camera_path_free(&input->camera_path);
+	bvh_free(&input->bvh);
 	object_vec_free(&input->objects);
 }
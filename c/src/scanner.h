@@ -1,15 +1,35 @@
 #pragma once
+#include <stdint.h>
+#include <stdio.h>
+
 #include "algebra.h"
+#include "animation.h"
+#include "bvh.h"
 #include "camera.h"
 #include "object.h"
 
 typedef struct _InputData {
-	int number_of_updates, max_bounces;
+	int number_of_updates, max_bounces, n_threads;
+	// pixels whose noise is under it stop getting samples (0: off)
+	float target_noise;
+	uint64_t seed;
 	Float3 background_color;
+	// what `camera` was made from, to save the scene again
+	Float3 camera_position, camera_direction;
+	float camera_angle;
 	Camera camera;
+	// the keyframes of `ray-tracer --frames`, if any
+	CameraPath camera_path;
 	char *color_ppm, *color_pfm, *albedo_pfm, *normal_pfm;
+	// saved every `checkpoint_seconds` (never if 0), `resume` is set by main()
+	char *checkpoint;
+	int checkpoint_seconds, resume;
 	ObjectVec objects;
+	Bvh bvh;
 } InputData;
 
-InputData scan_input();
+InputData scan_input(FILE *file);
 void free_input_data(InputData *input);
+// Return 0 if the whole word isn't a number
+int parse_int(const char *word, long long *value);
+int parse_float(const char *word, float *value);
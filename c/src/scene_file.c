@@ -0,0 +1,406 @@
+#define _POSIX_C_SOURCE 200809L
+#include "scene_file.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "algebra.h"
+#include "animation.h"
+#include "camera.h"
+#include "object.h"
+#include "scanner.h"
+
+#define SCENE_MAGIC "RTSCENE"
+#define SCENE_VERSION 4
+#define SCENE_NAME_LEN 256
+// the arrays start at multiples of it
+#define SCENE_ALIGN 64
+
+// Everything is 4 or 8 bytes and in order of size: no padding anywhere.
+typedef struct _SceneHeader {
+	char magic[8];
+	uint32_t version, header_size;
+	uint64_t seed;
+	// byte offsets from the start of the file
+	uint64_t material_count, material_offset, vertex_count, vertex_offset,
+		sphere_count, sphere_offset, plane_count, plane_offset,
+		triangle_count, triangle_offset, keyframe_count, keyframe_offset;
+	int32_t width, height, n_threads, sqrt_ray_per_pixel, number_of_updates,
+		max_bounces, checkpoint_seconds, save_floats;
+	Float3 camera_position, camera_direction, background_color;
+	float camera_angle, target_noise;
+	// keeps the size a multiple of 8, always 0
+	uint32_t unused;
+	// "" if not given
+	char color_ppm[SCENE_NAME_LEN], color_pfm[SCENE_NAME_LEN],
+		albedo_pfm[SCENE_NAME_LEN], normal_pfm[SCENE_NAME_LEN],
+		checkpoint[SCENE_NAME_LEN];
+} SceneHeader;
+
+// light_emitted is kept as is: color * intensity can't be divided back
+typedef struct _SceneMaterial {
+	Float3 color, light_emitted;
+	float reflection;
+} SceneMaterial;
+
+// `material` is an index in the materials, `v` in the vertices
+typedef struct _SceneSphere {
+	Float3 center;
+	float radius;
+	uint32_t material;
+} SceneSphere;
+
+typedef struct _ScenePlane {
+	Float3 normal;
+	float d;
+	uint32_t material;
+} ScenePlane;
+
+typedef struct _SceneTriangle {
+	uint32_t v[3], material;
+} SceneTriangle;
+
+_Static_assert(sizeof(SceneHeader) == 1480, "SceneHeader has padding");
+// the keyframes are saved as they are
+_Static_assert(sizeof(Keyframe) == 32, "Keyframe has padding");
+
+void scene_name_save(char* dst, const char* name);
+char* scene_name_load(const char* src);
+uint64_t scene_align(const uint64_t offset);
+void scene_write(FILE* file, const void* data, const size_t size,
+				 const char* filename);
+void scene_pad(FILE* file, const uint64_t from, const uint64_t to,
+			   const char* filename);
+int scene_fits(const uint64_t offset, const uint64_t count,
+			   const size_t element_size, const size_t size);
+void scene_check_index(const uint32_t index, const uint64_t count,
+					   const char* filename);
+
+void scene_file_save(const char* filename, const InputData* input_data) {
+	const ObjectVec* objects = &input_data->objects;
+	SceneHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_VERSION;
+	header.header_size = sizeof(SceneHeader);
+	header.seed = input_data->seed;
+	header.material_count = objects->material_count;
+	header.vertex_count = objects->vertex_count;
+	for (int i = 0; i < objects->size; i++) {
+		const int type = objects->ptr[i].shape_type;
+		header.sphere_count += type == TYPE_SPHERE;
+		header.plane_count += type == TYPE_PLANE;
+		header.triangle_count += type == TYPE_TRIANGLE;
+	}
+	header.material_offset = scene_align(sizeof(SceneHeader));
+	header.vertex_offset =
+		scene_align(header.material_offset +
+					header.material_count * sizeof(SceneMaterial));
+	header.sphere_offset = scene_align(
+		header.vertex_offset + header.vertex_count * sizeof(Float3));
+	header.plane_offset = scene_align(header.sphere_offset +
+									  header.sphere_count * sizeof(SceneSphere));
+	header.triangle_offset = scene_align(
+		header.plane_offset + header.plane_count * sizeof(ScenePlane));
+	header.keyframe_count = input_data->camera_path.count;
+	header.keyframe_offset =
+		scene_align(header.triangle_offset +
+					header.triangle_count * sizeof(SceneTriangle));
+	header.width = input_data->camera.width;
+	header.height = input_data->camera.height;
+	header.n_threads = input_data->n_threads;
+	header.sqrt_ray_per_pixel = input_data->camera.sqrt_ray_per_pixel;
+	header.number_of_updates = input_data->number_of_updates;
+	header.max_bounces = input_data->max_bounces;
+	header.checkpoint_seconds = input_data->checkpoint_seconds;
+	header.save_floats = input_data->color_pfm != NULL;
+	header.camera_position = input_data->camera_position;
+	header.camera_direction = input_data->camera_direction;
+	header.background_color = input_data->background_color;
+	header.camera_angle = input_data->camera_angle;
+	header.target_noise = input_data->target_noise;
+	scene_name_save(header.color_ppm, input_data->color_ppm);
+	scene_name_save(header.color_pfm, input_data->color_pfm);
+	scene_name_save(header.albedo_pfm, input_data->albedo_pfm);
+	scene_name_save(header.normal_pfm, input_data->normal_pfm);
+	scene_name_save(header.checkpoint, input_data->checkpoint);
+
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	scene_write(file, &header, sizeof(header), filename);
+	scene_pad(file, sizeof(header), header.material_offset, filename);
+	for (int i = 0; i < objects->material_count; i++) {
+		const Material* material = &objects->materials[i];
+		SceneMaterial scene_material;
+		scene_material.color = material->color;
+		scene_material.light_emitted = material->light_emitted;
+		scene_material.reflection = material->reflection;
+		scene_write(file, &scene_material, sizeof(scene_material), filename);
+	}
+	scene_pad(file,
+			  header.material_offset +
+				  header.material_count * sizeof(SceneMaterial),
+			  header.vertex_offset, filename);
+	scene_write(file, objects->vertices, header.vertex_count * sizeof(Float3),
+				filename);
+	scene_pad(file, header.vertex_offset + header.vertex_count * sizeof(Float3),
+			  header.sphere_offset, filename);
+	for (int i = 0; i < objects->size; i++) {
+		const Object* object = &objects->ptr[i];
+		if (object->shape_type != TYPE_SPHERE) continue;
+		SceneSphere sphere;
+		sphere.center = object->shape.sphere.center;
+		sphere.radius = object->shape.sphere.radius;
+		sphere.material = object->material;
+		scene_write(file, &sphere, sizeof(sphere), filename);
+	}
+	scene_pad(file,
+			  header.sphere_offset + header.sphere_count * sizeof(SceneSphere),
+			  header.plane_offset, filename);
+	for (int i = 0; i < objects->size; i++) {
+		const Object* object = &objects->ptr[i];
+		if (object->shape_type != TYPE_PLANE) continue;
+		ScenePlane plane;
+		plane.normal = object->shape.plane.normal;
+		plane.d = object->shape.plane.d;
+		plane.material = object->material;
+		scene_write(file, &plane, sizeof(plane), filename);
+	}
+	scene_pad(file,
+			  header.plane_offset + header.plane_count * sizeof(ScenePlane),
+			  header.triangle_offset, filename);
+	for (int i = 0; i < objects->size; i++) {
+		const Object* object = &objects->ptr[i];
+		if (object->shape_type != TYPE_TRIANGLE) continue;
+		SceneTriangle triangle;
+		for (int v = 0; v < 3; v++) triangle.v[v] = object->shape.triangle.v[v];
+		triangle.material = object->material;
+		scene_write(file, &triangle, sizeof(triangle), filename);
+	}
+	scene_pad(file,
+			  header.triangle_offset +
+				  header.triangle_count * sizeof(SceneTriangle),
+			  header.keyframe_offset, filename);
+	scene_write(file, input_data->camera_path.keys,
+				header.keyframe_count * sizeof(Keyframe), filename);
+	if (fclose(file) != 0) {
+		fprintf(stderr, "Error: can't write file %s\n", filename);
+		exit(-1);
+	}
+}
+
+InputData scene_file_load(const char* filename) {
+	const int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Error: can't open file %s\n", filename);
+		exit(-1);
+	}
+	const size_t size = st.st_size;
+	if (size < sizeof(SceneHeader)) {
+		fprintf(stderr, "Error: %s is not a binary scene\n", filename);
+		exit(-1);
+	}
+	unsigned char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: can't map file %s\n", filename);
+		exit(-1);
+	}
+	close(fd);
+	posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+	const SceneHeader* header = (const SceneHeader*)map;
+	if (memcmp(header->magic, SCENE_MAGIC, sizeof(header->magic)) != 0) {
+		fprintf(stderr, "Error: %s is not a binary scene\n", filename);
+		exit(-1);
+	}
+	if (header->version != SCENE_VERSION ||
+		header->header_size != sizeof(SceneHeader)) {
+		fprintf(stderr, "Error: %s has version %u, only %d is supported\n",
+				filename, header->version, SCENE_VERSION);
+		exit(-1);
+	}
+	const uint64_t n_objects =
+		header->sphere_count + header->plane_count + header->triangle_count;
+	if (!scene_fits(header->material_offset, header->material_count,
+					sizeof(SceneMaterial), size) ||
+		!scene_fits(header->vertex_offset, header->vertex_count,
+					sizeof(Float3), size) ||
+		!scene_fits(header->sphere_offset, header->sphere_count,
+					sizeof(SceneSphere), size) ||
+		!scene_fits(header->plane_offset, header->plane_count,
+					sizeof(ScenePlane), size) ||
+		!scene_fits(header->triangle_offset, header->triangle_count,
+					sizeof(SceneTriangle), size) ||
+		!scene_fits(header->keyframe_offset, header->keyframe_count,
+					sizeof(Keyframe), size) ||
+		n_objects > INT32_MAX || header->material_count > INT32_MAX ||
+		header->vertex_count > INT32_MAX) {
+		fprintf(stderr, "Error: binary scene %s is truncated or corrupt\n",
+				filename);
+		exit(-1);
+	}
+
+	InputData input_data;
+	input_data.color_ppm = scene_name_load(header->color_ppm);
+	input_data.color_pfm = NULL;
+	input_data.albedo_pfm = NULL;
+	input_data.normal_pfm = NULL;
+	if (header->save_floats) {
+		input_data.color_pfm = scene_name_load(header->color_pfm);
+		input_data.albedo_pfm = scene_name_load(header->albedo_pfm);
+		input_data.normal_pfm = scene_name_load(header->normal_pfm);
+	}
+	input_data.checkpoint_seconds = header->checkpoint_seconds;
+	input_data.checkpoint = scene_name_load(header->checkpoint);
+	input_data.resume = 0;
+	input_data.n_threads = header->n_threads;
+	input_data.seed = header->seed;
+	input_data.number_of_updates = header->number_of_updates;
+	input_data.max_bounces = header->max_bounces;
+	input_data.background_color = header->background_color;
+	input_data.camera_position = header->camera_position;
+	input_data.camera_direction = header->camera_direction;
+	input_data.camera_angle = header->camera_angle;
+	input_data.target_noise = header->target_noise;
+	input_data.camera =
+		camera_new(&input_data.camera_position, &input_data.camera_direction,
+				   input_data.camera_angle, header->width, header->height,
+				   header->sqrt_ray_per_pixel);
+
+	ObjectVec* objects = &input_data.objects;
+	*objects = objectvec_new(n_objects);
+	const SceneMaterial* materials =
+		(const SceneMaterial*)(map + header->material_offset);
+	// copied as they are: object_vec_push_material() would merge equal ones
+	// and shift the indices after them
+	if (header->material_count > 0) {
+		objects->materials = malloc(sizeof(Material) * header->material_count);
+		if (objects->materials == NULL) {
+			fprintf(stderr, "Error: malloc failed in scene_file_load()\n");
+			exit(-1);
+		}
+		objects->material_capacity = header->material_count;
+	}
+	for (uint64_t i = 0; i < header->material_count; i++) {
+		Material* material = &objects->materials[objects->material_count++];
+		material->color = materials[i].color;
+		material->light_emitted = materials[i].light_emitted;
+		material->reflection = materials[i].reflection;
+	}
+	object_vec_reserve_vertices(objects, header->vertex_count);
+	if (header->vertex_count > 0)
+		memcpy(objects->vertices, map + header->vertex_offset,
+			   header->vertex_count * sizeof(Float3));
+	objects->vertex_count = header->vertex_count;
+
+	const SceneSphere* spheres =
+		(const SceneSphere*)(map + header->sphere_offset);
+	for (uint64_t i = 0; i < header->sphere_count; i++) {
+		scene_check_index(spheres[i].material, header->material_count,
+						  filename);
+		Shape shape;
+		shape.sphere = sphere_new(&spheres[i].center, spheres[i].radius);
+		const Object object =
+			object_new(TYPE_SPHERE, &shape, spheres[i].material);
+		object_vec_push(objects, &object);
+	}
+	const ScenePlane* planes = (const ScenePlane*)(map + header->plane_offset);
+	for (uint64_t i = 0; i < header->plane_count; i++) {
+		scene_check_index(planes[i].material, header->material_count, filename);
+		// already normalized: plane_new() would round it again
+		Shape shape;
+		shape.plane.normal = planes[i].normal;
+		shape.plane.d = planes[i].d;
+		const Object object = object_new(TYPE_PLANE, &shape, planes[i].material);
+		object_vec_push(objects, &object);
+	}
+	const SceneTriangle* triangles =
+		(const SceneTriangle*)(map + header->triangle_offset);
+	for (uint64_t i = 0; i < header->triangle_count; i++) {
+		const SceneTriangle* triangle = &triangles[i];
+		scene_check_index(triangle->material, header->material_count,
+						  filename);
+		Shape shape;
+		for (int v = 0; v < 3; v++) {
+			scene_check_index(triangle->v[v], header->vertex_count, filename);
+			shape.triangle.v[v] = triangle->v[v];
+		}
+		const Object object =
+			object_new(TYPE_TRIANGLE, &shape, triangle->material);
+		object_vec_push(objects, &object);
+	}
+	// pushed one by one: they are checked like the ones of a text scene
+	input_data.camera_path = camera_path_new();
+	const Keyframe* keys = (const Keyframe*)(map + header->keyframe_offset);
+	for (uint64_t i = 0; i < header->keyframe_count; i++)
+		camera_path_push(&input_data.camera_path, &keys[i]);
+	munmap(map, size);
+	return input_data;
+}
+
+void scene_name_save(char* dst, const char* name) {
+	if (name == NULL) return;
+	if (strlen(name) >= SCENE_NAME_LEN) {
+		fprintf(stderr, "Error: file name %s is too long\n", name);
+		exit(-1);
+	}
+	strcpy(dst, name);
+}
+
+char* scene_name_load(const char* src) {
+	const size_t len = strnlen(src, SCENE_NAME_LEN - 1);
+	char* name = malloc(len + 1);
+	if (name == NULL) {
+		fprintf(stderr, "Error: malloc failed in scene_file_load()\n");
+		exit(-1);
+	}
+	memcpy(name, src, len);
+	name[len] = '\0';
+	return name;
+}
+
+uint64_t scene_align(const uint64_t offset) {
+	return (offset + SCENE_ALIGN - 1) / SCENE_ALIGN * SCENE_ALIGN;
+}
+
+void scene_write(FILE* file, const void* data, const size_t size,
+				 const char* filename) {
+	if (size > 0 && fwrite(data, 1, size, file) != size) {
+		fprintf(stderr, "Error: can't write file %s\n", filename);
+		exit(-1);
+	}
+}
+
+// Zeros from the end of an array to the start of the next one
+void scene_pad(FILE* file, const uint64_t from, const uint64_t to,
+			   const char* filename) {
+	const char zeros[SCENE_ALIGN] = {0};
+	scene_write(file, zeros, to - from, filename);
+}
+
+// Whether a section lies in the file, at an offset its arrays can be read
+// at in place. `offset + count * element_size` is never computed: a crafted
+// header could make it wrap.
+int scene_fits(const uint64_t offset, const uint64_t count,
+			   const size_t element_size, const size_t size) {
+	return offset % SCENE_ALIGN == 0 && offset <= size &&
+		   count <= (size - offset) / element_size;
+}
+
+void scene_check_index(const uint32_t index, const uint64_t count,
+					   const char* filename) {
+	if (index >= count) {
+		fprintf(stderr, "Error: binary scene %s has an index out of range\n",
+				filename);
+		exit(-1);
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "scanner.h"
+
+// Binary scene: a fixed header with the render settings and the camera, then
+// one contiguous array per primitive type and one of camera keyframes. It is
+// mapped and the arrays are read in place, without any parsing. Spheres,
+// planes and triangles keep their order within each type, not across types.
+
+void scene_file_save(const char* filename, const InputData* input_data);
+InputData scene_file_load(const char* filename);
@@ -0,0 +1,243 @@
+#include "soa.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "algebra.h"
+#include "triangle.h"
+
+void soa_streams_new(float** streams[], const int count, const int capacity);
+int* soa_index_stream_new(const int capacity);
+
+SphereSoa sphere_soa_new(const int capacity) {
+	SphereSoa soa;
+	soa.size = 0;
+	soa.capacity = capacity;
+	float** streams[] = {&soa.center_x, &soa.center_y, &soa.center_z,
+						 &soa.radius2};
+	soa_streams_new(streams, 4, capacity);
+	soa.object = soa_index_stream_new(capacity);
+	return soa;
+}
+
+void sphere_soa_push(SphereSoa* soa, const Sphere* sphere, const int object) {
+	if (soa->size >= soa->capacity) {
+		fprintf(stderr, "Error: soa->size >= soa->capacity\n");
+		exit(-1);
+	}
+	const int i = soa->size++;
+	soa->center_x[i] = sphere->center.x;
+	soa->center_y[i] = sphere->center.y;
+	soa->center_z[i] = sphere->center.z;
+	soa->radius2[i] = sphere->radius * sphere->radius;
+	soa->object[i] = object;
+}
+
+void sphere_soa_free(SphereSoa* soa) {
+	free(soa->center_x);
+	free(soa->object);
+}
+
+TriangleSoa triangle_soa_new(const int capacity) {
+	TriangleSoa soa;
+	soa.size = 0;
+	soa.capacity = capacity;
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+	float** streams[] = {&soa.v0_x, &soa.v0_y, &soa.v0_z,
+						 &soa.v1_x, &soa.v1_y, &soa.v1_z,
+						 &soa.v2_x, &soa.v2_y, &soa.v2_z};
+#else
+	float** streams[] = {&soa.v0_x, &soa.v0_y, &soa.v0_z,
+						 &soa.e1_x, &soa.e1_y, &soa.e1_z,
+						 &soa.e2_x, &soa.e2_y, &soa.e2_z};
+#endif
+	soa_streams_new(streams, 9, capacity);
+	soa.object = soa_index_stream_new(capacity);
+	return soa;
+}
+
+void triangle_soa_push(TriangleSoa* soa, const Float3* p1, const Float3* p2,
+					   const Float3* p3, const int object) {
+	if (soa->size >= soa->capacity) {
+		fprintf(stderr, "Error: soa->size >= soa->capacity\n");
+		exit(-1);
+	}
+	const int i = soa->size++;
+	soa->v0_x[i] = p1->x;
+	soa->v0_y[i] = p1->y;
+	soa->v0_z[i] = p1->z;
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+	soa->v1_x[i] = p2->x;
+	soa->v1_y[i] = p2->y;
+	soa->v1_z[i] = p2->z;
+	soa->v2_x[i] = p3->x;
+	soa->v2_y[i] = p3->y;
+	soa->v2_z[i] = p3->z;
+#else
+	const Float3 e1 = float3_sub(p2, p1);
+	const Float3 e2 = float3_sub(p3, p1);
+	soa->e1_x[i] = e1.x;
+	soa->e1_y[i] = e1.y;
+	soa->e1_z[i] = e1.z;
+	soa->e2_x[i] = e2.x;
+	soa->e2_y[i] = e2.y;
+	soa->e2_z[i] = e2.z;
+#endif
+	soa->object[i] = object;
+}
+
+void triangle_soa_free(TriangleSoa* soa) {
+	free(soa->v0_x);
+	free(soa->object);
+}
+
+// Points each of `streams` into one 64 byte aligned, zero filled block,
+// padding included, every stream on its own cache lines. The first stream is
+// the block, to free.
+void soa_streams_new(float** streams[], const int count, const int capacity) {
+	const size_t stride =
+		((capacity + SOA_PADDING) * sizeof(float) + 63) & ~(size_t)63;
+	float* block = aligned_alloc(64, stride * count);
+	if (block == NULL) {
+		fprintf(stderr, "Error: aligned_alloc failed in soa_streams_new()\n");
+		exit(-1);
+	}
+	memset(block, 0, stride * count);
+	for (int i = 0; i < count; i++)
+		*streams[i] = block + i * (stride / sizeof(float));
+}
+
+int* soa_index_stream_new(const int capacity) {
+	int* stream = malloc(sizeof(int) * (capacity + SOA_PADDING));
+	if (stream == NULL) {
+		fprintf(stderr, "Error: malloc failed in soa_index_stream_new()\n");
+		exit(-1);
+	}
+	return stream;
+}
+
+SoaHit soa_hit_new() {
+	SoaHit hit;
+	hit.distance = INFINITY;
+	hit.object = -1;
+	hit.any = 0;
+	return hit;
+}
+
+// Ties go to the lowest object, as a linear scan over the ObjectVec would do,
+// so the result does not depend on the order primitives are tested in.
+void soa_hit_update(SoaHit* hit, const float distance, const int object) {
+	if (distance > 0 &&
+		(distance < hit->distance ||
+		 (distance == hit->distance && object < hit->object))) {
+		hit->distance = distance;
+		hit->object = object;
+	}
+}
+
+int intersect_kernels_best_type() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return KERNELS_AVX2;
+	if (__builtin_cpu_supports("sse2")) return KERNELS_SSE;
+#endif
+	return KERNELS_SCALAR;
+}
+
+IntersectKernels intersect_kernels(const int type) {
+	IntersectKernels kernels;
+	kernels.name = "scalar";
+	kernels.type = KERNELS_SCALAR;
+	kernels.spheres = spheres_intersect_scalar;
+	kernels.triangles = triangles_intersect_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	if (type == KERNELS_SSE) {
+		kernels.name = "sse";
+		kernels.type = KERNELS_SSE;
+		kernels.spheres = spheres_intersect_sse;
+		kernels.triangles = triangles_intersect_sse;
+	} else if (type == KERNELS_AVX2) {
+		kernels.name = "avx2";
+		kernels.type = KERNELS_AVX2;
+		kernels.spheres = spheres_intersect_avx2;
+		kernels.triangles = triangles_intersect_avx2;
+	}
+#else
+	(void)type;
+#endif
+	return kernels;
+}
+
+void spheres_intersect_scalar(const SphereSoa* soa, const int first,
+							  const int count, const Ray3* ray, SoaHit* hit) {
+	const Float3* o = &ray->origin;
+	const Float3* d = &ray->direction;
+	const float a = float3_dot(d, d);
+	const float inv_2a = 0.5f / a;
+	for (int i = first; i < first + count; i++) {
+		const float px = o->x - soa->center_x[i];
+		const float py = o->y - soa->center_y[i];
+		const float pz = o->z - soa->center_z[i];
+		const float b = 2 * (px * d->x + py * d->y + pz * d->z);
+		const float c = px * px + py * py + pz * pz - soa->radius2[i];
+		const float discriminant = b * b - 4 * a * c;
+		if (discriminant < 0) continue;
+		const float sqrt_discriminant = sqrtf(discriminant);
+		const float near = (-b - sqrt_discriminant) * inv_2a;
+		const float distance =
+			near > 0 ? near : (-b + sqrt_discriminant) * inv_2a;
+		soa_hit_update(hit, distance, soa->object[i]);
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+void triangles_intersect_scalar(const TriangleSoa* soa, const int first,
+								const int count, const Ray3* ray, SoaHit* hit) {
+	const RayShear shear = ray_shear_new(ray);
+	TriangleHit triangle_hit;
+	for (int i = first; i < first + count; i++) {
+		const Float3 v0 = float3_new(soa->v0_x[i], soa->v0_y[i], soa->v0_z[i]);
+		const Float3 v1 = float3_new(soa->v1_x[i], soa->v1_y[i], soa->v1_z[i]);
+		const Float3 v2 = float3_new(soa->v2_x[i], soa->v2_y[i], soa->v2_z[i]);
+		if (!triangle_intersect_watertight(&v0, &v1, &v2, ray, &shear,
+										   &triangle_hit))
+			continue;
+		soa_hit_update(hit, triangle_hit.distance, soa->object[i]);
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+#else
+// Möller–Trumbore on the precomputed edges e1 = p2 - p1, e2 = p3 - p1.
+void triangles_intersect_scalar(const TriangleSoa* soa, const int first,
+								const int count, const Ray3* ray, SoaHit* hit) {
+	const Float3* o = &ray->origin;
+	const Float3* d = &ray->direction;
+	for (int i = first; i < first + count; i++) {
+		const float e1x = soa->e1_x[i], e1y = soa->e1_y[i], e1z = soa->e1_z[i];
+		const float e2x = soa->e2_x[i], e2y = soa->e2_y[i], e2z = soa->e2_z[i];
+		const float px = d->y * e2z - d->z * e2y;
+		const float py = d->z * e2x - d->x * e2z;
+		const float pz = d->x * e2y - d->y * e2x;
+		const float det = e1x * px + e1y * py + e1z * pz;
+		if (fabsf(det) < TRIANGLE_DET_EPSILON) continue;
+		const float inv_det = 1.0f / det;
+		const float tx = o->x - soa->v0_x[i];
+		const float ty = o->y - soa->v0_y[i];
+		const float tz = o->z - soa->v0_z[i];
+		const float u = (tx * px + ty * py + tz * pz) * inv_det;
+		if (u < 0 || u > 1) continue;
+		const float qx = ty * e1z - tz * e1y;
+		const float qy = tz * e1x - tx * e1z;
+		const float qz = tx * e1y - ty * e1x;
+		const float v = (d->x * qx + d->y * qy + d->z * qz) * inv_det;
+		if (v < 0 || u + v > 1) continue;
+		const float distance = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+		soa_hit_update(hit, distance, soa->object[i]);
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+#endif
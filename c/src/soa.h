@@ -0,0 +1,87 @@
+#pragma once
+
+#include "object.h"
+#include "ray.h"
+#include "sphere.h"
+#include "triangle.h"
+
+// Bounded primitives copied out of the ObjectVec (in BVH leaf order), one
+// float stream per component, so a leaf is read with contiguous loads. The
+// streams of a SoA are packed in one 64 byte aligned block, each starting on
+// a cache line. Every stream has SOA_PADDING zeroed slots past `size`, so the
+// SIMD kernels can always load whole vectors.
+#define SOA_PADDING 8
+
+#define KERNELS_SCALAR 0
+#define KERNELS_SSE 1
+#define KERNELS_AVX2 2
+
+typedef struct _SphereSoa {
+	float *center_x, *center_y, *center_z, *radius2;
+	int* object;
+	int size, capacity;
+} SphereSoa;
+
+// Watertight kernels need the vertices exactly as given (shared edges must be
+// bit-identical), the Möller–Trumbore ones v0 and the edges e1, e2. The
+// projection build has no SIMD version and uses Möller–Trumbore in the leaves.
+typedef struct _TriangleSoa {
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+	float *v0_x, *v0_y, *v0_z, *v1_x, *v1_y, *v1_z, *v2_x, *v2_y, *v2_z;
+#else
+	float *v0_x, *v0_y, *v0_z, *e1_x, *e1_y, *e1_z, *e2_x, *e2_y, *e2_z;
+#endif
+	int* object;
+	int size, capacity;
+} TriangleSoa;
+
+// The nearest hit so far: hits further than `distance` are ignored. `object`
+// is an index in the ObjectVec, -1 while nothing has been hit. With `any`, the
+// kernels return as soon as something is: occlusion tests don't need the
+// nearest.
+typedef struct _SoaHit {
+	float distance;
+	int object, any;
+} SoaHit;
+
+// Test soa[first, first + count) against `ray` and update `hit`.
+typedef void (*SphereKernel)(const SphereSoa* soa, const int first,
+							 const int count, const Ray3* ray, SoaHit* hit);
+typedef void (*TriangleKernel)(const TriangleSoa* soa, const int first,
+							   const int count, const Ray3* ray, SoaHit* hit);
+
+typedef struct _IntersectKernels {
+	const char* name;
+	int type;
+	SphereKernel spheres;
+	TriangleKernel triangles;
+} IntersectKernels;
+
+SphereSoa sphere_soa_new(const int capacity);
+void sphere_soa_push(SphereSoa* soa, const Sphere* sphere, const int object);
+void sphere_soa_free(SphereSoa* soa);
+TriangleSoa triangle_soa_new(const int capacity);
+void triangle_soa_push(TriangleSoa* soa, const Float3* p1, const Float3* p2,
+					   const Float3* p3, const int object);
+void triangle_soa_free(TriangleSoa* soa);
+
+SoaHit soa_hit_new();
+void soa_hit_update(SoaHit* hit, const float distance, const int object);
+
+int intersect_kernels_best_type();
+IntersectKernels intersect_kernels(const int type);
+
+void spheres_intersect_scalar(const SphereSoa* soa, const int first,
+							  const int count, const Ray3* ray, SoaHit* hit);
+void triangles_intersect_scalar(const TriangleSoa* soa, const int first,
+								const int count, const Ray3* ray, SoaHit* hit);
+#if defined(__x86_64__) || defined(__i386__)
+void spheres_intersect_sse(const SphereSoa* soa, const int first,
+						   const int count, const Ray3* ray, SoaHit* hit);
+void triangles_intersect_sse(const TriangleSoa* soa, const int first,
+							 const int count, const Ray3* ray, SoaHit* hit);
+void spheres_intersect_avx2(const SphereSoa* soa, const int first,
+							const int count, const Ray3* ray, SoaHit* hit);
+void triangles_intersect_avx2(const TriangleSoa* soa, const int first,
+							  const int count, const Ray3* ray, SoaHit* hit);
+#endif
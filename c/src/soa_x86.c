@@ -0,0 +1,433 @@
+#include "soa.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Same math as the scalar kernels in soa.c, 4 (SSE) or 8 (AVX2) primitives at
+// a time. Candidate lanes go through soa_hit_update(), which also takes care
+// of ties. Built with target attributes: the AVX2 ones must only run where
+// intersect_kernels_best_type() says so.
+
+int soa_lane_mask(const int first, const int count, const int i,
+				  const int width) {
+	const int left = first + count - i;
+	return left >= width ? (1 << width) - 1 : (1 << left) - 1;
+}
+
+__attribute__((target("sse2"))) void spheres_intersect_sse(
+	const SphereSoa* soa, const int first, const int count, const Ray3* ray,
+	SoaHit* hit) {
+	const __m128 ox = _mm_set1_ps(ray->origin.x);
+	const __m128 oy = _mm_set1_ps(ray->origin.y);
+	const __m128 oz = _mm_set1_ps(ray->origin.z);
+	const __m128 dx = _mm_set1_ps(ray->direction.x);
+	const __m128 dy = _mm_set1_ps(ray->direction.y);
+	const __m128 dz = _mm_set1_ps(ray->direction.z);
+	const float a = ray->direction.x * ray->direction.x +
+					ray->direction.y * ray->direction.y +
+					ray->direction.z * ray->direction.z;
+	const __m128 four_a = _mm_set1_ps(4 * a);
+	const __m128 inv_2a = _mm_set1_ps(0.5f / a);
+	const __m128 zero = _mm_setzero_ps();
+	float distances[4];
+	for (int i = first; i < first + count; i += 4) {
+		const __m128 px = _mm_sub_ps(ox, _mm_loadu_ps(soa->center_x + i));
+		const __m128 py = _mm_sub_ps(oy, _mm_loadu_ps(soa->center_y + i));
+		const __m128 pz = _mm_sub_ps(oz, _mm_loadu_ps(soa->center_z + i));
+		const __m128 half_b = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(px, dx), _mm_mul_ps(py, dy)),
+			_mm_mul_ps(pz, dz));
+		const __m128 b = _mm_add_ps(half_b, half_b);
+		const __m128 c = _mm_sub_ps(
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)),
+					   _mm_mul_ps(pz, pz)),
+			_mm_loadu_ps(soa->radius2 + i));
+		const __m128 discriminant =
+			_mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(four_a, c));
+		int mask = _mm_movemask_ps(_mm_cmpge_ps(discriminant, zero)) &
+				   soa_lane_mask(first, count, i, 4);
+		if (mask == 0) continue;
+		const __m128 sqrt_discriminant = _mm_sqrt_ps(discriminant);
+		const __m128 near =
+			_mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, b), sqrt_discriminant), inv_2a);
+		const __m128 far =
+			_mm_mul_ps(_mm_add_ps(_mm_sub_ps(zero, b), sqrt_discriminant), inv_2a);
+		const __m128 use_near = _mm_cmpgt_ps(near, zero);
+		const __m128 distance = _mm_or_ps(_mm_and_ps(use_near, near),
+										  _mm_andnot_ps(use_near, far));
+		mask &= _mm_movemask_ps(_mm_cmpgt_ps(distance, zero)) &
+				_mm_movemask_ps(
+					_mm_cmple_ps(distance, _mm_set1_ps(hit->distance)));
+		if (mask == 0) continue;
+		_mm_storeu_ps(distances, distance);
+		for (; mask != 0; mask &= mask - 1) {
+			const int lane = __builtin_ctz(mask);
+			soa_hit_update(hit, distances[lane], soa->object[i + lane]);
+		}
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+// Watertight test as in triangle.c. No fma: the edge functions of two
+// triangles sharing an edge must round the same way. Lanes where an edge
+// function is exactly 0 are redone by the scalar version, which has the
+// double precision fallback.
+__attribute__((target("sse2"))) void triangles_intersect_sse(
+	const TriangleSoa* soa, const int first, const int count, const Ray3* ray,
+	SoaHit* hit) {
+	const RayShear shear = ray_shear_new(ray);
+	const float* v0[3] = {soa->v0_x, soa->v0_y, soa->v0_z};
+	const float* v1[3] = {soa->v1_x, soa->v1_y, soa->v1_z};
+	const float* v2[3] = {soa->v2_x, soa->v2_y, soa->v2_z};
+	const __m128 ox = _mm_set1_ps(float3_axis(&ray->origin, shear.kx));
+	const __m128 oy = _mm_set1_ps(float3_axis(&ray->origin, shear.ky));
+	const __m128 oz = _mm_set1_ps(float3_axis(&ray->origin, shear.kz));
+	const __m128 sx = _mm_set1_ps(shear.sx);
+	const __m128 sy = _mm_set1_ps(shear.sy);
+	const __m128 sz = _mm_set1_ps(shear.sz);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	float distances[4];
+	for (int i = first; i < first + count; i += 4) {
+		const __m128 az = _mm_sub_ps(_mm_loadu_ps(v0[shear.kz] + i), oz);
+		const __m128 bz = _mm_sub_ps(_mm_loadu_ps(v1[shear.kz] + i), oz);
+		const __m128 cz = _mm_sub_ps(_mm_loadu_ps(v2[shear.kz] + i), oz);
+		const __m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(v0[shear.kx] + i), ox),
+									 _mm_mul_ps(sx, az));
+		const __m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(v0[shear.ky] + i), oy),
+									 _mm_mul_ps(sy, az));
+		const __m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(v1[shear.kx] + i), ox),
+									 _mm_mul_ps(sx, bz));
+		const __m128 by = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(v1[shear.ky] + i), oy),
+									 _mm_mul_ps(sy, bz));
+		const __m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(v2[shear.kx] + i), ox),
+									 _mm_mul_ps(sx, cz));
+		const __m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(v2[shear.ky] + i), oy),
+									 _mm_mul_ps(sy, cz));
+		const __m128 w1 = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+		const __m128 w2 = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+		const __m128 w3 = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+		const __m128 any_negative =
+			_mm_or_ps(_mm_or_ps(_mm_cmplt_ps(w1, zero), _mm_cmplt_ps(w2, zero)),
+					  _mm_cmplt_ps(w3, zero));
+		const __m128 any_positive =
+			_mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(w1, zero), _mm_cmpgt_ps(w2, zero)),
+					  _mm_cmpgt_ps(w3, zero));
+		const __m128 any_zero =
+			_mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(w1, zero), _mm_cmpeq_ps(w2, zero)),
+					  _mm_cmpeq_ps(w3, zero));
+		const __m128 det = _mm_add_ps(_mm_add_ps(w1, w2), w3);
+		const __m128 distance = _mm_mul_ps(
+			_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w1, az),
+											 _mm_mul_ps(w2, bz)),
+								  _mm_mul_ps(w3, cz)),
+					   sz),
+			_mm_div_ps(one, det));
+		__m128 valid = _mm_andnot_ps(_mm_and_ps(any_negative, any_positive),
+									 _mm_cmpneq_ps(det, zero));
+		valid = _mm_and_ps(valid, _mm_cmpgt_ps(distance, zero));
+		valid = _mm_and_ps(
+			valid, _mm_cmple_ps(distance, _mm_set1_ps(hit->distance)));
+		const int lanes = soa_lane_mask(first, count, i, 4);
+		const int exact = _mm_movemask_ps(any_zero) & lanes;
+		int mask = _mm_movemask_ps(valid) & lanes & ~exact;
+		if (exact != 0)
+			for (int left = exact; left != 0; left &= left - 1)
+				triangles_intersect_scalar(soa, i + __builtin_ctz(left), 1, ray,
+										   hit);
+		if (mask == 0) continue;
+		_mm_storeu_ps(distances, distance);
+		for (; mask != 0; mask &= mask - 1) {
+			const int lane = __builtin_ctz(mask);
+			soa_hit_update(hit, distances[lane], soa->object[i + lane]);
+		}
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+
+#else
+__attribute__((target("sse2"))) void triangles_intersect_sse(
+	const TriangleSoa* soa, const int first, const int count, const Ray3* ray,
+	SoaHit* hit) {
+	const __m128 ox = _mm_set1_ps(ray->origin.x);
+	const __m128 oy = _mm_set1_ps(ray->origin.y);
+	const __m128 oz = _mm_set1_ps(ray->origin.z);
+	const __m128 dx = _mm_set1_ps(ray->direction.x);
+	const __m128 dy = _mm_set1_ps(ray->direction.y);
+	const __m128 dz = _mm_set1_ps(ray->direction.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 epsilon = _mm_set1_ps(TRIANGLE_DET_EPSILON);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	float distances[4];
+	for (int i = first; i < first + count; i += 4) {
+		const __m128 e1x = _mm_loadu_ps(soa->e1_x + i);
+		const __m128 e1y = _mm_loadu_ps(soa->e1_y + i);
+		const __m128 e1z = _mm_loadu_ps(soa->e1_z + i);
+		const __m128 e2x = _mm_loadu_ps(soa->e2_x + i);
+		const __m128 e2y = _mm_loadu_ps(soa->e2_y + i);
+		const __m128 e2z = _mm_loadu_ps(soa->e2_z + i);
+		const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		const __m128 det = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+			_mm_mul_ps(e1z, pz));
+		const __m128 inv_det = _mm_div_ps(one, det);
+		const __m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(soa->v0_x + i));
+		const __m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(soa->v0_y + i));
+		const __m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(soa->v0_z + i));
+		const __m128 u = _mm_mul_ps(
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)),
+					   _mm_mul_ps(tz, pz)),
+			inv_det);
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		const __m128 v = _mm_mul_ps(
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+					   _mm_mul_ps(dz, qz)),
+			inv_det);
+		const __m128 distance = _mm_mul_ps(
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+					   _mm_mul_ps(e2z, qz)),
+			inv_det);
+		__m128 valid = _mm_cmpge_ps(_mm_andnot_ps(sign, det), epsilon);
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+		valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+		valid = _mm_and_ps(valid, _mm_cmpgt_ps(distance, zero));
+		valid = _mm_and_ps(
+			valid, _mm_cmple_ps(distance, _mm_set1_ps(hit->distance)));
+		int mask = _mm_movemask_ps(valid) & soa_lane_mask(first, count, i, 4);
+		if (mask == 0) continue;
+		_mm_storeu_ps(distances, distance);
+		for (; mask != 0; mask &= mask - 1) {
+			const int lane = __builtin_ctz(mask);
+			soa_hit_update(hit, distances[lane], soa->object[i + lane]);
+		}
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+#endif
+
+__attribute__((target("avx2,fma"))) void spheres_intersect_avx2(
+	const SphereSoa* soa, const int first, const int count, const Ray3* ray,
+	SoaHit* hit) {
+	const __m256 ox = _mm256_set1_ps(ray->origin.x);
+	const __m256 oy = _mm256_set1_ps(ray->origin.y);
+	const __m256 oz = _mm256_set1_ps(ray->origin.z);
+	const __m256 dx = _mm256_set1_ps(ray->direction.x);
+	const __m256 dy = _mm256_set1_ps(ray->direction.y);
+	const __m256 dz = _mm256_set1_ps(ray->direction.z);
+	const float a = ray->direction.x * ray->direction.x +
+					ray->direction.y * ray->direction.y +
+					ray->direction.z * ray->direction.z;
+	const __m256 four_a = _mm256_set1_ps(4 * a);
+	const __m256 inv_2a = _mm256_set1_ps(0.5f / a);
+	const __m256 zero = _mm256_setzero_ps();
+	float distances[8];
+	for (int i = first; i < first + count; i += 8) {
+		const __m256 px = _mm256_sub_ps(ox, _mm256_loadu_ps(soa->center_x + i));
+		const __m256 py = _mm256_sub_ps(oy, _mm256_loadu_ps(soa->center_y + i));
+		const __m256 pz = _mm256_sub_ps(oz, _mm256_loadu_ps(soa->center_z + i));
+		const __m256 half_b = _mm256_fmadd_ps(
+			pz, dz, _mm256_fmadd_ps(py, dy, _mm256_mul_ps(px, dx)));
+		const __m256 b = _mm256_add_ps(half_b, half_b);
+		const __m256 c = _mm256_sub_ps(
+			_mm256_fmadd_ps(pz, pz,
+							_mm256_fmadd_ps(py, py, _mm256_mul_ps(px, px))),
+			_mm256_loadu_ps(soa->radius2 + i));
+		const __m256 discriminant =
+			_mm256_fnmadd_ps(four_a, c, _mm256_mul_ps(b, b));
+		int mask = _mm256_movemask_ps(
+					   _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ)) &
+				   soa_lane_mask(first, count, i, 8);
+		if (mask == 0) continue;
+		const __m256 sqrt_discriminant = _mm256_sqrt_ps(discriminant);
+		const __m256 minus_b = _mm256_sub_ps(zero, b);
+		const __m256 near =
+			_mm256_mul_ps(_mm256_sub_ps(minus_b, sqrt_discriminant), inv_2a);
+		const __m256 far =
+			_mm256_mul_ps(_mm256_add_ps(minus_b, sqrt_discriminant), inv_2a);
+		const __m256 distance =
+			_mm256_blendv_ps(far, near, _mm256_cmp_ps(near, zero, _CMP_GT_OQ));
+		mask &= _mm256_movemask_ps(_mm256_and_ps(
+			_mm256_cmp_ps(distance, zero, _CMP_GT_OQ),
+			_mm256_cmp_ps(distance, _mm256_set1_ps(hit->distance),
+						  _CMP_LE_OQ)));
+		if (mask == 0) continue;
+		_mm256_storeu_ps(distances, distance);
+		for (; mask != 0; mask &= mask - 1) {
+			const int lane = __builtin_ctz(mask);
+			soa_hit_update(hit, distances[lane], soa->object[i + lane]);
+		}
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_WATERTIGHT
+// Same as the SSE version. Built without "fma" so that the compiler can't
+// contract the edge functions either.
+__attribute__((target("avx2"))) void triangles_intersect_avx2(
+	const TriangleSoa* soa, const int first, const int count, const Ray3* ray,
+	SoaHit* hit) {
+	const RayShear shear = ray_shear_new(ray);
+	const float* v0[3] = {soa->v0_x, soa->v0_y, soa->v0_z};
+	const float* v1[3] = {soa->v1_x, soa->v1_y, soa->v1_z};
+	const float* v2[3] = {soa->v2_x, soa->v2_y, soa->v2_z};
+	const __m256 ox = _mm256_set1_ps(float3_axis(&ray->origin, shear.kx));
+	const __m256 oy = _mm256_set1_ps(float3_axis(&ray->origin, shear.ky));
+	const __m256 oz = _mm256_set1_ps(float3_axis(&ray->origin, shear.kz));
+	const __m256 sx = _mm256_set1_ps(shear.sx);
+	const __m256 sy = _mm256_set1_ps(shear.sy);
+	const __m256 sz = _mm256_set1_ps(shear.sz);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	float distances[8];
+	for (int i = first; i < first + count; i += 8) {
+		const __m256 az = _mm256_sub_ps(_mm256_loadu_ps(v0[shear.kz] + i), oz);
+		const __m256 bz = _mm256_sub_ps(_mm256_loadu_ps(v1[shear.kz] + i), oz);
+		const __m256 cz = _mm256_sub_ps(_mm256_loadu_ps(v2[shear.kz] + i), oz);
+		const __m256 ax =
+			_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(v0[shear.kx] + i), ox),
+						  _mm256_mul_ps(sx, az));
+		const __m256 ay =
+			_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(v0[shear.ky] + i), oy),
+						  _mm256_mul_ps(sy, az));
+		const __m256 bx =
+			_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(v1[shear.kx] + i), ox),
+						  _mm256_mul_ps(sx, bz));
+		const __m256 by =
+			_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(v1[shear.ky] + i), oy),
+						  _mm256_mul_ps(sy, bz));
+		const __m256 cx =
+			_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(v2[shear.kx] + i), ox),
+						  _mm256_mul_ps(sx, cz));
+		const __m256 cy =
+			_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(v2[shear.ky] + i), oy),
+						  _mm256_mul_ps(sy, cz));
+		const __m256 w1 =
+			_mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+		const __m256 w2 =
+			_mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+		const __m256 w3 =
+			_mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+		const __m256 any_negative = _mm256_or_ps(
+			_mm256_or_ps(_mm256_cmp_ps(w1, zero, _CMP_LT_OQ),
+						 _mm256_cmp_ps(w2, zero, _CMP_LT_OQ)),
+			_mm256_cmp_ps(w3, zero, _CMP_LT_OQ));
+		const __m256 any_positive = _mm256_or_ps(
+			_mm256_or_ps(_mm256_cmp_ps(w1, zero, _CMP_GT_OQ),
+						 _mm256_cmp_ps(w2, zero, _CMP_GT_OQ)),
+			_mm256_cmp_ps(w3, zero, _CMP_GT_OQ));
+		const __m256 any_zero = _mm256_or_ps(
+			_mm256_or_ps(_mm256_cmp_ps(w1, zero, _CMP_EQ_OQ),
+						 _mm256_cmp_ps(w2, zero, _CMP_EQ_OQ)),
+			_mm256_cmp_ps(w3, zero, _CMP_EQ_OQ));
+		const __m256 det = _mm256_add_ps(_mm256_add_ps(w1, w2), w3);
+		const __m256 distance = _mm256_mul_ps(
+			_mm256_mul_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w1, az),
+											_mm256_mul_ps(w2, bz)),
+							  _mm256_mul_ps(w3, cz)),
+				sz),
+			_mm256_div_ps(one, det));
+		__m256 valid =
+			_mm256_andnot_ps(_mm256_and_ps(any_negative, any_positive),
+							 _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+		valid =
+			_mm256_and_ps(valid, _mm256_cmp_ps(distance, zero, _CMP_GT_OQ));
+		valid = _mm256_and_ps(
+			valid, _mm256_cmp_ps(distance, _mm256_set1_ps(hit->distance),
+								 _CMP_LE_OQ));
+		const int lanes = soa_lane_mask(first, count, i, 8);
+		const int exact = _mm256_movemask_ps(any_zero) & lanes;
+		int mask = _mm256_movemask_ps(valid) & lanes & ~exact;
+		if (exact != 0)
+			for (int left = exact; left != 0; left &= left - 1)
+				triangles_intersect_scalar(soa, i + __builtin_ctz(left), 1, ray,
+										   hit);
+		if (mask == 0) continue;
+		_mm256_storeu_ps(distances, distance);
+		for (; mask != 0; mask &= mask - 1) {
+			const int lane = __builtin_ctz(mask);
+			soa_hit_update(hit, distances[lane], soa->object[i + lane]);
+		}
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+
+#else
+__attribute__((target("avx2,fma"))) void triangles_intersect_avx2(
+	const TriangleSoa* soa, const int first, const int count, const Ray3* ray,
+	SoaHit* hit) {
+	const __m256 ox = _mm256_set1_ps(ray->origin.x);
+	const __m256 oy = _mm256_set1_ps(ray->origin.y);
+	const __m256 oz = _mm256_set1_ps(ray->origin.z);
+	const __m256 dx = _mm256_set1_ps(ray->direction.x);
+	const __m256 dy = _mm256_set1_ps(ray->direction.y);
+	const __m256 dz = _mm256_set1_ps(ray->direction.z);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 epsilon = _mm256_set1_ps(TRIANGLE_DET_EPSILON);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	float distances[8];
+	for (int i = first; i < first + count; i += 8) {
+		const __m256 e1x = _mm256_loadu_ps(soa->e1_x + i);
+		const __m256 e1y = _mm256_loadu_ps(soa->e1_y + i);
+		const __m256 e1z = _mm256_loadu_ps(soa->e1_z + i);
+		const __m256 e2x = _mm256_loadu_ps(soa->e2_x + i);
+		const __m256 e2y = _mm256_loadu_ps(soa->e2_y + i);
+		const __m256 e2z = _mm256_loadu_ps(soa->e2_z + i);
+		const __m256 px = _mm256_fmsub_ps(dy, e2z, _mm256_mul_ps(dz, e2y));
+		const __m256 py = _mm256_fmsub_ps(dz, e2x, _mm256_mul_ps(dx, e2z));
+		const __m256 pz = _mm256_fmsub_ps(dx, e2y, _mm256_mul_ps(dy, e2x));
+		const __m256 det = _mm256_fmadd_ps(
+			e1z, pz, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1x, px)));
+		const __m256 inv_det = _mm256_div_ps(one, det);
+		const __m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(soa->v0_x + i));
+		const __m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(soa->v0_y + i));
+		const __m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(soa->v0_z + i));
+		const __m256 u = _mm256_mul_ps(
+			_mm256_fmadd_ps(tz, pz,
+							_mm256_fmadd_ps(ty, py, _mm256_mul_ps(tx, px))),
+			inv_det);
+		const __m256 qx = _mm256_fmsub_ps(ty, e1z, _mm256_mul_ps(tz, e1y));
+		const __m256 qy = _mm256_fmsub_ps(tz, e1x, _mm256_mul_ps(tx, e1z));
+		const __m256 qz = _mm256_fmsub_ps(tx, e1y, _mm256_mul_ps(ty, e1x));
+		const __m256 v = _mm256_mul_ps(
+			_mm256_fmadd_ps(dz, qz,
+							_mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dx, qx))),
+			inv_det);
+		const __m256 distance = _mm256_mul_ps(
+			_mm256_fmadd_ps(e2z, qz,
+							_mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2x, qx))),
+			inv_det);
+		__m256 valid =
+			_mm256_cmp_ps(_mm256_andnot_ps(sign, det), epsilon, _CMP_GE_OQ);
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(
+			valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+		valid =
+			_mm256_and_ps(valid, _mm256_cmp_ps(distance, zero, _CMP_GT_OQ));
+		valid = _mm256_and_ps(
+			valid, _mm256_cmp_ps(distance, _mm256_set1_ps(hit->distance),
+								 _CMP_LE_OQ));
+		int mask =
+			_mm256_movemask_ps(valid) & soa_lane_mask(first, count, i, 8);
+		if (mask == 0) continue;
+		_mm256_storeu_ps(distances, distance);
+		for (; mask != 0; mask &= mask - 1) {
+			const int lane = __builtin_ctz(mask);
+			soa_hit_update(hit, distances[lane], soa->object[i + lane]);
+		}
+		if (hit->any && hit->object >= 0) return;
+	}
+}
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <math.h>
 
+#include "aabb.h"
 #include "algebra.h"
 
 Sphere sphere_new(const Float3* center, const float radius) {
@@ -29,3 +30,21 @@ Float3 sphere_normal_normalized(const void* sphere, const Float3* point) {
 	Float3 normal = float3_sub(point, &sph->center);
 	return float3_normalize(&normal);
 }
+
+// The point of the surface nearest to `point`. A hit found from far away
+// can be off the surface by more than a ray can safely start from.
+Float3 sphere_project(const Sphere* sphere, const Float3* point) {
+	Float3 projected = sphere_normal_normalized(sphere, point);
+	float3_mul_eq(&projected, sphere->radius);
+	float3_add_eq(&projected, &sphere->center);
+	return projected;
+}
+
+Aabb sphere_bounds(const Sphere* sphere) {
+	const Float3 radius =
+		float3_new(sphere->radius, sphere->radius, sphere->radius);
+	Aabb bounds;
+	bounds.min = float3_sub(&sphere->center, &radius);
+	bounds.max = float3_add(&sphere->center, &radius);
+	return bounds;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "aabb.h"
 #include "algebra.h"
 #include "ray.h"
 
@@ -12,3 +13,5 @@ Sphere sphere_new(const Float3* center, const float radius);
 
 float sphere_intersect_distance(const void* sphere, const Ray3* ray);
 Float3 sphere_normal_normalized(const void* sphere, const Float3* point);
+Float3 sphere_project(const Sphere* sphere, const Float3* point);
+Aabb sphere_bounds(const Sphere* sphere);
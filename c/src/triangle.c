@@ -2,17 +2,27 @@
 
 #include <math.h>
 
+#include "aabb.h"
 #include "algebra.h"
 #include "plane.h"
 
+#if TRIANGLE_INTERSECT == TRIANGLE_PROJECTION
 #define XY 1
 #define YZ 2
 #define ZX 3
 int projection_type(const Plane* plane);
+int triangle_intersect_projection(const Triangle* tri, const Ray3* ray,
+								  TriangleHit* hit);
+#endif
 
 Triangle triangle_new(const Float3* p1, const Float3* p2, const Float3* p3) {
-	const Plane plane = plane_from_points(p1, p2, p3);
-	const int projection = projection_type(&plane);
+	Triangle triangle;
+	triangle.plane = plane_from_points(p1, p2, p3);
+	triangle.p1 = *p1;
+	triangle.p2 = *p2;
+	triangle.p3 = *p3;
+#if TRIANGLE_INTERSECT == TRIANGLE_PROJECTION
+	const int projection = projection_type(&triangle.plane);
 	Float2 v1, v2, v3;
 	if (projection == XY) {
 		v1 = float2_new(p1->x, p1->y);
@@ -36,20 +46,43 @@ Triangle triangle_new(const Float3* p1, const Float3* p2, const Float3* p3) {
 		v3 = tmp;
 	}
 	Float2 tmp = float2_sub(&v2, &v1);
-	Ray2 r1 = ray2_new(&v1, &tmp);
+	triangle.r1 = ray2_new(&v1, &tmp);
 	tmp = float2_sub(&v3, &v2);
-	Ray2 r2 = ray2_new(&v2, &tmp);
+	triangle.r2 = ray2_new(&v2, &tmp);
 	tmp = float2_sub(&v1, &v3);
-	Ray2 r3 = ray2_new(&v3, &tmp);
-
-	Triangle triangle;
-	triangle.plane = plane;
-	triangle.r1 = r1;
-	triangle.r2 = r2;
-	triangle.r3 = r3;
+	triangle.r3 = ray2_new(&v3, &tmp);
+	triangle.projection = projection;
+#elif TRIANGLE_INTERSECT == TRIANGLE_MOLLER
+	triangle.e1 = float3_sub(p2, p1);
+	triangle.e2 = float3_sub(p3, p1);
+#endif
 	return triangle;
 }
 
+// Returns 1 and fills `hit` if the ray hits the triangle at a positive
+// distance.
+int triangle_intersect(const Triangle* triangle, const Ray3* ray,
+					   TriangleHit* hit) {
+#if TRIANGLE_INTERSECT == TRIANGLE_PROJECTION
+	return triangle_intersect_projection(triangle, ray, hit);
+#elif TRIANGLE_INTERSECT == TRIANGLE_MOLLER
+	return triangle_intersect_moller(&triangle->p1, &triangle->e1,
+									 &triangle->e2, ray, hit);
+#else
+	const RayShear shear = ray_shear_new(ray);
+	return triangle_intersect_watertight(&triangle->p1, &triangle->p2,
+										 &triangle->p3, ray, &shear, hit);
+#endif
+}
+
+float triangle_intersect_distance(const void* triangle, const Ray3* ray) {
+	TriangleHit hit;
+	if (triangle_intersect((const Triangle*)triangle, ray, &hit))
+		return hit.distance;
+	return -1;
+}
+
+#if TRIANGLE_INTERSECT == TRIANGLE_PROJECTION
 int projection_type(const Plane* plane) {
 	if (fabsf(plane->normal.x) >= fabsf(plane->normal.y) &&
 		fabsf(plane->normal.x) >= fabsf(plane->normal.z))
@@ -60,17 +93,16 @@ int projection_type(const Plane* plane) {
 	return XY;
 }
 
-float triangle_intersect_distance(const void* triangle, const Ray3* ray) {
-	const Triangle* tri = (Triangle*)triangle;
+int triangle_intersect_projection(const Triangle* tri, const Ray3* ray,
+								  TriangleHit* hit) {
 	const float distance = plane_intersect_distance(&tri->plane, ray);
-	if (distance < 0.0) return distance;
+	if (distance < 0.0) return 0;
 	const Float3 movement = float3_mul(&ray->direction, distance);
 	const Float3 point = float3_add(&ray->origin, &movement);
 	float cross1, cross2, cross3;
-	const int type = projection_type(&tri->plane);
 	Float2 projection;
-	if (type == XY) projection = float2_new(point.x, point.y);
-	else if (type == YZ) projection = float2_new(point.y, point.z);
+	if (tri->projection == XY) projection = float2_new(point.x, point.y);
+	else if (tri->projection == YZ) projection = float2_new(point.y, point.z);
 	else projection = float2_new(point.z, point.x);
 	Float2 tmp = float2_sub(&projection, &tri->r1.origin);
 	cross1 = float2_cross(&tri->r1.direction, &tmp);
@@ -78,11 +110,119 @@ float triangle_intersect_distance(const void* triangle, const Ray3* ray) {
 	cross2 = float2_cross(&tri->r2.direction, &tmp);
 	tmp = float2_sub(&projection, &tri->r3.origin);
 	cross3 = float2_cross(&tri->r3.direction, &tmp);
-	if (cross1 < 0.0 && cross2 < 0.0 && cross3 < 0.0) return distance;
-	return -1;
+	if (!(cross1 < 0.0 && cross2 < 0.0 && cross3 < 0.0)) return 0;
+
+	// r1..r3 may have swapped p2 and p3, so the barycentrics come from 3D
+	const Float3 e1 = float3_sub(&tri->p2, &tri->p1);
+	const Float3 e2 = float3_sub(&tri->p3, &tri->p1);
+	const Float3 d = float3_sub(&point, &tri->p1);
+	const float d11 = float3_dot(&e1, &e1), d12 = float3_dot(&e1, &e2);
+	const float d22 = float3_dot(&e2, &e2);
+	const float d1 = float3_dot(&d, &e1), d2 = float3_dot(&d, &e2);
+	const float inv_denominator = 1.0f / (d11 * d22 - d12 * d12);
+	hit->distance = distance;
+	hit->u = (d22 * d1 - d12 * d2) * inv_denominator;
+	hit->v = (d11 * d2 - d12 * d1) * inv_denominator;
+	return 1;
+}
+#endif
+
+// Möller–Trumbore on the precomputed edges e1 = p2 - p1, e2 = p3 - p1.
+int triangle_intersect_moller(const Float3* p1, const Float3* e1,
+							  const Float3* e2, const Ray3* ray,
+							  TriangleHit* hit) {
+	const Float3 p = float3_cross(&ray->direction, e2);
+	const float det = float3_dot(e1, &p);
+	if (fabsf(det) < TRIANGLE_DET_EPSILON) return 0;
+	const float inv_det = 1.0f / det;
+	const Float3 t = float3_sub(&ray->origin, p1);
+	const float u = float3_dot(&t, &p) * inv_det;
+	if (u < 0 || u > 1) return 0;
+	const Float3 q = float3_cross(&t, e1);
+	const float v = float3_dot(&ray->direction, &q) * inv_det;
+	if (v < 0 || u + v > 1) return 0;
+	const float distance = float3_dot(e2, &q) * inv_det;
+	if (!(distance > 0)) return 0;
+	hit->distance = distance;
+	hit->u = u;
+	hit->v = v;
+	return 1;
+}
+
+RayShear ray_shear_new(const Ray3* ray) {
+	const Float3* d = &ray->direction;
+	const float abs_x = fabsf(d->x), abs_y = fabsf(d->y), abs_z = fabsf(d->z);
+	RayShear shear;
+	shear.kz = abs_x >= abs_y && abs_x >= abs_z ? 0 : (abs_y >= abs_z ? 1 : 2);
+	shear.kx = (shear.kz + 1) % 3;
+	shear.ky = (shear.kx + 1) % 3;
+	const float dz = float3_axis(d, shear.kz);
+	// keeps the winding, so the edge functions have the same sign convention
+	// for every ray
+	if (dz < 0) {
+		const int tmp = shear.kx;
+		shear.kx = shear.ky;
+		shear.ky = tmp;
+	}
+	shear.sx = float3_axis(d, shear.kx) / dz;
+	shear.sy = float3_axis(d, shear.ky) / dz;
+	shear.sz = 1.0f / dz;
+	return shear;
+}
+
+// The vertices are moved to the ray space (origin at the ray origin, ray along
+// +z) and the edges are tested in 2D there. Two triangles sharing an edge
+// compute the same edge function with opposite sign, bit for bit, so a ray
+// can't slip between them. That only holds if the products are rounded
+// separately: the edge functions must not be contracted to fma.
+int triangle_intersect_watertight(const Float3* p1, const Float3* p2,
+								  const Float3* p3, const Ray3* ray,
+								  const RayShear* shear, TriangleHit* hit) {
+	const Float3 a = float3_sub(p1, &ray->origin);
+	const Float3 b = float3_sub(p2, &ray->origin);
+	const Float3 c = float3_sub(p3, &ray->origin);
+	const float az = float3_axis(&a, shear->kz);
+	const float bz = float3_axis(&b, shear->kz);
+	const float cz = float3_axis(&c, shear->kz);
+	const float ax = float3_axis(&a, shear->kx) - shear->sx * az;
+	const float ay = float3_axis(&a, shear->ky) - shear->sy * az;
+	const float bx = float3_axis(&b, shear->kx) - shear->sx * bz;
+	const float by = float3_axis(&b, shear->ky) - shear->sy * bz;
+	const float cx = float3_axis(&c, shear->kx) - shear->sx * cz;
+	const float cy = float3_axis(&c, shear->ky) - shear->sy * cz;
+
+	// w1 is the edge opposite to p1 and so on
+	float w1 = cx * by - cy * bx;
+	float w2 = ax * cy - ay * cx;
+	float w3 = bx * ay - by * ax;
+	if (w1 == 0 || w2 == 0 || w3 == 0) {
+		// exact in double, so the sign on the edge is right
+		w1 = (double)cx * by - (double)cy * bx;
+		w2 = (double)ax * cy - (double)ay * cx;
+		w3 = (double)bx * ay - (double)by * ax;
+	}
+	if ((w1 < 0 || w2 < 0 || w3 < 0) && (w1 > 0 || w2 > 0 || w3 > 0))
+		return 0;
+	const float det = w1 + w2 + w3;
+	if (det == 0) return 0;
+	const float inv_det = 1.0f / det;
+	const float distance = (w1 * az + w2 * bz + w3 * cz) * shear->sz * inv_det;
+	if (!(distance > 0)) return 0;
+	hit->distance = distance;
+	hit->u = w2 * inv_det;
+	hit->v = w3 * inv_det;
+	return 1;
 }
 
 Float3 triangle_normal_normalized(const void* triangle, const Float3* point) {
 	Triangle* tri = (Triangle*)triangle;
 	return plane_normal_normalized(&tri->plane, point);
 }
+
+Aabb triangle_bounds(const Triangle* triangle) {
+	Aabb bounds = aabb_empty();
+	aabb_grow_point(&bounds, &triangle->p1);
+	aabb_grow_point(&bounds, &triangle->p2);
+	aabb_grow_point(&bounds, &triangle->p3);
+	return bounds;
+}
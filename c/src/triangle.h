@@ -1,14 +1,58 @@
 #pragma once
 
+#include "aabb.h"
 #include "algebra.h"
 #include "plane.h"
 #include "ray.h"
 
+// Ray/triangle test, picked at build time with `make TRIANGLE=...`:
+// - projection: hit the plane, then 2D edge tests in the dominant plane
+// - moller: Möller–Trumbore on the precomputed edges
+// - watertight: Woop, Benthin, Wald (2013), no gaps along shared edges
+#define TRIANGLE_PROJECTION 1
+#define TRIANGLE_MOLLER 2
+#define TRIANGLE_WATERTIGHT 3
+#ifndef TRIANGLE_INTERSECT
+#define TRIANGLE_INTERSECT TRIANGLE_WATERTIGHT
+#endif
+
+// Below this |det| a ray is taken as parallel to the triangle (Möller–Trumbore)
+#define TRIANGLE_DET_EPSILON 1e-12f
+
 typedef struct _Triangle {
 	Plane plane;
+	Float3 p1, p2, p3;
+#if TRIANGLE_INTERSECT == TRIANGLE_PROJECTION
 	Ray2 r1, r2, r3;
+	int projection;
+#elif TRIANGLE_INTERSECT == TRIANGLE_MOLLER
+	Float3 e1, e2;
+#endif
 } Triangle;
 
+// point = (1 - u - v) * p1 + u * p2 + v * p3
+typedef struct _TriangleHit {
+	float distance, u, v;
+} TriangleHit;
+
+// Per ray part of the watertight test: the axis the ray mostly goes along is
+// kz, and the shear (sx, sy, sz) maps the ray direction to (0, 0, 1).
+typedef struct _RayShear {
+	int kx, ky, kz;
+	float sx, sy, sz;
+} RayShear;
+
 Triangle triangle_new(const Float3* p1, const Float3* p2, const Float3* p3);
+int triangle_intersect(const Triangle* triangle, const Ray3* ray,
+					   TriangleHit* hit);
 float triangle_intersect_distance(const void* triangle, const Ray3* ray);
 Float3 triangle_normal_normalized(const void* triangle, const Float3* point);
+Aabb triangle_bounds(const Triangle* triangle);
+
+RayShear ray_shear_new(const Ray3* ray);
+int triangle_intersect_watertight(const Float3* p1, const Float3* p2,
+								  const Float3* p3, const Ray3* ray,
+								  const RayShear* shear, TriangleHit* hit);
+int triangle_intersect_moller(const Float3* p1, const Float3* e1,
+							  const Float3* e2, const Ray3* ray,
+							  TriangleHit* hit);
@@ -4,11 +4,23 @@ use crate::object::{Intersectable, Plane};
 use crate::ray::Ray;
 use crate::utils::Float3;
 use crate::utils::Mat3;
-use std::sync::Arc;
+use rand::Rng;
 
+/// The screen of the camera: the primary rays of a pixel are made when it is
+/// traced, from its corner and the steps between pixels and between samples.
 #[derive(Debug)]
 pub struct Camera {
-    pub rays: Vec<Arc<[Ray]>>,
+    pub orig: Float3,
+    pub width: usize,
+    pub height: usize,
+    pub sqrt_ray_per_pixel: usize,
+    /// each ray at a random point of its sub-pixel instead of its corner
+    pub jitter: bool,
+    ul: Float3,
+    dx: Float3,
+    dy: Float3,
+    ddx: Float3,
+    ddy: Float3,
 }
 
 impl Camera {
@@ -24,30 +36,75 @@ impl Camera {
 
         let ratio = n_rays_x as f32 / n_rays_y as f32;
         let (ul, ur, _, dl) = screen_corners(&ray, alpha, ratio);
-        let pixel_per_ray = sqrt_ray_per_pixel * sqrt_ray_per_pixel;
 
-        let mut rays = Vec::with_capacity(n_rays_y * n_rays_x);
         let dy = (dl - &ul) / n_rays_y as f32;
         let dx = (ur - &ul) / n_rays_x as f32;
         let ddy = dy / sqrt_ray_per_pixel as f32;
         let ddx = dx / sqrt_ray_per_pixel as f32;
-        for i in 0..n_rays_y {
-            let delta_y = dy * i as f32;
-            for j in 0..n_rays_x {
-                let point = ul + &delta_y + &(dx * j as f32);
-                let mut group = Vec::with_capacity(pixel_per_ray);
-                for ii in 0..sqrt_ray_per_pixel {
-                    let ddelta_y = ddy * ii as f32;
-                    for jj in 0..sqrt_ray_per_pixel {
-                        let point = point + &ddelta_y + &(ddx * jj as f32);
-                        group.push(Ray::new_norm(ray.orig, point - &ray.orig));
-                    }
-                }
-                rays.push(group.into());
-            }
+
+        return Camera {
+            orig: ray.orig,
+            width: n_rays_x,
+            height: n_rays_y,
+            sqrt_ray_per_pixel,
+            jitter: false,
+            ul,
+            dx,
+            dy,
+            ddx,
+            ddy,
+        };
+    }
+
+    pub fn ray_per_pixel(&self) -> usize {
+        return self.sqrt_ray_per_pixel * self.sqrt_ray_per_pixel;
+    }
+
+    pub fn total_pixel(&self) -> usize {
+        return self.width * self.height;
+    }
+
+    /// The rays of pixel `i`, row by row, one per sub-pixel
+    pub fn pixel_rays(&self, i: usize) -> PixelRays<'_> {
+        let delta_y = self.dy * (i / self.width) as f32;
+        let corner = self.ul + &delta_y + &(self.dx * (i % self.width) as f32);
+        return PixelRays {
+            camera: self,
+            corner,
+            sub: 0,
+        };
+    }
+}
+
+pub struct PixelRays<'a> {
+    camera: &'a Camera,
+    corner: Float3,
+    sub: usize,
+}
+
+impl Iterator for PixelRays<'_> {
+    type Item = Ray;
+
+    fn next(&mut self) -> Option<Ray> {
+        let camera = self.camera;
+        if self.sub == camera.ray_per_pixel() {
+            return None;
+        }
+        let mut ii = (self.sub / camera.sqrt_ray_per_pixel) as f32;
+        let mut jj = (self.sub % camera.sqrt_ray_per_pixel) as f32;
+        self.sub += 1;
+        if camera.jitter {
+            let mut rng = rand::thread_rng();
+            ii += rng.gen_range(0.0..1.0);
+            jj += rng.gen_range(0.0..1.0);
         }
+        let point = self.corner + &(camera.ddy * ii) + &(camera.ddx * jj);
+        return Some(Ray::new_norm(camera.orig, point - &camera.orig));
+    }
 
-        return Camera { rays };
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        let left = self.camera.ray_per_pixel() - self.sub;
+        return (left, Some(left));
     }
 }
 
@@ -134,4 +191,46 @@ mod tests {
         assert!((dl.y - 0.07).abs() < 1e-2);
         assert!((dl.z - 0.17).abs() < 1e-2);
     }
+
+    #[test]
+    fn test_pixel_rays() {
+        let ray = Ray::new_norm(Float3::new(0.0, 0.0, 0.0), Float3::new(1.0, 1.0, 1.0));
+        let alpha = 90f32.to_radians();
+        let camera = Camera::new_rectangle(&ray, alpha, 4, 2, 3);
+        let (ul, ur, dr, _) = screen_corners(&ray, alpha, 2.0);
+
+        assert_eq!(camera.pixel_rays(0).count(), 9);
+        let first = camera.pixel_rays(0).next().unwrap();
+        let expected = Ray::new_norm(ray.orig, ul);
+        assert!((first.dir - &expected.dir).norm() < 1e-5);
+
+        // the last sub-pixel of the last pixel is one sub-pixel from dr
+        let last = camera.pixel_rays(7).last().unwrap();
+        let step = (ur - &ul) / 12.0 + &((dr - &ur) / 6.0);
+        let expected = Ray::new_norm(ray.orig, dr - &step);
+        assert!((last.dir - &expected.dir).norm() < 1e-5);
+    }
+
+    #[test]
+    fn test_jittered_rays() {
+        let ray = Ray::new_norm(Float3::new(1.0, 2.0, 3.0), Float3::new(1.0, -1.0, 0.5));
+        let mut camera = Camera::new_rectangle(&ray, 1.0, 5, 3, 4);
+        camera.jitter = true;
+        let normal = camera.dx.cross(&camera.dy);
+        for i in 0..camera.total_pixel() {
+            let (row, col) = ((i / camera.width) as f32, (i % camera.width) as f32);
+            for (sub, ray) in camera.pixel_rays(i).enumerate() {
+                // where the ray crosses the screen, in pixels from its corner
+                let t = (camera.ul - &ray.orig).dot(&normal) / ray.dir.dot(&normal);
+                let offset = ray.orig + &(ray.dir * t) - &camera.ul;
+                let x = offset.dot(&camera.dx) / camera.dx.dot(&camera.dx) - col;
+                let y = offset.dot(&camera.dy) / camera.dy.dot(&camera.dy) - row;
+                // inside the sub-pixel of the sample, so inside the pixel
+                let n = camera.sqrt_ray_per_pixel as f32;
+                let (sub_y, sub_x) = ((sub / 4) as f32 / n, (sub % 4) as f32 / n);
+                assert!(sub_x - 1e-3 <= x && x <= sub_x + 1.0 / n + 1e-3);
+                assert!(sub_y - 1e-3 <= y && y <= sub_y + 1.0 / n + 1e-3);
+            }
+        }
+    }
 }
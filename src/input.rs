@@ -1,5 +1,5 @@
 use crate::camera::Camera;
-use crate::object::{triangle, Object, Plane, Sphere};
+use crate::object::{triangle, Object, ObjectList, Plane, Sphere};
 use crate::ray::Ray;
 use crate::utils::Float3;
 use crate::Result;
@@ -52,7 +52,7 @@ pub struct Settings {
     pub camera: Camera,
     pub background: Float3,
     pub max_bounces: usize,
-    pub objs: Vec<Object>,
+    pub objs: ObjectList,
 }
 
 pub fn read_input(filename: &str) -> Result<Settings> {
@@ -85,14 +85,14 @@ pub fn read_input(filename: &str) -> Result<Settings> {
                 let col = Float3::new(scan.tok(), scan.tok(), scan.tok());
                 let reflect = scan.tok();
                 let intensity: f32 = scan.tok();
-                objs.push(Object::new(Box::new(sphere), col, intensity, reflect));
+                objs.push(Object::new(sphere, col, intensity, reflect));
             }
             "plane" => {
                 let plane = Plane::new(scan.tok(), scan.tok(), scan.tok(), scan.tok());
                 let col = Float3::new(scan.tok(), scan.tok(), scan.tok());
                 let reflect = scan.tok();
                 let intensity: f32 = scan.tok();
-                objs.push(Object::new(Box::new(plane), col, intensity, reflect));
+                objs.push(Object::new(plane, col, intensity, reflect));
             }
             "triangle" => {
                 let p1 = Float3::new(scan.tok(), scan.tok(), scan.tok());
@@ -102,7 +102,7 @@ pub fn read_input(filename: &str) -> Result<Settings> {
                 let col = Float3::new(scan.tok(), scan.tok(), scan.tok());
                 let reflect = scan.tok();
                 let intensity: f32 = scan.tok();
-                objs.push(Object::new(Box::new(triangle), col, intensity, reflect));
+                objs.push(Object::new(triangle, col, intensity, reflect));
             }
             _ => {
                 return Err(Box::new(io::Error::new(
@@ -120,6 +120,6 @@ pub fn read_input(filename: &str) -> Result<Settings> {
         background,
         number_of_updates: number_of_update,
         max_bounces,
-        objs,
+        objs: ObjectList::new(objs),
     });
 }
@@ -7,17 +7,23 @@ pub mod utils;
 
 pub type Result<T> = std::result::Result<T, Box<dyn Error>>;
 
+use camera::Camera;
 use input::Settings;
+use object::ObjectList;
 use ray::Ray;
 use std::error::Error;
 use std::fs::File;
 use std::io::Write;
 use std::io::{Seek, SeekFrom};
-use std::sync::{Arc, Mutex};
 use std::thread;
 use threadpool::ThreadPool;
 use utils::Float3;
 
+/// The rows of a tile: a tile is a job, and it owns its part of the image.
+/// It is traced in square blocks of that side, the pixels of a block in
+/// Z-order, so neighbouring pixels follow each other in both directions.
+const TILE_ROWS: usize = 8;
+
 struct ImageStatus {
     float3s: Vec<Float3>,
     u8s: Vec<u8>,
@@ -29,16 +35,40 @@ impl ImageStatus {
         let u8s = vec![0; total_pixel * 3];
         return Self { float3s, u8s };
     }
+
+    /// The image cut in bands of `rows` whole rows, each one borrowing its
+    /// pixels of both buffers: no two tiles share a pixel.
+    fn tiles(&mut self, width: usize, rows: usize) -> Vec<Tile<'_>> {
+        let pixels = width * rows;
+        let float3s = self.float3s.chunks_mut(pixels);
+        let u8s = self.u8s.chunks_mut(pixels * 3);
+        return float3s
+            .zip(u8s)
+            .enumerate()
+            .map(|(i, (float3s, u8s))| Tile {
+                first_pixel: i * pixels,
+                float3s,
+                u8s,
+            })
+            .collect();
+    }
+}
+
+struct Tile<'a> {
+    first_pixel: usize,
+    float3s: &'a mut [Float3],
+    u8s: &'a mut [u8],
 }
 
 pub fn shoot_and_draw(settings: Settings) -> Result<()> {
     let number_of_updates = settings.number_of_updates;
-    let camera = &settings.camera.rays;
-    let background = settings.background;
-    let objs = Arc::new(settings.objs);
+    let camera = &settings.camera;
+    let background = &settings.background;
+    let objs = &settings.objs;
+    let max_bounces = settings.max_bounces;
     let width = settings.width;
     let height = settings.height;
-    let ray_per_pixel = camera[0].len();
+    let ray_per_pixel = camera.ray_per_pixel();
     let n_threads = if settings.n_threads > 0 {
         settings.n_threads
     } else {
@@ -52,32 +82,22 @@ pub fn shoot_and_draw(settings: Settings) -> Result<()> {
     eprintln!("0 / {}", number_of_updates);
 
     let pool = ThreadPool::new(n_threads);
-    let image_status = Arc::new(Mutex::new(ImageStatus::new(width * height)));
+    let mut image_status = ImageStatus::new(width * height);
     for nou in 1..=number_of_updates {
         let to_multiply = 255.0 / (nou * ray_per_pixel) as f32;
-        pool.add(camera.len());
-        for (i, ray_group) in camera.iter().enumerate() {
-            let objs = Arc::clone(&objs);
-            let image_status = Arc::clone(&image_status);
-            let ray_group = Arc::clone(ray_group);
-            pool.execute(move || {
-                let mut local_pix_sum = Float3::new(0.0, 0.0, 0.0);
-                for ray in ray_group.iter() {
-                    let light = trace_ray(&ray, &objs, settings.max_bounces, &background);
-                    local_pix_sum.sum(&light);
-                }
-                let mut image_status = image_status.lock().unwrap();
-                image_status.float3s[i].sum(&local_pix_sum);
-                let total_pix_sum = image_status.float3s[i];
-                let rgb = &mut image_status.u8s[i * 3..i * 3 + 3];
-                rgb[0] = (total_pix_sum.x * to_multiply) as u8;
-                rgb[1] = (total_pix_sum.y * to_multiply) as u8;
-                rgb[2] = (total_pix_sum.z * to_multiply) as u8;
-            });
-        }
-        pool.wait();
+        let jobs = image_status
+            .tiles(width, TILE_ROWS)
+            .into_iter()
+            .map(|tile| {
+                Box::new(move || {
+                    render_tile(tile, camera, objs, max_bounces, background, to_multiply)
+                }) as Box<dyn FnOnce() + Send>
+            })
+            .collect();
+        // returning from run() is the only synchronisation of a pass
+        pool.run(jobs);
         file.seek(SeekFrom::Start(header_len))?;
-        file.write_all(&image_status.lock().unwrap().u8s)?;
+        file.write_all(&image_status.u8s)?;
         file.flush()?;
         eprintln!("\x1b[A{} / {}", nou, number_of_updates);
     }
@@ -85,25 +105,66 @@ pub fn shoot_and_draw(settings: Settings) -> Result<()> {
     return Ok(());
 }
 
-fn trace_ray(ray: &Ray, objs: &[object::Object], bounces: usize, background: &Float3) -> Float3 {
+fn render_tile(
+    tile: Tile,
+    camera: &Camera,
+    objs: &ObjectList,
+    max_bounces: usize,
+    background: &Float3,
+    to_multiply: f32,
+) {
+    let rows = tile.float3s.len() / camera.width;
+    for i in tile_order(camera.width, rows) {
+        let mut local_pix_sum = Float3::new(0.0, 0.0, 0.0);
+        for ray in camera.pixel_rays(tile.first_pixel + i) {
+            let light = trace_ray(&ray, objs, max_bounces, background);
+            local_pix_sum.sum(&light);
+        }
+        let total_pix_sum = &mut tile.float3s[i];
+        total_pix_sum.sum(&local_pix_sum);
+        let rgb = &mut tile.u8s[i * 3..i * 3 + 3];
+        rgb[0] = (total_pix_sum.x * to_multiply) as u8;
+        rgb[1] = (total_pix_sum.y * to_multiply) as u8;
+        rgb[2] = (total_pix_sum.z * to_multiply) as u8;
+    }
+}
+
+/// The pixels of a tile of `width` x `rows`, by their index in it (row by
+/// row): blocks of TILE_ROWS x TILE_ROWS left to right, each one in Z-order.
+fn tile_order(width: usize, rows: usize) -> impl Iterator<Item = usize> {
+    (0..width).step_by(TILE_ROWS).flat_map(move |block_x| {
+        (0..TILE_ROWS * TILE_ROWS).filter_map(move |code| {
+            let x = block_x + morton_compact(code);
+            let y = morton_compact(code >> 1);
+            // the last block of a row may be cut by the edge of the image
+            (x < width && y < rows).then(|| y * width + x)
+        })
+    })
+}
+
+/// The even bits of a Morton code, packed: one of its two coordinates
+fn morton_compact(code: usize) -> usize {
+    let mut value = 0;
+    let mut bit = 0;
+    while code >> (2 * bit) != 0 {
+        value |= ((code >> (2 * bit)) & 1) << bit;
+        bit += 1;
+    }
+    return value;
+}
+
+pub fn trace_ray(ray: &Ray, objs: &ObjectList, bounces: usize, background: &Float3) -> Float3 {
     let mut ray = *ray;
     let mut color = Float3::new(1.0, 1.0, 1.0);
     let mut light = Float3::new(0.0, 0.0, 0.0);
     let mut prev = usize::MAX;
     for _ in 0..bounces {
-        let mut nearest: Option<(f32, &object::Object)> = None;
-        for obj in objs {
-            if let Some(t) = obj.shape.intersect(&ray) {
-                if (nearest.is_none() || t < nearest.unwrap().0) && prev != obj.id {
-                    nearest = Some((t, obj));
-                }
-            }
-        }
-        if let Some((t, obj)) = nearest {
-            prev = obj.id;
-            obj.reflect(&mut ray, t);
-            light.sum(&(obj.color * obj.emit_intensity * &color));
-            color.mul(&obj.color);
+        if let Some((t, i)) = objs.nearest(&ray, prev) {
+            let material = &objs.materials[i];
+            prev = i;
+            objs.reflect(i, &mut ray, t);
+            light.sum(&(material.color * material.emit_intensity * &color));
+            color.mul(&material.color);
         } else {
             break;
         }
@@ -111,3 +172,19 @@ fn trace_ray(ray: &Ray, objs: &[object::Object], bounces: usize, background: &Fl
     light.sum(&(*background * &color));
     return light;
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_tile_order() {
+        let order: Vec<usize> = tile_order(20, 8).collect();
+        assert_eq!(order[..5], [0, 1, 20, 21, 2]);
+        let mut sorted = order.clone();
+        sorted.sort();
+        assert_eq!(sorted, (0..160).collect::<Vec<_>>());
+        // the last band of an image may have fewer rows
+        assert_eq!(tile_order(20, 3).count(), 60);
+    }
+}
@@ -3,7 +3,9 @@ use ray_tracing_image::shoot_and_draw;
 use ray_tracing_image::Result;
 
 fn main() -> Result<()> {
-    let settings = read_input("c/input.txt")?;
+    let mut settings = read_input("c/input.txt")?;
+    // `--jitter`: every sample at a random point of its sub-pixel
+    settings.camera.jitter = std::env::args().skip(1).any(|arg| arg == "--jitter");
     shoot_and_draw(settings)?;
     Ok(())
 }
@@ -17,48 +17,207 @@ pub trait Intersectable {
     fn normal(&self, ray: &Ray) -> Ray;
 }
 
-pub struct Object {
-    pub shape: Box<dyn Intersectable + Sync + Send>,
+/// The shape of an object, matched on instead of called through a vtable
+#[derive(Debug, Clone)]
+pub enum Shape {
+    Sphere(Sphere),
+    Plane(Plane),
+    Triangle(Triangle),
+}
+
+impl Intersectable for Shape {
+    #[inline]
+    fn intersect(&self, ray: &Ray) -> Option<f32> {
+        return match self {
+            Shape::Sphere(sphere) => sphere.intersect(ray),
+            Shape::Plane(plane) => plane.intersect(ray),
+            Shape::Triangle(triangle) => triangle.intersect(ray),
+        };
+    }
+
+    #[inline]
+    fn normal(&self, ray: &Ray) -> Ray {
+        return match self {
+            Shape::Sphere(sphere) => sphere.normal(ray),
+            Shape::Plane(plane) => plane.normal(ray),
+            Shape::Triangle(triangle) => triangle.normal(ray),
+        };
+    }
+}
+
+impl From<Sphere> for Shape {
+    fn from(sphere: Sphere) -> Self {
+        return Shape::Sphere(sphere);
+    }
+}
+
+impl From<Plane> for Shape {
+    fn from(plane: Plane) -> Self {
+        return Shape::Plane(plane);
+    }
+}
+
+impl From<Triangle> for Shape {
+    fn from(triangle: Triangle) -> Self {
+        return Shape::Triangle(triangle);
+    }
+}
+
+/// The color, emission and reflection of an object
+#[derive(Debug, Clone)]
+pub struct Material {
     pub color: Float3,
     pub emit_intensity: f32,
     pub reflection: f32,
-    pub id: usize,
+}
+
+impl Material {
+    /// Bounces `ray`, already moved to the hit point, off a surface of
+    /// normal `norm`
+    pub fn reflect(&self, ray: &mut Ray, norm: Ray) {
+        let mut rng = rand::thread_rng();
+        let flip = rng.gen_range(0.0..=1.0);
+        if flip < self.reflection {
+            ray.dir = ray.dir.reflect(&norm.dir);
+        } else {
+            ray.dir = half_sphere_random(norm, &mut rng);
+        }
+    }
+}
+
+/// An object of a scene, as it is read: ObjectList::new splits it into its
+/// shape and its material
+pub struct Object {
+    pub shape: Shape,
+    pub material: Material,
 }
 
 impl Object {
     pub fn new(
-        shape: Box<dyn Intersectable + Sync + Send>,
+        shape: impl Into<Shape>,
         color: Float3,
         emit_intensity: f32,
         reflection: f32,
     ) -> Self {
-        static mut ID: usize = 0;
-        let id = unsafe {
-            ID += 1;
-            ID
-        };
         return Object {
-            shape,
-            color,
-            emit_intensity,
-            reflection,
-            id,
+            shape: shape.into(),
+            material: Material {
+                color,
+                emit_intensity,
+                reflection,
+            },
         };
     }
+}
 
-    pub fn reflect(&self, ray: &mut Ray, t: f32) {
-        ray.move_along(t);
-        let norm = self.shape.normal(&ray);
-        let mut rng = rand::thread_rng();
-        let flip = rng.gen_range(0.0..=1.0);
-        if flip < self.reflection {
-            ray.dir = ray.dir.reflect(&norm.dir);
-        } else {
-            ray.dir = half_sphere_random(norm, &mut rng);
+/// The objects of a scene. Their shapes are kept in one contiguous array per
+/// type, so the nearest hit is found by one loop per type, which the compiler
+/// inlines for that shape; the materials are kept by object index.
+pub struct ObjectList {
+    pub materials: Vec<Material>,
+    /// where the shape of each object is
+    shapes: Vec<ShapeIndex>,
+    spheres: ShapeArray<Sphere>,
+    planes: ShapeArray<Plane>,
+    triangles: ShapeArray<Triangle>,
+}
+
+/// The index of a shape in the array of its type
+#[derive(Debug, Clone, Copy)]
+enum ShapeIndex {
+    Sphere(usize),
+    Plane(usize),
+    Triangle(usize),
+}
+
+struct ShapeArray<T> {
+    shapes: Vec<T>,
+    /// the index of the object of each shape
+    objects: Vec<usize>,
+}
+
+impl<T: Intersectable> ShapeArray<T> {
+    fn new() -> Self {
+        return ShapeArray {
+            shapes: Vec::new(),
+            objects: Vec::new(),
+        };
+    }
+
+    /// Adds the shape of `object`, and returns its index in the array
+    fn push(&mut self, shape: T, object: usize) -> usize {
+        self.shapes.push(shape);
+        self.objects.push(object);
+        return self.shapes.len() - 1;
+    }
+
+    /// Keeps in `nearest` the closest hit so far, leaving out object `skip`.
+    /// A tie goes to the object that comes first, whatever its type.
+    #[inline]
+    fn nearest(&self, ray: &Ray, skip: usize, nearest: &mut Option<(f32, usize)>) {
+        for (shape, &object) in self.shapes.iter().zip(&self.objects) {
+            if let Some(t) = shape.intersect(ray) {
+                let closer = match *nearest {
+                    None => true,
+                    Some((best, best_object)) => t < best || (t == best && object < best_object),
+                };
+                if closer && object != skip {
+                    *nearest = Some((t, object));
+                }
+            }
         }
     }
 }
 
+impl ObjectList {
+    pub fn new(objs: Vec<Object>) -> Self {
+        let mut materials = Vec::with_capacity(objs.len());
+        let mut shapes = Vec::with_capacity(objs.len());
+        let mut spheres = ShapeArray::new();
+        let mut planes = ShapeArray::new();
+        let mut triangles = ShapeArray::new();
+        for (i, obj) in objs.into_iter().enumerate() {
+            shapes.push(match obj.shape {
+                Shape::Sphere(sphere) => ShapeIndex::Sphere(spheres.push(sphere, i)),
+                Shape::Plane(plane) => ShapeIndex::Plane(planes.push(plane, i)),
+                Shape::Triangle(triangle) => ShapeIndex::Triangle(triangles.push(triangle, i)),
+            });
+            materials.push(obj.material);
+        }
+        return ObjectList {
+            materials,
+            shapes,
+            spheres,
+            planes,
+            triangles,
+        };
+    }
+
+    /// The closest object `ray` hits, and its index, except object `skip`
+    pub fn nearest(&self, ray: &Ray, skip: usize) -> Option<(f32, usize)> {
+        let mut nearest = None;
+        self.spheres.nearest(ray, skip, &mut nearest);
+        self.planes.nearest(ray, skip, &mut nearest);
+        self.triangles.nearest(ray, skip, &mut nearest);
+        return nearest;
+    }
+
+    pub fn normal(&self, object: usize, ray: &Ray) -> Ray {
+        return match self.shapes[object] {
+            ShapeIndex::Sphere(i) => self.spheres.shapes[i].normal(ray),
+            ShapeIndex::Plane(i) => self.planes.shapes[i].normal(ray),
+            ShapeIndex::Triangle(i) => self.triangles.shapes[i].normal(ray),
+        };
+    }
+
+    /// Moves `ray` by `t` to where it hits `object`, and bounces it off
+    pub fn reflect(&self, object: usize, ray: &mut Ray, t: f32) {
+        ray.move_along(t);
+        let norm = self.normal(object, ray);
+        self.materials[object].reflect(ray, norm);
+    }
+}
+
 fn half_sphere_random(norm: Ray, rng: &mut ThreadRng) -> Float3 {
     let phi = rng.gen_range(0.0..2.0 * PI);
     let theta = rng.gen_range(0.0..PI);
@@ -71,3 +230,45 @@ fn half_sphere_random(norm: Ray, rng: &mut ThreadRng) -> Float3 {
     }
     return dir;
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_nearest_tie() {
+        // a sphere, a plane and a triangle all hit at t = 5
+        let ray = Ray::new_norm(Float3::new(0.0, 0.0, 0.0), Float3::new(1.0, 0.0, 0.0));
+        let (p1, p2, p3) = (
+            Float3::new(5.0, -1.0, -1.0),
+            Float3::new(5.0, 1.0, -1.0),
+            Float3::new(5.0, 0.0, 1.0),
+        );
+        let color = Float3::new(0.5, 0.5, 0.5);
+        let shapes = || -> [Shape; 3] {
+            return [
+                Sphere::new(Float3::new(8.0, 0.0, 0.0), 3.0).into(),
+                Plane::new(1.0, 0.0, 0.0, -5.0).into(),
+                Triangle::new(p1, p2, p3).into(),
+            ];
+        };
+        // every order of the three: the first one listed wins, then the second
+        for order in [
+            [0, 1, 2],
+            [0, 2, 1],
+            [1, 0, 2],
+            [1, 2, 0],
+            [2, 0, 1],
+            [2, 1, 0],
+        ] {
+            let mut shapes = shapes().map(Some);
+            let objs = order
+                .iter()
+                .map(|&i| Object::new(shapes[i].take().unwrap(), color, 0.0, 0.0))
+                .collect();
+            let list = ObjectList::new(objs);
+            assert_eq!(list.nearest(&ray, usize::MAX), Some((5.0, 0)));
+            assert_eq!(list.nearest(&ray, 0), Some((5.0, 1)));
+        }
+    }
+}
@@ -3,7 +3,7 @@ use crate::ray::Ray;
 use crate::utils::Float3;
 
 // ax + by + cz + d = 0
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct Plane {
     pub a: f32,
     pub b: f32,
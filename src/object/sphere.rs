@@ -2,6 +2,7 @@ use crate::object::Intersectable;
 use crate::ray::Ray;
 use crate::utils::Float3;
 
+#[derive(Debug, Clone)]
 pub struct Sphere {
     pub center: Float3,
     pub radius: f32,
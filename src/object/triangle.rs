@@ -3,7 +3,7 @@ use crate::object::Plane;
 use crate::ray::{Ray, Ray2};
 use crate::utils::{Float2, Float3};
 
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 enum Projection {
     XY,
     YZ,
@@ -11,7 +11,7 @@ enum Projection {
 }
 
 // ax + by + cz = d
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct Triangle {
     plane: Plane,
     projection: Projection,
@@ -1,93 +1,321 @@
-use std::sync::{mpsc, Arc, Mutex};
+use std::collections::VecDeque;
+use std::panic::{self, AssertUnwindSafe};
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
 use std::thread;
 
+/// A work-stealing pool: every worker has its own queue, takes jobs from its
+/// front and, once it is empty, steals from the back of the others. A queue
+/// is only locked by its owner and the odd thief, so the workers don't fight
+/// over one lock; completion is one atomic counter.
 pub struct ThreadPool {
-    workers: Vec<Worker>,
-    sender: Option<mpsc::Sender<Job>>,
-    waiter: mpsc::Receiver<()>,
-    todos: Arc<Mutex<usize>>
+    workers: Vec<thread::JoinHandle<()>>,
+    shared: Arc<Shared>,
 }
 
 type Job = Box<dyn FnOnce() + Send + 'static>;
 
+struct Shared {
+    queues: Vec<Mutex<VecDeque<Job>>>,
+    /// jobs waiting in the queues: the workers sleep when it is 0
+    queued: AtomicUsize,
+    /// jobs submitted and not done yet: wait() returns when it is 0
+    pending: AtomicUsize,
+    /// the queue the next single job goes to
+    next_queue: AtomicUsize,
+    panicked: AtomicBool,
+    /// true once the pool is dropped
+    sleep: Mutex<bool>,
+    wake: Condvar,
+    done: Mutex<()>,
+    all_done: Condvar,
+}
+
 impl ThreadPool {
     pub fn new(size: usize) -> Self {
-        let (sender, receiver) = mpsc::channel();
-        let receiver = Arc::new(Mutex::new(receiver));
-        let mut workers = Vec::with_capacity(size);
-        let (interrupt, waiter) = mpsc::channel();
-        let todos = Arc::new(Mutex::new(0));
-        for id in 0..size {
-            workers.push(Worker::new(id, Arc::clone(&receiver), Arc::clone(&todos), interrupt.clone()));
-        }
-        ThreadPool {
-            workers,
-            sender: Some(sender),
-            waiter,
-            todos
-        }
+        assert!(size > 0);
+        let shared = Arc::new(Shared {
+            queues: (0..size).map(|_| Mutex::new(VecDeque::new())).collect(),
+            queued: AtomicUsize::new(0),
+            pending: AtomicUsize::new(0),
+            next_queue: AtomicUsize::new(0),
+            panicked: AtomicBool::new(false),
+            sleep: Mutex::new(false),
+            wake: Condvar::new(),
+            done: Mutex::new(()),
+            all_done: Condvar::new(),
+        });
+        let workers = (0..size)
+            .map(|id| {
+                let shared = Arc::clone(&shared);
+                thread::spawn(move || shared.work(id))
+            })
+            .collect();
+        return ThreadPool { workers, shared };
+    }
+
+    pub fn size(&self) -> usize {
+        return self.shared.queues.len();
     }
 
     pub fn execute<F>(&self, f: F)
     where
         F: FnOnce() + Send + 'static,
     {
-        let job = Box::new(f);
-        self.sender.as_ref().unwrap().send(job).unwrap();
+        let shared = &self.shared;
+        let queue = shared.next_queue.fetch_add(1, Ordering::Relaxed) % self.size();
+        shared.submit(vec![(queue, Box::new(f) as Job)]);
+    }
+
+    /// Submits all of `jobs` at once, dealt in contiguous runs to the queues:
+    /// one lock per queue instead of one per job.
+    pub fn execute_batch<I, F>(&self, jobs: I)
+    where
+        I: IntoIterator<Item = F>,
+        F: FnOnce() + Send + 'static,
+    {
+        self.submit_batch(jobs.into_iter().map(|f| Box::new(f) as Job).collect());
+    }
+
+    /// Runs `jobs`, which may borrow from the caller, and returns once all of
+    /// them are done. Like wait(), it must not be called from a job of the
+    /// same pool.
+    pub fn run<'a>(&self, jobs: Vec<Box<dyn FnOnce() + Send + 'a>>) {
+        let jobs = jobs
+            .into_iter()
+            // SAFETY: only the lifetime of the trait object changes, not its
+            // layout. No job is used after 'a, because:
+            // - a job counts in `pending` from before it is queued until
+            //   run_job() has called it; the call consumes the box, so it is
+            //   dropped by then, in catch_unwind if it panics;
+            // - a job that is never run (the pool can't be dropped while
+            //   `self` is borrowed) stays counted;
+            // - wait() returns only once `pending` is 0, and nothing between
+            //   submit_batch() and wait() can unwind: the queue locks are
+            //   never held while a job runs, so they are never poisoned.
+            .map(|job| unsafe { std::mem::transmute::<_, Job>(job) })
+            .collect();
+        self.submit_batch(jobs);
+        self.wait();
     }
 
+    /// Blocks until every job submitted so far is done. Panics if one of
+    /// them did.
     pub fn wait(&self) {
-        self.waiter.recv().unwrap();
+        let shared = &self.shared;
+        let mut done = shared.done.lock().unwrap();
+        while shared.pending.load(Ordering::Acquire) != 0 {
+            done = shared.all_done.wait(done).unwrap();
+        }
+        drop(done);
+        if shared.panicked.swap(false, Ordering::Relaxed) {
+            panic!("a job of the thread pool panicked");
+        }
     }
 
-    pub fn add(&self, todos: usize) {
-        *self.todos.lock().unwrap() += todos;
+    fn submit_batch(&self, jobs: Vec<Job>) {
+        let size = self.size();
+        let per_queue = (jobs.len() + size - 1) / size;
+        let jobs = jobs
+            .into_iter()
+            .enumerate()
+            .map(|(i, job)| (i / per_queue.max(1), job))
+            .collect();
+        self.shared.submit(jobs);
     }
 }
 
-impl Drop for ThreadPool {
-    fn drop(&mut self) {
-        drop(self.sender.take());
-        for worker in &mut self.workers {
-            if let Some(thread) = worker.thread.take() {
-                thread.join().unwrap();
+impl Shared {
+    /// Pushes each job to its queue, `jobs` sorted by queue
+    fn submit(&self, jobs: Vec<(usize, Job)>) {
+        if jobs.is_empty() {
+            return;
+        }
+        // counted before they can be taken, so neither counter goes below 0
+        self.pending.fetch_add(jobs.len(), Ordering::AcqRel);
+        self.queued.fetch_add(jobs.len(), Ordering::AcqRel);
+        let mut jobs = jobs.into_iter().peekable();
+        while let Some(&(queue, _)) = jobs.peek() {
+            let mut deque = self.queues[queue].lock().unwrap();
+            while let Some((_, job)) = jobs.next_if(|(q, _)| *q == queue) {
+                deque.push_back(job);
+            }
+        }
+        let _sleep = self.sleep.lock().unwrap();
+        self.wake.notify_all();
+    }
+
+    fn work(&self, id: usize) {
+        // jobs done and not yet taken off `pending`: it is updated once per
+        // run of jobs, when the own queue is found empty
+        let mut done = 0;
+        loop {
+            // taken out first: in the `if let` the guard would live on, and
+            // the queue stay locked, while the job runs
+            let job = self.queues[id].lock().unwrap().pop_front();
+            if let Some(job) = job {
+                self.run_job(job);
+                done += 1;
+                continue;
+            }
+            if done > 0 {
+                self.finish(done);
+                done = 0;
+            }
+            let job = self.steal(id);
+            if let Some(job) = job {
+                self.run_job(job);
+                done += 1;
+                continue;
+            }
+            if self.queued.load(Ordering::Acquire) != 0 {
+                // jobs on their way to a queue: let them get there
+                thread::yield_now();
+                continue;
+            }
+            let mut stop = self.sleep.lock().unwrap();
+            while self.queued.load(Ordering::Acquire) == 0 && !*stop {
+                stop = self.wake.wait(stop).unwrap();
+            }
+            if *stop && self.queued.load(Ordering::Acquire) == 0 {
+                return;
             }
         }
     }
+
+    fn run_job(&self, job: Job) {
+        self.queued.fetch_sub(1, Ordering::AcqRel);
+        if panic::catch_unwind(AssertUnwindSafe(job)).is_err() {
+            self.panicked.store(true, Ordering::Relaxed);
+        }
+    }
+
+    fn finish(&self, done: usize) {
+        if self.pending.fetch_sub(done, Ordering::AcqRel) == done {
+            let _done = self.done.lock().unwrap();
+            self.all_done.notify_all();
+        }
+    }
+
+    /// The back half of the first other queue that isn't empty: its last job
+    /// is run now, the others go to the own queue.
+    fn steal(&self, id: usize) -> Option<Job> {
+        let size = self.queues.len();
+        for i in 1..size {
+            if self.queued.load(Ordering::Acquire) == 0 {
+                return None;
+            }
+            let mut stolen = {
+                let mut victim = self.queues[(id + i) % size].lock().unwrap();
+                let keep = victim.len() / 2;
+                victim.split_off(keep)
+            };
+            if let Some(job) = stolen.pop_back() {
+                self.queues[id].lock().unwrap().append(&mut stolen);
+                return Some(job);
+            }
+        }
+        return None;
+    }
 }
 
-struct Worker {
-    _id: usize,
-    thread: Option<thread::JoinHandle<()>>,
+impl Drop for ThreadPool {
+    fn drop(&mut self) {
+        *self.shared.sleep.lock().unwrap() = true;
+        self.shared.wake.notify_all();
+        for worker in self.workers.drain(..) {
+            worker.join().unwrap();
+        }
+    }
 }
 
-impl Worker {
-    fn new(
-        id: usize,
-        receiver: Arc<Mutex<mpsc::Receiver<Job>>>,
-        todos: Arc<Mutex<usize>>,
-        interrupt: mpsc::Sender<()>
-    ) -> Worker {
-        let thread = thread::spawn(move || loop {
-            let message = receiver.lock().unwrap().recv();
-            match message {
-                Ok(job) => job(),
-                Err(_) => break,
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_wait() {
+        let pool = ThreadPool::new(4);
+        let count = Arc::new(AtomicUsize::new(0));
+        let jobs = (0..1000).map(|_| {
+            let count = Arc::clone(&count);
+            move || {
+                count.fetch_add(1, Ordering::Relaxed);
             }
-            sub_todo(&todos,&interrupt);
         });
-        Worker {
-            _id: id,
-            thread: Some(thread),
-        }
+        pool.execute_batch(jobs);
+        let count_one = Arc::clone(&count);
+        pool.execute(move || {
+            count_one.fetch_add(1, Ordering::Relaxed);
+        });
+        pool.wait();
+        assert_eq!(count.load(Ordering::Relaxed), 1001);
+    }
+
+    #[test]
+    fn test_run_borrows() {
+        let pool = ThreadPool::new(3);
+        let mut sums = vec![0; 10];
+        let jobs = sums
+            .iter_mut()
+            .enumerate()
+            .map(|(i, sum)| Box::new(move || *sum = i * i) as Box<dyn FnOnce() + Send>)
+            .collect();
+        pool.run(jobs);
+        assert_eq!(sums[9], 81);
+        assert_eq!(sums.iter().sum::<usize>(), 285);
     }
-}
 
-#[inline]
-fn sub_todo(todos: &Arc<Mutex<usize>>, interrupt: &mpsc::Sender<()>) {
-    let mut n = todos.lock().unwrap();
-    *n -= 1;
-    if *n == 0 {
-        interrupt.send(()).unwrap();
+    #[test]
+    fn test_nested_execute() {
+        let pool = Arc::new(ThreadPool::new(1));
+        let count = Arc::new(AtomicUsize::new(0));
+        let (inner_pool, inner_count) = (Arc::clone(&pool), Arc::clone(&count));
+        pool.execute(move || {
+            let count = Arc::clone(&inner_count);
+            inner_pool.execute(move || {
+                count.fetch_add(1, Ordering::Relaxed);
+            });
+            inner_count.fetch_add(1, Ordering::Relaxed);
+        });
+        pool.wait();
+        assert_eq!(count.load(Ordering::Relaxed), 2);
+    }
+
+    #[test]
+    fn test_execute_while_busy() {
+        let pool = ThreadPool::new(2);
+        // every worker runs a job that waits for `release`, up to 10 s
+        let release = Arc::new((Mutex::new(false), Condvar::new()));
+        let started = Arc::new(AtomicUsize::new(0));
+        let released = Arc::new(AtomicUsize::new(0));
+        let jobs = (0..pool.size()).map(|_| {
+            let (release, started) = (Arc::clone(&release), Arc::clone(&started));
+            let released = Arc::clone(&released);
+            move || {
+                started.fetch_add(1, Ordering::AcqRel);
+                let (lock, condvar) = &*release;
+                let timeout = std::time::Duration::from_secs(10);
+                let guard = lock.lock().unwrap();
+                let (guard, _) = condvar.wait_timeout_while(guard, timeout, |r| !*r).unwrap();
+                if *guard {
+                    released.fetch_add(1, Ordering::Relaxed);
+                }
+            }
+        });
+        pool.execute_batch(jobs);
+        while started.load(Ordering::Acquire) < pool.size() {
+            thread::yield_now();
+        }
+        // one job per queue, and a batch: none of them may wait for the
+        // busy workers
+        for _ in 0..pool.size() {
+            pool.execute(|| {});
+        }
+        pool.execute_batch((0..10).map(|_| || {}));
+        *release.0.lock().unwrap() = true;
+        release.1.notify_all();
+        pool.wait();
+        assert_eq!(released.load(Ordering::Relaxed), pool.size());
     }
 }